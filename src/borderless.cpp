@@ -27,7 +27,7 @@ void Borderless::Load()
         case M2FixGame::NMA1:
         case M2FixGame::NMA2:
         {
-            bool ret = false;
+            M2Hook::Result ret = false;
 
             ret = M2Hook::GetInstance().Patch(
                 "B8 00 00 0B 02 C7 85 70 FF FF FF 00 00 CB 00 74 "
@@ -38,6 +38,7 @@ void Borderless::Load()
             );
 
             if (!ret) {
+                M2Hook::GetInstance().Otherwise();
                 ret = M2Hook::GetInstance().Patch(
                     "BA 00 00 CA 12 EB 02 33 D2", 0,
                     "BA 00 00 00 90 90 90 90 90",
@@ -211,7 +211,7 @@ void Config::Load()
         case M2FixGame::NMA1:
         case M2FixGame::NMA2:
         {
-            bool ret = false;
+            M2Hook::Result ret = false;
 
             ret = M2Hook::GetInstance().Hook(
                 "50 C6 01 00 E8 ?? ?? ?? FF 8B CF E8 ?? ?? ?? ?? 85 "
@@ -219,6 +219,7 @@ void Config::Load()
                 -0x48, GetCfgValue, "[Config-32A] MWinResCfg::GetValue"
             );
             if (!ret) {
+                M2Hook::GetInstance().Otherwise();
                 ret = M2Hook::GetInstance().Hook(
                     "51 8B 51 04 8B 41 08 2B C2 89 14 24 C1 F8 02 55",
                     0, GetCfgValueEx, "[Config-32] MWinResCfg::GetValueEx"
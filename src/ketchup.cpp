@@ -1,19 +1,24 @@
 #include "m2fix.h"
 #include "sqhook.h"
 #include "ketchup.h"
+#include "ketchupfingerprint.h"
 
+#include "sqbinary.h"
 #include "sqemutask.h"
 #include "sqglobals.h"
 #include "sqsystemdata.h"
+#include "sqtitleprof.h"
 
 template <Squirk Q>
 bool Ketchup<Q>::ApplyBlock(HSQUIRRELVM<Q> v,
 	Ketchup_TitleInfo &title, Ketchup_VersionInfo &version, Ketchup_DiskInfo &disk,
 	uint64_t offset, unsigned char *data, size_t size)
 {
+	// Filled in place, a run can be thousands of bytes.
 	Sqrat::Array<Q> block(v, size);
+	SQArray<Q> *array = _array(block.GetObject());
 	for (size_t i = 0; i < size; i++) {
-		block.SetValue(i, data[i]);
+		array->_values[i] = static_cast<SQInteger>(data[i]);
 	}
 #ifndef _WIN64
 	SQEmuTask<Q>::EntryCdRomPatch(static_cast<SQInteger>(offset), block);
@@ -23,111 +28,33 @@ bool Ketchup<Q>::ApplyBlock(HSQUIRRELVM<Q> v,
 	spdlog::info("[SQ] [Ketchup] CD-ROM write 0x{:08x} with {} bytes.", offset, size);
 
 	// If tray is open this isn't a cold boot, so we can skip this.
+	// Written a run at a time, up to the end of the current sector's data,
+	// and the rest of the sector skipped over.
 	while (!SQHook<Q>::IsCdRomShellOpen() && size != 0) {
+		size_t run = 1;
 		if (offset >= disk.ram_base && offset < (disk.ram_base + disk.ram_range)) {
 			unsigned int address = static_cast<unsigned int>(offset) - disk.ram_base;
 			unsigned int sector = address / PSX_SectorRange;
 			unsigned int pos = address % PSX_SectorRange;
 
 			if (pos < PSX_SectorSize) {
+				run = std::min<size_t>({ size, PSX_SectorSize - pos, static_cast<size_t>(disk.ram_base + disk.ram_range - offset) });
 				address = (sector * PSX_SectorSize) + pos;
-				SQEmuTask<Q>::SetRamValue(CHAR_BIT, PSX_ImageBase + address, *data);
-				spdlog::info("[SQ] [Ketchup] Mapped RAM write 0x{:08x} [0x{:08x}] with value 0x{:02x}.",
-					PSX_ImageBase + address, offset, *data);
+				SQEmuTask<Q>::RamCopy(PSX_ImageBase + address, data, run);
+				spdlog::info("[SQ] [Ketchup] Mapped RAM write 0x{:08x} [0x{:08x}] with {} bytes.",
+					PSX_ImageBase + address, offset, run);
+			}
+			else {
+				run = std::min<size_t>(size, PSX_SectorRange - pos);
 			}
 		}
 
-		size--; data++; offset++;
-	}
-
-	return true;
-}
-
-template <Squirk Q>
-int Ketchup<Q>::MetaPPF_FileId(std::ifstream &data, int version)
-{
-	unsigned int magic;
-	int length;
-
-	int index = 0;
-	if (version == 2) {
-		index = 4;
-	} else {
-		index = 2;
-	}
-
-	data.seekg(-(index + 4), std::ios_base::end);
-	data.read(reinterpret_cast<char *>(&magic), sizeof(magic));
-
-	if (magic != 'ZID.') {
-		return 0;
+		size -= run; data += run; offset += run;
 	}
 
-	data.seekg(-index, std::ios_base::end);
-	data.read(reinterpret_cast<char *>(&length), index);
-	return length;
-}
-
-template <Squirk Q>
-bool Ketchup<Q>::ApplyPPF3(HSQUIRRELVM<Q> v, Ketchup_TitleInfo &title, Ketchup_VersionInfo &version, Ketchup_DiskInfo &disk, std::ifstream &data)
-{
-	unsigned char ppfmem[512];
-	int length = MetaPPF_FileId(data, 3);
-
-	unsigned char image_type, block_check, undo;
-	data.seekg(56, std::ios_base::beg);
-	data.read(reinterpret_cast<char *>(&image_type), sizeof(image_type));
-	data.read(reinterpret_cast<char *>(&block_check), sizeof(block_check));
-	data.read(reinterpret_cast<char *>(&undo), sizeof(undo));
-
-	data.seekg(0, std::ios_base::end);
-	std::streampos count = data.tellg();
-	data.seekg(0, std::ios_base::beg);
-
-	std::streampos pos;
-	if (block_check) {
-		pos = 1084;
-		count -= 1084;
-	} else {
-		pos = 60;
-		count -= 60;
-	}
-
-	if (length)
-		count -= (length + 18 + 16 + 2);
-
-	uint64_t offset;
-	unsigned char anz;
-	data.seekg(pos, std::ios_base::beg);
-	do {
-		data.read(reinterpret_cast<char *>(&offset), sizeof(offset));
-		data.read(reinterpret_cast<char *>(&anz), sizeof(anz));
-		data.read(reinterpret_cast<char *>(ppfmem), anz);
-		if (undo) data.seekg(anz, std::ios_base::cur);
-
-		if (!ApplyBlock(v, title, version, disk, offset, ppfmem, anz))
-			return false;
-
-		count -= (anz + 9);
-		if (undo) count -= anz;
-	} while (count != 0);
-
 	return true;
 }
 
-template <Squirk Q>
-bool Ketchup<Q>::Apply(HSQUIRRELVM<Q> v, Ketchup_TitleInfo &title, Ketchup_VersionInfo &version, Ketchup_DiskInfo &disk, std::ifstream &data)
-{
-	unsigned int magic;
-	data.seekg(0, std::ios_base::beg);
-	data.read(reinterpret_cast<char *>(&magic), sizeof(magic));
-
-	switch (magic) {
-		case '3FPP': return ApplyPPF3(v, title, version, disk, data);
-		default: return false;
-	}
-}
-
 template <Squirk Q>
 std::filesystem::path Ketchup<Q>::RootPath(Ketchup_TitleInfo &title, Ketchup_VersionInfo &version, Ketchup_DiskInfo &disk, std::string base)
 {
@@ -144,19 +71,66 @@ std::filesystem::path Ketchup<Q>::RootPath(Ketchup_TitleInfo &title, Ketchup_Ver
 	return root;
 }
 
+// The game's own CD-ROM patches that overlap `runs`, in the order it
+// entered them, so a later one is on top.
+template <Squirk Q>
+void Ketchup<Q>::BuiltinPatches(HSQUIRRELVM<Q> v, const Ketchup_Patches &runs, Ketchup_Patches &patches)
+{
+	for (auto &patch : SQHook<Q>::GetCdRomPatches()) {
+		auto it = runs.lower_bound(patch.offset + patch.size);
+		if (it == runs.begin()) continue;
+		--it;
+		if (it->first + it->second.size() <= patch.offset) continue;
+
+		std::vector<unsigned char> data(patch.size);
+		if (sq_isarray(patch.data)) {
+			auto &values = _array(patch.data)->_values;
+			for (size_t i = 0; i < data.size() && i < values.size(); i++) {
+				if (sq_isinteger(values[i])) data[i] = static_cast<unsigned char>(_integer(values[i]));
+			}
+		}
+		else {
+			SQBinary<Q> binary = patch.data;
+			for (size_t i = 0; i < data.size(); i++) {
+				data[i] = static_cast<unsigned char>(binary.At(static_cast<SQInteger>(i)));
+			}
+		}
+		KetchupPatch::Coalesce(patches, patch.offset, data.data(), data.size());
+	}
+}
+
 template <Squirk Q>
 bool Ketchup<Q>::ProcessDisk(HSQUIRRELVM<Q> v, Ketchup_TitleInfo &title, Ketchup_VersionInfo &version, Ketchup_DiskInfo &disk)
 {
 	std::filesystem::directory_entry root { RootPath(title, version, disk) };
 	spdlog::info("[SQ] [Ketchup] base path is {}.", root.path().string());
 
-	if (!root.exists() || !root.is_directory()) return true;
-	for (const auto &entry : std::filesystem::directory_iterator(root)) {
-		std::ifstream data(entry.path(), std::ios::in | std::ios::binary);
-		if (Apply(v, title, version, disk, data)) {
-			spdlog::info("[SQ] [Ketchup] loaded {}.", entry.path().string());
+	// A folder that's gone still has what its mods patched set back.
+	if ((!root.exists() || !root.is_directory()) && Reload.Applied().empty()) return true;
+
+	// What UPS & BPS patches are made against.
+	KetchupSource source(SQTitleProf<Q>::GetDisk());
+	if (!source.Valid()) spdlog::info("[SQ] [Ketchup] disc image isn't available to read.");
+
+	// Only waited on by mods checked against the whole image, and stopped
+	// along with the source if none were.
+	source.Fingerprint(M2Utils::EnsureAppData() / KetchupFingerprint::CacheFile);
+
+	// Only what changed since the last disk patch point, unless the emulator
+	// let go of what was entered then.
+	Ketchup_Patches patches;
+	Reload.Update(root.path(), source, SQHook<Q>::IsCdRomPatchReleased(),
+		[v](const Ketchup_Patches &runs, Ketchup_Patches &builtin) { BuiltinPatches(v, runs, builtin); }, patches);
+
+	SQHook<Q>::SetCdRomPatchEntering(true);
+	for (auto &[offset, run] : patches) {
+		if (!ApplyBlock(v, title, version, disk, offset, run.data(), run.size())) {
+			SQHook<Q>::SetCdRomPatchEntering(false);
+			return false;
 		}
 	}
+	SQHook<Q>::SetCdRomPatchEntering(false);
+	SQHook<Q>::SetCdRomPatchEntered();
 
 	return true;
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "stdafx.h"
+#include "ketchuppatch.h"
+#include "ketchupreload.h"
 
 typedef struct {
 	unsigned int id;
@@ -42,12 +44,13 @@ private:
 	static bool ApplyBlock(HSQUIRRELVM<Q> v,
 		Ketchup_TitleInfo &title, Ketchup_VersionInfo &version, Ketchup_DiskInfo &disk,
 		uint64_t offset, unsigned char *data, size_t size);
-	static bool Apply(HSQUIRRELVM<Q> v, Ketchup_TitleInfo &title, Ketchup_VersionInfo &version, Ketchup_DiskInfo &disk, std::ifstream &data);
 
-	static bool ApplyPPF3(HSQUIRRELVM<Q> v, Ketchup_TitleInfo &title, Ketchup_VersionInfo &version, Ketchup_DiskInfo &disk, std::ifstream &data);
-	static int MetaPPF_FileId(std::ifstream &data, int version);
+	static void BuiltinPatches(HSQUIRRELVM<Q> v, const Ketchup_Patches &runs, Ketchup_Patches &patches);
 
 	static bool ProcessDisk(HSQUIRRELVM<Q> v, Ketchup_TitleInfo &title, Ketchup_VersionInfo &version, Ketchup_DiskInfo &disk);
 	static bool ProcessVersion(HSQUIRRELVM<Q> v, Ketchup_TitleInfo &title, Ketchup_VersionInfo &version);
 	static bool ProcessTitle(HSQUIRRELVM<Q> v, Ketchup_TitleInfo &title);
+
+	// What's applied, kept across disk patch points.
+	static inline KetchupReload Reload;
 };
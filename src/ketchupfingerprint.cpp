@@ -0,0 +1,133 @@
+#include "ketchupfingerprint.h"
+
+#include <chrono>
+
+namespace {
+	// Guards the cache, read and written whole.
+	std::mutex g_cacheMutex;
+}
+
+KetchupFingerprint::KetchupFingerprint(const std::filesystem::path &path, const std::filesystem::path &cache)
+{
+	auto stamp = StampOf(path);
+	if (!stamp) {
+		std::promise<std::optional<uint32_t>> none;
+		none.set_value(std::nullopt);
+		m_crc = none.get_future().share();
+		return;
+	}
+
+	if (auto crc = Lookup(path, *stamp, cache)) {
+		std::promise<std::optional<uint32_t>> known;
+		known.set_value(crc);
+		m_crc = known.get_future().share();
+		return;
+	}
+
+	// Its own handle on the image, reading alongside whoever started it.
+	std::promise<std::optional<uint32_t>> promise;
+	m_crc = promise.get_future().share();
+	m_worker = std::thread([this, promise = std::move(promise), path, cache, stamp = *stamp]() mutable {
+		auto start = std::chrono::steady_clock::now();
+
+		KetchupSource source(path);
+		auto crc = source.Valid() ? Compute(source, source.Size(), &m_stop) : std::nullopt;
+		if (crc) {
+			auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+			spdlog::info("[SQ] [Ketchup] Disc image CRC-32 is {:08x}, read in {}ms.", *crc, ms);
+			Store(path, stamp, *crc, cache);
+		}
+		promise.set_value(crc);
+	});
+}
+
+KetchupFingerprint::~KetchupFingerprint()
+{
+	m_stop = true;
+	if (m_worker.joinable()) m_worker.join();
+}
+
+std::optional<uint32_t> KetchupFingerprint::CRC32() const
+{
+	return m_crc.get();
+}
+
+std::optional<uint32_t> KetchupFingerprint::Compute(const KetchupSource &source, uint64_t size, const std::atomic<bool> *stop)
+{
+	std::vector<unsigned char> chunk(m_iChunkSize);
+	uint32_t crc = 0;
+	for (uint64_t offset = 0; offset < size; offset += chunk.size()) {
+		if (stop && *stop) return std::nullopt;
+		size_t length = static_cast<size_t>(std::min<uint64_t>(chunk.size(), size - offset));
+		if (!source.Read(offset, chunk.data(), length)) return std::nullopt;
+		crc = KetchupPatch::CRC32(chunk.data(), length, crc);
+	}
+	return crc;
+}
+
+std::optional<KetchupFingerprint::Stamp> KetchupFingerprint::StampOf(const std::filesystem::path &path)
+{
+	std::error_code ec;
+	uint64_t size = std::filesystem::file_size(path, ec);
+	if (ec) return std::nullopt;
+	int64_t time = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+	if (ec) return std::nullopt;
+	return Stamp { size, time };
+}
+
+// `{ "version", "images": { path: [size, time, crc] } }`, by absolute path.
+std::optional<uint32_t> KetchupFingerprint::Lookup(const std::filesystem::path &path, const Stamp &stamp, const std::filesystem::path &cache)
+{
+	std::lock_guard lock(g_cacheMutex);
+
+	std::error_code ec;
+	auto key = std::filesystem::absolute(path, ec).string();
+	if (ec) return std::nullopt;
+
+	std::ifstream file(cache);
+	auto index = nlohmann::json::parse(file, nullptr, false);
+	auto version = index.is_object() ? index.find("version") : index.end();
+	auto images = index.is_object() ? index.find("images") : index.end();
+	if (version == index.end() || !version->is_number_unsigned() || version->get<uint32_t>() != m_iCacheVersion ||
+		images == index.end() || !images->is_object()) return std::nullopt;
+
+	auto entry = images->find(key);
+	if (entry == images->end() || !entry->is_array() || entry->size() != 3 ||
+		!(*entry)[0].is_number_unsigned() || !(*entry)[1].is_number_integer() || !(*entry)[2].is_number_unsigned()) return std::nullopt;
+	if ((*entry)[0].get<uint64_t>() != stamp.size || (*entry)[1].get<int64_t>() != stamp.time) return std::nullopt;
+	return (*entry)[2].get<uint32_t>();
+}
+
+void KetchupFingerprint::Store(const std::filesystem::path &path, const Stamp &stamp, uint32_t crc, const std::filesystem::path &cache)
+{
+	std::lock_guard lock(g_cacheMutex);
+
+	std::error_code ec;
+	auto key = std::filesystem::absolute(path, ec).string();
+	if (ec) return;
+
+	nlohmann::json index;
+	{
+		std::ifstream file(cache);
+		index = nlohmann::json::parse(file, nullptr, false);
+	}
+	auto version = index.is_object() ? index.find("version") : index.end();
+	if (version == index.end() || !version->is_number_unsigned() || version->get<uint32_t>() != m_iCacheVersion ||
+		!index["images"].is_object()) {
+		index = { { "version", m_iCacheVersion }, { "images", nlohmann::json::object() } };
+	}
+	index["images"][key] = { stamp.size, stamp.time, crc };
+
+	// Write aside and swap in, a torn write only ever loses the fingerprints.
+	auto temp = cache;
+	temp += ".tmp";
+	{
+		std::ofstream file(temp, std::ios::out | std::ios::trunc);
+		if (file) file << index.dump();
+		if (!file) {
+			spdlog::warn("[SQ] [Ketchup] Couldn't write the disc image's fingerprint.");
+			return;
+		}
+	}
+	std::filesystem::rename(temp, cache, ec);
+}
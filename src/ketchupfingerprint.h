@@ -0,0 +1,52 @@
+#pragma once
+
+#include "stdafx.h"
+#include "ketchuppatch.h"
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+// The CRC-32 of a whole disc image, read through once on a worker thread and
+// remembered by the image's path, size & modification time, so it's only
+// worked out again for an image that changed.
+class KetchupFingerprint
+{
+public:
+	// Starts on the image at `path` unless `cache` has it as it is now.
+	KetchupFingerprint(const std::filesystem::path &path, const std::filesystem::path &cache);
+	// Stops the worker between chunks and waits for it, so it never outlives
+	// whoever started it. A fingerprint stopped short isn't remembered.
+	~KetchupFingerprint();
+
+	KetchupFingerprint(const KetchupFingerprint &) = delete;
+	KetchupFingerprint &operator=(const KetchupFingerprint &) = delete;
+
+	// Waits on the worker if it's still reading. Null if the image can't be read.
+	std::optional<uint32_t> CRC32() const;
+
+	// The CRC-32 of the first `size` bytes of `source`, null if `stop` is set first.
+	static std::optional<uint32_t> Compute(const KetchupSource &source, uint64_t size, const std::atomic<bool> *stop = nullptr);
+
+	static constexpr const char *CacheFile = "disc_fingerprints.json";
+
+private:
+	struct Stamp
+	{
+		uint64_t size;
+		int64_t time;
+	};
+
+	static std::optional<Stamp> StampOf(const std::filesystem::path &path);
+
+	static std::optional<uint32_t> Lookup(const std::filesystem::path &path, const Stamp &stamp, const std::filesystem::path &cache);
+	static void Store(const std::filesystem::path &path, const Stamp &stamp, uint32_t crc, const std::filesystem::path &cache);
+
+	static constexpr uint32_t m_iCacheVersion = 1;
+	static constexpr size_t m_iChunkSize = 0x400000;
+
+	// Nothing waits on it unless it's asked for, or the fingerprint goes.
+	std::shared_future<std::optional<uint32_t>> m_crc;
+	std::atomic<bool> m_stop = false;
+	std::thread m_worker;
+};
@@ -0,0 +1,274 @@
+#include "ketchupimage.h"
+#include "ketchupsector.h"
+
+namespace {
+	uint32_t Read32BE(const unsigned char *data)
+	{
+		return (static_cast<uint32_t>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+	}
+
+	uint64_t Read64BE(const unsigned char *data)
+	{
+		return (static_cast<uint64_t>(Read32BE(data)) << 32) | Read32BE(data + 4);
+	}
+
+	// Reads through a file front to back a chunk at a time, for scanning it
+	// without a read per field.
+	class Cursor
+	{
+	public:
+		Cursor(const KetchupImage::Reader &reader, uint64_t size, uint64_t position)
+			: m_reader(reader), m_size(size), m_position(position), m_buffer(0x100000) {}
+
+		uint64_t Position() const { return m_position - (m_end - m_at); }
+
+		int Byte()
+		{
+			if (m_at == m_end && !Fill()) return -1;
+			return m_buffer[m_at++];
+		}
+
+		void Skip(uint64_t count)
+		{
+			if (count <= m_end - m_at) {
+				m_at += static_cast<size_t>(count);
+				return;
+			}
+			m_position = Position() + count;
+			m_at = m_end = 0;
+		}
+
+	private:
+		bool Fill()
+		{
+			if (m_position >= m_size) return false;
+			size_t chunk = static_cast<size_t>(std::min<uint64_t>(m_buffer.size(), m_size - m_position));
+			if (!m_reader(m_position, m_buffer.data(), chunk)) return false;
+			m_position += chunk;
+			m_at = 0;
+			m_end = chunk;
+			return true;
+		}
+
+		const KetchupImage::Reader &m_reader;
+		uint64_t m_size;
+		uint64_t m_position;
+		std::vector<unsigned char> m_buffer;
+		size_t m_at = 0;
+		size_t m_end = 0;
+	};
+}
+
+bool KetchupImage::Open(Reader reader, uint64_t size, std::unique_ptr<KetchupImage> &image)
+{
+	image.reset();
+
+	// ECM's magic is only four bytes, so a file too short for CHD's can still be one.
+	unsigned char magic[8] = {};
+	if (size < 4 || !reader(0, magic, static_cast<size_t>(std::min<uint64_t>(size, sizeof(magic))))) return true;
+
+	if (std::memcmp(magic, "ECM\0", 4) == 0) {
+		auto ecm = std::make_unique<KetchupECM>(std::move(reader), size);
+		if (!ecm->Valid()) {
+			spdlog::warn("[SQ] [Ketchup] ECM disc image is damaged.");
+			return false;
+		}
+		image = std::move(ecm);
+	}
+	else if (std::memcmp(magic, "MComprHD", 8) == 0) {
+		auto chd = std::make_unique<KetchupCHD>(std::move(reader), size);
+		if (!chd->Valid()) {
+			spdlog::warn("[SQ] [Ketchup] CHD disc image can't be read, only uncompressed CHD v5 images without a parent can.");
+			return false;
+		}
+		image = std::move(chd);
+	}
+	return true;
+}
+
+KetchupECM::KetchupECM(Reader reader, uint64_t size)
+	: m_reader(std::move(reader))
+{
+	m_valid = Index(size);
+	if (!m_valid) m_records.clear();
+}
+
+// After "ECM\0", records of a type & count, with the count's low five bits
+// in the first byte and seven more in each byte after while the top bit is
+// set, then their data. A count of 0xFFFFFFFF ends them, and the EDC of the
+// whole image follows.
+bool KetchupECM::Index(uint64_t size)
+{
+	Cursor cursor(m_reader, size, 4);
+	uint64_t output = 0;
+
+	for (;;) {
+		int c = cursor.Byte();
+		if (c < 0) return false;
+
+		uint32_t type = c & 3;
+		uint64_t count = (c >> 2) & 0x1F;
+		for (int bits = 5; c & 0x80; bits += 7) {
+			if (bits > 32 || (c = cursor.Byte()) < 0) return false;
+			count |= static_cast<uint64_t>(c & 0x7F) << bits;
+		}
+		count &= 0xFFFFFFFF;
+		if (count == 0xFFFFFFFF) break;
+		if (++count >= 0x80000000) return false;
+
+		m_records.push_back({ output, cursor.Position(), static_cast<uint32_t>(count), type });
+
+		cursor.Skip(count * InputSize(type));
+		if (cursor.Position() > size) return false;
+		output += count * OutputSize(type);
+	}
+
+	m_size = output;
+	return cursor.Position() + 4 <= size && !m_records.empty();
+}
+
+bool KetchupECM::Read(uint64_t offset, unsigned char *data, size_t size) const
+{
+	std::fill(data, data + size, 0);
+	if (!m_valid) return false;
+	if (offset >= m_size) return true;
+	size = static_cast<size_t>(std::min<uint64_t>(size, m_size - offset));
+
+	auto it = std::upper_bound(m_records.begin(), m_records.end(), offset,
+		[](uint64_t offset, const Record &record) { return offset < record.output; });
+	--it;
+
+	unsigned char sector[KetchupSector::Size];
+	while (size != 0) {
+		const Record &record = *it;
+		size_t unitSize = OutputSize(record.type);
+		uint64_t within = offset - record.output;
+		uint64_t end = record.output + static_cast<uint64_t>(record.count) * unitSize;
+		size_t run = static_cast<size_t>(std::min<uint64_t>(size, end - offset));
+
+		if (record.type == 0) {
+			if (!m_reader(record.input + within, data, run)) return false;
+		}
+		else {
+			uint32_t unit = static_cast<uint32_t>(within / unitSize);
+			size_t at = static_cast<size_t>(within % unitSize);
+			run = std::min(run, unitSize - at);
+			if (!Decode(record, unit, sector)) return false;
+
+			// Mode 2 sectors are stored without their sync & header.
+			size_t start = record.type == 1 ? 0 : 0x10;
+			std::copy_n(sector + start + at, run, data);
+		}
+
+		offset += run; data += run; size -= run;
+		if (offset == end) ++it;
+	}
+	return true;
+}
+
+bool KetchupECM::Decode(const Record &record, uint32_t unit, unsigned char *sector) const
+{
+	unsigned char stored[0x918];
+	size_t size = InputSize(record.type);
+	if (!m_reader(record.input + static_cast<uint64_t>(unit) * size, stored, size)) return false;
+
+	std::fill(sector, sector + KetchupSector::Size, 0);
+	switch (record.type) {
+		case 1:
+			std::copy_n(KetchupSector::Sync, sizeof(KetchupSector::Sync), sector);
+			std::copy_n(stored, 3, sector + 0xC);
+			sector[0xF] = 1;
+			std::copy_n(stored + 3, KetchupSector::DataSize, sector + 0x10);
+			KetchupSector::Regenerate(sector, 1, false);
+			return true;
+		case 2:
+		case 3:
+			// The subheader is stored once but written twice.
+			std::copy_n(stored, size, sector + 0x14);
+			std::copy_n(stored, 4, sector + 0x10);
+			KetchupSector::Regenerate(sector, 2, record.type == 3);
+			return true;
+		default:
+			return false;
+	}
+}
+
+size_t KetchupECM::InputSize(uint32_t type)
+{
+	switch (type) {
+		case 1: return 0x803;
+		case 2: return 0x804;
+		case 3: return 0x918;
+		default: return 1;
+	}
+}
+
+size_t KetchupECM::OutputSize(uint32_t type)
+{
+	switch (type) {
+		case 1: return 0x930;
+		case 2:
+		case 3: return 0x920;
+		default: return 1;
+	}
+}
+
+// A 124 byte big-endian header: "MComprHD", length, version, four
+// compressors, logical bytes, map & metadata offsets, hunk & unit bytes, then
+// the SHA-1s of the raw data, the whole and the parent. An uncompressed map
+// has the offset of each hunk in hunks, 0 for one that's all zeroes.
+KetchupCHD::KetchupCHD(Reader reader, uint64_t size)
+	: m_reader(std::move(reader))
+{
+	unsigned char header[m_iHeaderSize];
+	if (size < sizeof(header) || !m_reader(0, header, sizeof(header))) return;
+	if (Read32BE(header + 8) != m_iHeaderSize || Read32BE(header + 12) != m_iVersion) return;
+
+	for (int i = 0; i < 4; ++i) {
+		if (Read32BE(header + 16 + i * 4)) return;
+	}
+	if (std::any_of(header + 104, header + 124, [](unsigned char c) { return c != 0; })) return;
+
+	uint64_t logical = Read64BE(header + 32);
+	uint64_t map = Read64BE(header + 40);
+	m_hunkBytes = Read32BE(header + 56);
+	m_unitBytes = Read32BE(header + 60);
+	if (!m_hunkBytes || m_unitBytes < m_iSectorSize || m_hunkBytes % m_unitBytes) return;
+
+	uint64_t hunks = (logical + m_hunkBytes - 1) / m_hunkBytes;
+	if (map > size || hunks > (size - map) / 4) return;
+
+	std::vector<unsigned char> entries(static_cast<size_t>(hunks) * 4);
+	if (!m_reader(map, entries.data(), entries.size())) return;
+
+	m_map.resize(static_cast<size_t>(hunks));
+	for (size_t i = 0; i < m_map.size(); ++i) {
+		m_map[i] = Read32BE(entries.data() + i * 4);
+		if (static_cast<uint64_t>(m_map[i]) * m_hunkBytes + m_hunkBytes > size) return;
+	}
+
+	m_size = logical / m_unitBytes * m_iSectorSize;
+	m_valid = true;
+}
+
+bool KetchupCHD::Read(uint64_t offset, unsigned char *data, size_t size) const
+{
+	std::fill(data, data + size, 0);
+	if (!m_valid) return false;
+	if (offset >= m_size) return true;
+	size = static_cast<size_t>(std::min<uint64_t>(size, m_size - offset));
+
+	// Each frame is a sector then its subcode.
+	while (size != 0) {
+		uint64_t frame = offset / m_iSectorSize;
+		size_t at = static_cast<size_t>(offset % m_iSectorSize);
+		size_t run = std::min<size_t>(size, m_iSectorSize - at);
+
+		uint64_t unit = frame * m_unitBytes;
+		uint32_t hunk = m_map[static_cast<size_t>(unit / m_hunkBytes)];
+		if (hunk && !m_reader(static_cast<uint64_t>(hunk) * m_hunkBytes + unit % m_hunkBytes + at, data, run)) return false;
+
+		offset += run; data += run; size -= run;
+	}
+	return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "stdafx.h"
+
+// A disc image stored in another format, read back as the raw image it was
+// made from. KetchupSource doesn't open images through it, as the image it
+// reads is always the game's own raw one; until DevCDROM is hooked, nothing
+// could mount an ECM or CHD image in its place.
+class KetchupImage
+{
+public:
+	using Reader = std::function<bool(uint64_t offset, unsigned char *data, size_t size)>;
+
+	virtual ~KetchupImage() = default;
+
+	// The image in the `size` bytes `reader` reads, by its magic, or null for
+	// a raw image. False for one that's damaged or in a form that can't be read.
+	static bool Open(Reader reader, uint64_t size, std::unique_ptr<KetchupImage> &image);
+
+	virtual uint64_t Size() const = 0;
+
+	// Reads past the end come back as zeroes.
+	virtual bool Read(uint64_t offset, unsigned char *data, size_t size) const = 0;
+};
+
+// ECM, which drops the sync, EDC & ECC it can make again from sectors and
+// keeps the rest as it was. Records are indexed when opened, so any part of
+// the image can be read without decoding what comes before it.
+class KetchupECM final : public KetchupImage
+{
+public:
+	KetchupECM(Reader reader, uint64_t size);
+
+	bool Valid() const { return m_valid; }
+
+	uint64_t Size() const override { return m_size; }
+	bool Read(uint64_t offset, unsigned char *data, size_t size) const override;
+
+private:
+	// `count` of one type, raw bytes or sectors, from `input` in the file.
+	struct Record
+	{
+		uint64_t output;
+		uint64_t input;
+		uint32_t count;
+		uint32_t type;
+	};
+
+	bool Index(uint64_t size);
+
+	// Makes one sector of a record from its stored part.
+	bool Decode(const Record &record, uint32_t unit, unsigned char *sector) const;
+
+	static size_t InputSize(uint32_t type);
+	static size_t OutputSize(uint32_t type);
+
+	Reader m_reader;
+	std::vector<Record> m_records;
+	uint64_t m_size = 0;
+	bool m_valid = false;
+};
+
+// Uncompressed CHD v5 holding a CD, every frame a raw sector and subcode.
+// Compressed hunks need zlib, LZMA or FLAC, which aren't part of the build.
+class KetchupCHD final : public KetchupImage
+{
+public:
+	KetchupCHD(Reader reader, uint64_t size);
+
+	bool Valid() const { return m_valid; }
+
+	uint64_t Size() const override { return m_size; }
+	bool Read(uint64_t offset, unsigned char *data, size_t size) const override;
+
+private:
+	static constexpr uint32_t m_iVersion = 5;
+	static constexpr uint32_t m_iHeaderSize = 124;
+	static constexpr uint32_t m_iSectorSize = 0x930;
+
+	Reader m_reader;
+	std::vector<uint32_t> m_map;
+	uint32_t m_hunkBytes = 0;
+	uint32_t m_unitBytes = 0;
+	uint64_t m_size = 0;
+	bool m_valid = false;
+};
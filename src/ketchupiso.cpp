@@ -0,0 +1,275 @@
+#include "ketchupiso.h"
+#include "ketchupsector.h"
+
+namespace {
+	uint32_t Read32(const unsigned char *data)
+	{
+		return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+	}
+}
+
+bool KetchupISO::Load(const KetchupSource &source, const std::filesystem::path &cache)
+{
+	m_entries.clear();
+
+	uint64_t key = ImageKey(source);
+	if (!key) return false;
+
+	{
+		std::ifstream file(cache);
+		auto index = nlohmann::json::parse(file, nullptr, false);
+		auto version = index.is_object() ? index.find("version") : index.end();
+		auto image = index.is_object() ? index.find("image") : index.end();
+		auto files = index.is_object() ? index.find("files") : index.end();
+
+		if (version != index.end() && version->is_number_unsigned() && version->get<uint32_t>() == m_iIndexVersion &&
+			image != index.end() && image->is_number_unsigned() && image->get<uint64_t>() == key &&
+			files != index.end() && files->is_object()) {
+			for (auto &[path, entry] : files->items()) {
+				if (!entry.is_array() || entry.size() != 4 ||
+					!std::all_of(entry.begin(), entry.end(), [](const auto &value) { return value.is_number_unsigned(); })) {
+					m_entries.clear();
+					break;
+				}
+				m_entries[path] = { entry[0].get<uint32_t>(), entry[1].get<uint32_t>(), entry[2].get<uint32_t>(), entry[3].get<uint32_t>() };
+			}
+			if (!m_entries.empty()) return true;
+		}
+	}
+
+	if (!Build(source)) {
+		m_entries.clear();
+		return false;
+	}
+	spdlog::info("[SQ] [Ketchup] Indexed {} files on the disc image.", m_entries.size());
+
+	auto files = nlohmann::json::object();
+	for (auto &[path, entry] : m_entries) {
+		files[path] = { entry.lba, entry.size, entry.record, entry.at };
+	}
+	nlohmann::json index = {
+		{ "version", m_iIndexVersion },
+		{ "image", key },
+		{ "files", std::move(files) },
+	};
+
+	// Write aside and swap in, a torn write only ever loses the index.
+	auto temp = cache;
+	temp += ".tmp";
+	{
+		std::ofstream file(temp, std::ios::out | std::ios::trunc);
+		if (file) file << index.dump();
+		if (!file) {
+			spdlog::warn("[SQ] [Ketchup] Couldn't write the index for the disc image's files.");
+			return true;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(temp, cache, ec);
+	return true;
+}
+
+const KetchupISO::Entry *KetchupISO::Find(const std::string &path) const
+{
+	auto it = m_entries.find(Normalise(path));
+	return it != m_entries.end() ? &it->second : nullptr;
+}
+
+void KetchupISO::Replace(const std::filesystem::path &root, const KetchupSource &source, const std::filesystem::path &cache, Ketchup_Patches &patches)
+{
+	std::error_code ec;
+	if (!std::filesystem::is_directory(root, ec)) return;
+
+	KetchupISO iso;
+	if (!iso.Load(source, cache)) {
+		spdlog::warn("[SQ] [Ketchup] The disc image's files couldn't be read, {} is skipped.", root.string());
+		return;
+	}
+
+	for (std::filesystem::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+		const auto &entry = *it;
+		std::error_code error;
+		if (!entry.is_regular_file(error)) continue;
+
+		std::string path = entry.path().lexically_relative(root).generic_string();
+		auto *file = iso.Find(path);
+		if (!file) {
+			spdlog::warn("[SQ] [Ketchup] {} isn't on the disc.", path);
+			continue;
+		}
+
+		KetchupFile data(entry.path());
+		if (!data.Data()) {
+			spdlog::warn("[SQ] [Ketchup] {} couldn't be read.", path);
+			continue;
+		}
+
+		uint64_t sectors = (static_cast<uint64_t>(file->size) + KetchupSector::DataSize - 1) / KetchupSector::DataSize;
+		if (data.Size() > sectors * KetchupSector::DataSize) {
+			spdlog::warn("[SQ] [Ketchup] {} is {} bytes, more than the {} sectors it has on the disc.", path, data.Size(), sectors);
+			continue;
+		}
+
+		// All of a file's sectors are checked before any are patched.
+		unsigned char sector[KetchupSector::Size];
+		uint32_t count = static_cast<uint32_t>((data.Size() + KetchupSector::DataSize - 1) / KetchupSector::DataSize);
+		bool writable = true;
+		for (uint32_t i = 0; i < count && writable; ++i) writable = ReadSector(source, file->lba + i, sector) != 0;
+		if (writable && data.Size() != file->size) writable = ReadSector(source, file->record, sector) != 0;
+		if (!writable) {
+			spdlog::warn("[SQ] [Ketchup] {} lies in sectors that can't be patched.", path);
+			continue;
+		}
+
+		// The last sector is padded out with zeroes, as mastering would.
+		for (uint32_t i = 0; i < count; ++i) {
+			unsigned char chunk[KetchupSector::DataSize] = {};
+			size_t offset = static_cast<size_t>(i) * KetchupSector::DataSize;
+			std::copy_n(data.Data() + offset, std::min(KetchupSector::DataSize, data.Size() - offset), chunk);
+			Patch(source, file->lba + i, chunk, sizeof(chunk), 0, patches);
+		}
+
+		// Both-endian, as ISO9660 records its sizes.
+		if (data.Size() != file->size) {
+			uint32_t size = static_cast<uint32_t>(data.Size());
+			unsigned char both[8];
+			for (int i = 0; i < 4; ++i) {
+				both[i] = static_cast<unsigned char>(size >> (i * 8));
+				both[7 - i] = both[i];
+			}
+			Patch(source, file->record, both, sizeof(both), file->at + 10, patches);
+		}
+
+		spdlog::info("[SQ] [Ketchup] Replaced {} with {} bytes.", path, data.Size());
+	}
+}
+
+bool KetchupISO::Build(const KetchupSource &source)
+{
+	unsigned char sector[KetchupSector::Size];
+
+	// The volume descriptors, up to the primary one.
+	uint32_t rootLBA = 0, rootSize = 0;
+	for (uint32_t lba = m_iDescriptors; !rootLBA; ++lba) {
+		if (lba == m_iDescriptors * 2) return false;
+		size_t at = ReadSector(source, lba, sector);
+		if (!at) return false;
+
+		const unsigned char *descriptor = sector + at;
+		if (std::memcmp(descriptor + 1, "CD001", 5) != 0 || descriptor[0] == 0xFF) return false;
+		if (descriptor[0] != 1) continue;
+
+		rootLBA = Read32(descriptor + 156 + 2);
+		rootSize = Read32(descriptor + 156 + 10);
+		if (!rootLBA) return false;
+	}
+
+	struct Directory
+	{
+		std::string path;
+		uint32_t lba;
+		uint32_t size;
+	};
+	std::vector<Directory> pending = { { "", rootLBA, rootSize } };
+	std::set<uint32_t> seen;
+
+	while (!pending.empty()) {
+		Directory directory = std::move(pending.back());
+		pending.pop_back();
+		if (!seen.insert(directory.lba).second) continue;
+		if (seen.size() > m_iMaxDirectories) return false;
+
+		uint32_t count = static_cast<uint32_t>((static_cast<uint64_t>(directory.size) + KetchupSector::DataSize - 1) / KetchupSector::DataSize);
+		for (uint32_t i = 0; i < count; ++i) {
+			size_t at = ReadSector(source, directory.lba + i, sector);
+			if (!at) return false;
+			const unsigned char *data = sector + at;
+
+			// Records never cross sectors, the rest of one is padded with zeroes.
+			for (size_t pos = 0; pos < KetchupSector::DataSize && data[pos] != 0;) {
+				const unsigned char *record = data + pos;
+				size_t length = record[0];
+				if (length < 34 || pos + length > KetchupSector::DataSize || 33u + record[32] > length) return false;
+
+				pos += length;
+
+				// "\0" & "\1" are the directory itself and its parent.
+				std::string name(reinterpret_cast<const char *>(record + 33), record[32]);
+				if (name.size() == 1 && (name[0] == 0 || name[0] == 1)) continue;
+
+				std::string path = Normalise(directory.path.empty() ? name : directory.path + "/" + name);
+				if (record[25] & 0x02) {
+					pending.push_back({ path, Read32(record + 2), Read32(record + 10) });
+					continue;
+				}
+				m_entries[path] = { Read32(record + 2), Read32(record + 10), directory.lba + i, static_cast<uint32_t>(record - data) };
+			}
+		}
+	}
+
+	return !m_entries.empty();
+}
+
+// Mode 1 & Mode 2 Form 1 only, Form 2 holds streamed audio & video.
+size_t KetchupISO::ReadSector(const KetchupSource &source, uint32_t lba, unsigned char *sector)
+{
+	if (!source.Read(static_cast<uint64_t>(lba) * KetchupSector::Size, sector, KetchupSector::Size)) return 0;
+	if (KetchupSector::Form2(sector)) return 0;
+	return KetchupSector::DataOffset(sector);
+}
+
+uint64_t KetchupISO::ImageKey(const KetchupSource &source)
+{
+	uint64_t key = source.Size();
+	unsigned char sector[KetchupSector::Size];
+	for (uint32_t lba = m_iDescriptors; lba < m_iDescriptors * 2; ++lba) {
+		size_t at = ReadSector(source, lba, sector);
+		if (!at) return 0;
+
+		key = key * 0x100000001B3ull ^ KetchupPatch::Hash(sector + at, KetchupSector::DataSize);
+		if (sector[at] == 0xFF) return key ? key : 1;
+	}
+	return 0;
+}
+
+// Upper case with `/` between names, and without the ";1" versions or the
+// trailing dot of names without an extension.
+std::string KetchupISO::Normalise(std::string path)
+{
+	std::string normal;
+	normal.reserve(path.size());
+
+	size_t begin = 0;
+	while (begin <= path.size()) {
+		size_t end = path.find_first_of("/\\", begin);
+		if (end == std::string::npos) end = path.size();
+
+		std::string name = path.substr(begin, end - begin);
+		name = name.substr(0, name.find(';'));
+		if (!name.empty() && name.back() == '.') name.pop_back();
+		if (!name.empty()) {
+			if (!normal.empty()) normal += '/';
+			for (char c : name) normal += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+		}
+
+		begin = end + 1;
+	}
+	return normal;
+}
+
+// Writes `data` at `at` in the sector's data as the image stands with
+// `patches`, and the sector's EDC & ECC along with it.
+bool KetchupISO::Patch(const KetchupSource &source, uint32_t lba, const unsigned char *data, size_t size, size_t at, Ketchup_Patches &patches)
+{
+	uint64_t offset = static_cast<uint64_t>(lba) * KetchupSector::Size;
+	unsigned char sector[KetchupSector::Size];
+	KetchupPatch::ReadTarget(patches, source, offset, sector, sizeof(sector));
+
+	size_t start = KetchupSector::Form2(sector) ? 0 : KetchupSector::DataOffset(sector);
+	if (!start || at + size > KetchupSector::DataSize) return false;
+
+	std::copy_n(data, size, sector + start + at);
+	KetchupSector::Regenerate(sector);
+	KetchupPatch::Coalesce(patches, offset + start, sector + start, sizeof(sector) - start);
+	return true;
+}
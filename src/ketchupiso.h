@@ -0,0 +1,53 @@
+#pragma once
+
+#include "stdafx.h"
+#include "ketchuppatch.h"
+
+// The files on a disc image, found through its ISO9660 directories, so
+// replacing one can be turned into patches on the sectors it lies in.
+class KetchupISO
+{
+public:
+	struct Entry
+	{
+		uint32_t lba;
+		uint32_t size;
+		// The directory sector holding the file's record, and where in its data.
+		uint32_t record;
+		uint32_t at;
+	};
+
+	// Reads the index cached at `cache` if it was built from this image, or
+	// walks the image's directories and caches what's found.
+	bool Load(const KetchupSource &source, const std::filesystem::path &cache);
+
+	// By path from the root, e.g. "MGS/STAGE.DIR", without the version.
+	const Entry *Find(const std::string &path) const;
+
+	// Replaces files on the image with those under `root`, laid out as on the
+	// disc. A file can shrink or grow up to the sectors its original had.
+	static void Replace(const std::filesystem::path &root, const KetchupSource &source, const std::filesystem::path &cache, Ketchup_Patches &patches);
+
+	static constexpr const char *FilesFolder = "files";
+	static constexpr const char *IndexFile = "iso9660.json";
+
+private:
+	static constexpr uint32_t m_iIndexVersion = 1;
+	static constexpr uint32_t m_iDescriptors = 16;
+	static constexpr size_t m_iMaxDirectories = 0x10000;
+
+	bool Build(const KetchupSource &source);
+
+	// The raw sector and where its data starts, or 0 if it has none.
+	static size_t ReadSector(const KetchupSource &source, uint32_t lba, unsigned char *sector);
+
+	// Tells images apart by their size & volume descriptors, which the
+	// directories hang off of.
+	static uint64_t ImageKey(const KetchupSource &source);
+
+	static std::string Normalise(std::string path);
+
+	static bool Patch(const KetchupSource &source, uint32_t lba, const unsigned char *data, size_t size, size_t at, Ketchup_Patches &patches);
+
+	std::map<std::string, Entry> m_entries;
+};
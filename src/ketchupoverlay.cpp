@@ -0,0 +1,156 @@
+#include "ketchupoverlay.h"
+#include "ketchupsector.h"
+
+#include <bit>
+
+bool KetchupOverlay::Open(const std::filesystem::path &path, const KetchupSource &source, const Ketchup_Patches &patches)
+{
+	m_source = &source;
+
+	auto keys = Keys(source, patches);
+	if (Map(path, keys)) return true;
+
+	if (!Build(path, source, patches, keys)) {
+		spdlog::warn("[SQ] [Ketchup] Couldn't write the overlay {}.", path.string());
+		return false;
+	}
+	if (!Map(path, keys)) return false;
+
+	spdlog::info("[SQ] [Ketchup] Built the overlay with {} sectors.", m_header->patched);
+	return true;
+}
+
+const unsigned char *KetchupOverlay::Sector(uint32_t lba) const
+{
+	if (!m_header || lba >= m_header->sectors) return nullptr;
+
+	uint64_t word = m_bitmap[lba / 64];
+	uint64_t bit = 1ull << (lba % 64);
+	if (!(word & bit)) return nullptr;
+
+	size_t index = m_rank[lba / 64] + std::popcount(word & (bit - 1));
+	return m_sectors + index * KetchupSector::Size;
+}
+
+bool KetchupOverlay::Read(uint32_t lba, unsigned char *sector) const
+{
+	if (auto patched = Sector(lba)) {
+		std::memcpy(sector, patched, KetchupSector::Size);
+		return true;
+	}
+	if (!m_source) return false;
+	return m_source->Read(static_cast<uint64_t>(lba) * KetchupSector::Size, sector, KetchupSector::Size);
+}
+
+// The image by its size and the bytes of the sectors the patches land in,
+// all an overlay's sectors are made from, so any other image of the same
+// size is told apart however alike their volume descriptors are. The mods by
+// the runs they come to, so the same patches from other files still match.
+std::pair<uint64_t, uint64_t> KetchupOverlay::Keys(const KetchupSource &source, const Ketchup_Patches &patches)
+{
+	uint64_t image = source.Size();
+	uint64_t mods = patches.size();
+	uint64_t last = UINT64_MAX;
+	unsigned char sector[KetchupSector::Size];
+	for (auto &[offset, run] : patches) {
+		mods = (mods ^ offset) * 0x100000001B3ull;
+		mods = (mods ^ KetchupPatch::Hash(run.data(), run.size())) * 0x100000001B3ull;
+
+		for (uint64_t lba = offset / KetchupSector::Size; lba <= (offset + run.size() - 1) / KetchupSector::Size; ++lba) {
+			if (lba == last) continue;
+			last = lba;
+			source.Read(lba * KetchupSector::Size, sector, sizeof(sector));
+			image = (image ^ KetchupPatch::Hash(sector, sizeof(sector))) * 0x100000001B3ull;
+		}
+	}
+	return { image, mods };
+}
+
+bool KetchupOverlay::Build(const std::filesystem::path &path, const KetchupSource &source, const Ketchup_Patches &patches,
+	const std::pair<uint64_t, uint64_t> &keys)
+{
+	// Runs are ordered and disjoint, so sectors come out in order, though
+	// neighbouring runs can share one.
+	std::vector<uint32_t> touched;
+	for (auto &[offset, run] : patches) {
+		uint64_t first = offset / KetchupSector::Size;
+		uint64_t last = (offset + run.size() - 1) / KetchupSector::Size;
+		if (last > UINT32_MAX - 1) return false;
+		for (uint64_t lba = first; lba <= last; ++lba) {
+			if (touched.empty() || touched.back() < lba) touched.push_back(static_cast<uint32_t>(lba));
+		}
+	}
+
+	uint64_t sectors = (source.Size() + KetchupSector::Size - 1) / KetchupSector::Size;
+	if (!touched.empty()) sectors = std::max<uint64_t>(sectors, touched.back() + 1ull);
+	if (sectors > UINT32_MAX) return false;
+
+	size_t words = static_cast<size_t>((sectors + 63) / 64);
+	std::vector<uint64_t> bitmap(words);
+	std::vector<uint32_t> rank(words);
+	for (uint32_t lba : touched) bitmap[lba / 64] |= 1ull << (lba % 64);
+	for (size_t i = 1; i < words; ++i) rank[i] = rank[i - 1] + std::popcount(bitmap[i - 1]);
+
+	Header header = { m_iMagic, m_iVersion, keys.first, keys.second, static_cast<uint32_t>(sectors), static_cast<uint32_t>(touched.size()) };
+
+	// Write aside and swap in, a torn write only ever loses the overlay.
+	auto temp = path;
+	temp += ".tmp";
+	{
+		std::ofstream file(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file) return false;
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char *>(bitmap.data()), bitmap.size() * sizeof(uint64_t));
+		file.write(reinterpret_cast<const char *>(rank.data()), rank.size() * sizeof(uint32_t));
+
+		unsigned char sector[KetchupSector::Size];
+		for (uint32_t lba : touched) {
+			KetchupPatch::ReadTarget(patches, source, static_cast<uint64_t>(lba) * KetchupSector::Size, sector, sizeof(sector));
+			file.write(reinterpret_cast<const char *>(sector), sizeof(sector));
+		}
+		if (!file) return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(temp, path, ec);
+	return !ec;
+}
+
+bool KetchupOverlay::Map(const std::filesystem::path &path, const std::pair<uint64_t, uint64_t> &keys)
+{
+	// Unmapped unless it's the right one, so it can be rebuilt in place.
+	m_header = nullptr;
+	m_file.reset();
+	auto file = std::make_unique<KetchupFile>(path);
+
+	const unsigned char *data = file->Data();
+	size_t size = file->Size();
+	if (!data || size < sizeof(Header)) return false;
+
+	auto header = reinterpret_cast<const Header *>(data);
+	if (header->magic != m_iMagic || header->version != m_iVersion ||
+		header->image != keys.first || header->mods != keys.second) return false;
+
+	size_t words = (static_cast<size_t>(header->sectors) + 63) / 64;
+	uint64_t expected = sizeof(Header) + words * (sizeof(uint64_t) + sizeof(uint32_t)) +
+		static_cast<uint64_t>(header->patched) * KetchupSector::Size;
+	if (size != expected) return false;
+
+	auto bitmap = reinterpret_cast<const uint64_t *>(data + sizeof(Header));
+	auto rank = reinterpret_cast<const uint32_t *>(bitmap + words);
+
+	// A bad rank would send reads out of the file.
+	uint64_t count = 0;
+	for (size_t i = 0; i < words; ++i) {
+		if (rank[i] != count) return false;
+		count += std::popcount(bitmap[i]);
+	}
+	if (count != header->patched) return false;
+
+	m_file = std::move(file);
+	m_header = header;
+	m_bitmap = bitmap;
+	m_rank = rank;
+	m_sectors = reinterpret_cast<const unsigned char *>(rank + words);
+	return true;
+}
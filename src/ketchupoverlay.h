@@ -0,0 +1,66 @@
+#pragma once
+
+#include "stdafx.h"
+#include "ketchuppatch.h"
+
+// Every sector the patches touch, patched ahead of time into one file that's
+// mapped rather than read. A bitmap says which sectors it holds, so resolving
+// a read is a bit test and a copy, and untouched sectors come from the image.
+// Nothing reads through it yet: that takes a hook on DevCDROM's reads, whose
+// layout isn't mapped, so patches still go in through EntryCdRomPatch.
+class KetchupOverlay
+{
+public:
+	KetchupOverlay() = default;
+
+	KetchupOverlay(const KetchupOverlay &) = delete;
+	KetchupOverlay &operator=(const KetchupOverlay &) = delete;
+
+	// Maps the overlay at `path` if it was built from this image and these
+	// patches, or builds it first.
+	bool Open(const std::filesystem::path &path, const KetchupSource &source, const Ketchup_Patches &patches);
+
+	bool Valid() const { return m_header != nullptr; }
+	uint32_t Sectors() const { return m_header ? m_header->patched : 0; }
+
+	// The patched sector, or null if the patches leave it as on the image.
+	const unsigned char *Sector(uint32_t lba) const;
+
+	// The sector as patched, from the overlay or else from the image.
+	bool Read(uint32_t lba, unsigned char *sector) const;
+
+	static constexpr const char *Extension = ".kovl";
+	static constexpr const char *OverlayFile = "overlay.kovl";
+
+private:
+	// Followed by the bitmap, a word per 64 sectors, the count of bits set
+	// before each word, then the patched sectors in order.
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t image;
+		uint64_t mods;
+		uint32_t sectors;
+		uint32_t patched;
+	};
+
+	static constexpr uint32_t m_iMagic = 'LVOK';
+	static constexpr uint32_t m_iVersion = 1;
+
+	// Which image and which patches an overlay was built from.
+	static std::pair<uint64_t, uint64_t> Keys(const KetchupSource &source, const Ketchup_Patches &patches);
+
+	static bool Build(const std::filesystem::path &path, const KetchupSource &source, const Ketchup_Patches &patches,
+		const std::pair<uint64_t, uint64_t> &keys);
+
+	bool Map(const std::filesystem::path &path, const std::pair<uint64_t, uint64_t> &keys);
+
+	std::unique_ptr<KetchupFile> m_file;
+	const KetchupSource *m_source = nullptr;
+
+	const Header *m_header = nullptr;
+	const uint64_t *m_bitmap = nullptr;
+	const uint32_t *m_rank = nullptr;
+	const unsigned char *m_sectors = nullptr;
+};
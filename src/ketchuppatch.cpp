@@ -0,0 +1,752 @@
+#include "ketchuppatch.h"
+#include "ketchupfingerprint.h"
+#include "ketchupiso.h"
+#include "ketchupoverlay.h"
+
+#include <atomic>
+#include <thread>
+
+KetchupFile::KetchupFile(const std::filesystem::path &path)
+{
+	m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) return;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0 ||
+		static_cast<unsigned long long>(size.QuadPart) > SIZE_MAX) return;
+
+	m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping) return;
+
+	m_data = static_cast<const unsigned char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data) m_size = static_cast<size_t>(size.QuadPart);
+}
+
+KetchupFile::~KetchupFile()
+{
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+}
+
+KetchupSource::KetchupSource() = default;
+
+KetchupSource::KetchupSource(const std::filesystem::path &path)
+	: m_path(path)
+{
+	m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) return;
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(m_file, &size)) m_size = static_cast<uint64_t>(size.QuadPart);
+}
+
+KetchupSource::~KetchupSource()
+{
+	if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+}
+
+// Positional reads, so threads don't share a file pointer.
+bool KetchupSource::Read(uint64_t offset, unsigned char *data, size_t size) const
+{
+	std::fill(data, data + size, 0);
+	if (!Valid()) return false;
+	if (offset >= m_size) return true;
+	size = static_cast<size_t>(std::min<uint64_t>(size, m_size - offset));
+
+	while (size != 0) {
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+		DWORD read = 0;
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 0x1000000));
+		if (!ReadFile(m_file, data, chunk, &read, &overlapped) || read == 0) return false;
+
+		offset += read; data += read; size -= read;
+	}
+	return true;
+}
+
+void KetchupSource::Fingerprint(const std::filesystem::path &cache)
+{
+	if (Valid()) m_fingerprint = std::make_unique<KetchupFingerprint>(m_path, cache);
+}
+
+std::optional<uint32_t> KetchupSource::CRC32() const
+{
+	if (!Valid()) return std::nullopt;
+	if (m_fingerprint) return m_fingerprint->CRC32();
+	return KetchupFingerprint::Compute(*this, m_size);
+}
+
+bool KetchupPatch::Load(const std::filesystem::path &path, const KetchupSource &source, Ketchup_Patches &patches)
+{
+	std::error_code ec;
+	uint64_t size = std::filesystem::file_size(path, ec);
+	if (ec) return false;
+	int64_t time = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+	if (ec) return false;
+
+	auto cache = path;
+	cache += IndexExtension;
+
+	// One read for the whole index.
+	std::vector<unsigned char> index;
+	IndexHeader header = {};
+	{
+		std::ifstream file(cache, std::ios::in | std::ios::binary | std::ios::ate);
+		if (file) {
+			index.resize(static_cast<size_t>(file.tellg()));
+			file.seekg(0, std::ios_base::beg);
+			if (!file.read(reinterpret_cast<char *>(index.data()), index.size())) index.clear();
+		}
+		if (index.size() >= sizeof(header)) std::memcpy(&header, index.data(), sizeof(header));
+		if (header.magic != m_iIndexMagic || header.version != m_iIndexVersion) header = {};
+	}
+
+	// The image is checked again on every load, it may have been swapped since.
+	auto checked = [&] {
+		if (Check(header.checks, source)) return true;
+		spdlog::warn("[SQ] [Ketchup] {} is for a different disc image.", path.string());
+		return false;
+	};
+
+	if (header.magic && header.size == size && header.time == time) {
+		if (!checked()) return false;
+		if (ReadIndex(index, patches)) return true;
+	}
+
+	KetchupFile file(path);
+	if (!file.Data()) return false;
+	uint64_t hash = Hash(file.Data(), file.Size());
+
+	// Touched or copied but the same mod, just bring the time up to date.
+	if (header.magic && header.size == size && header.hash == hash) {
+		if (!checked()) return false;
+		if (ReadIndex(index, patches)) {
+			header.time = time;
+			std::memcpy(index.data(), &header, sizeof(header));
+			WriteIndex(cache, index);
+			return true;
+		}
+	}
+
+	Ketchup_Patches runs;
+	Checks checks = {};
+	if (!Parse(file.Data(), file.Size(), source, runs, checks)) return false;
+
+	header = { m_iIndexMagic, m_iIndexVersion, size, time, hash, runs.size(), checks };
+	if (!WriteIndex(cache, BuildIndex(header, runs))) {
+		spdlog::warn("[SQ] [Ketchup] Couldn't write the index for {}.", path.string());
+	}
+	if (!checked()) return false;
+
+	for (auto &[offset, run] : runs) {
+		Coalesce(patches, offset, run.data(), run.size());
+	}
+	return true;
+}
+
+std::vector<std::filesystem::path> KetchupPatch::LoadOrder(const std::filesystem::path &root)
+{
+	std::vector<std::filesystem::path> found;
+	for (const auto &entry : std::filesystem::directory_iterator(root)) {
+		if (!entry.is_regular_file()) continue;
+		// Indexes, overlays and what a torn write left of either aren't mods.
+		auto extension = entry.path().extension();
+		auto name = entry.path().filename();
+		if (extension == IndexExtension || extension == KetchupOverlay::Extension || extension == ".tmp" ||
+			name == LoadOrderFile || name == KetchupISO::IndexFile) continue;
+		found.push_back(entry.path());
+	}
+	std::sort(found.begin(), found.end());
+
+	// One file name per line, blank lines & `#` comments ignored.
+	std::vector<std::filesystem::path> order;
+	std::ifstream file(root / LoadOrderFile);
+	for (std::string line; std::getline(file, line);) {
+		line.erase(0, line.find_first_not_of(" \t"));
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty() || line[0] == '#') continue;
+
+		auto it = std::find_if(found.begin(), found.end(),
+			[&](const std::filesystem::path &path) { return path.filename().string() == line; });
+		if (it == found.end()) {
+			spdlog::warn("[SQ] [Ketchup] {} in the load order wasn't found.", line);
+			continue;
+		}
+		order.push_back(*it);
+		found.erase(it);
+	}
+
+	order.insert(order.end(), found.begin(), found.end());
+	return order;
+}
+
+void KetchupPatch::Compose(const std::vector<std::filesystem::path> &mods, const KetchupSource &source, Ketchup_Patches &patches,
+	std::map<std::filesystem::path, Ketchup_Patches> &loaded)
+{
+	for (auto it = loaded.begin(); it != loaded.end();) {
+		if (std::find(mods.begin(), mods.end(), it->first) == mods.end()) it = loaded.erase(it);
+		else ++it;
+	}
+
+	std::vector<size_t> queue;
+	for (size_t i = 0; i < mods.size(); ++i) {
+		if (!loaded.count(mods[i])) queue.push_back(i);
+	}
+
+	// New mods are loaded by a few workers taking the next one in turn.
+	std::vector<Ketchup_Patches> fresh(mods.size());
+	std::vector<char> valid(mods.size());
+	if (!queue.empty()) {
+		std::atomic<size_t> next = 0;
+		auto worker = [&] {
+			for (size_t n; (n = next++) < queue.size();) {
+				size_t i = queue[n];
+				valid[i] = Load(mods[i], source, fresh[i]);
+			}
+		};
+
+		size_t count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, queue.size());
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < count; ++i) threads.emplace_back(worker);
+		worker();
+		for (auto &thread : threads) thread.join();
+	}
+
+	std::vector<size_t> applied;
+	for (size_t i = 0; i < mods.size(); ++i) {
+		if (!loaded.count(mods[i])) {
+			if (!valid[i]) {
+				spdlog::warn("[SQ] [Ketchup] {} isn't a mod, or is malformed.", mods[i].string());
+				continue;
+			}
+			loaded[mods[i]] = std::move(fresh[i]);
+			spdlog::info("[SQ] [Ketchup] loaded {}.", mods[i].string());
+		}
+		const auto &runs = loaded[mods[i]];
+
+		for (size_t j : applied) {
+			auto [count, first] = Conflicts(loaded[mods[j]], runs);
+			if (count == 0) continue;
+			spdlog::warn("[SQ] [Ketchup] {} overrides {} bytes of {}, the first at 0x{:08x}.",
+				mods[i].filename().string(), count, mods[j].filename().string(), first);
+		}
+
+		for (auto &[offset, run] : runs) {
+			Coalesce(patches, offset, run.data(), run.size());
+		}
+		applied.push_back(i);
+	}
+}
+
+std::pair<uint64_t, uint64_t> KetchupPatch::Conflicts(const Ketchup_Patches &earlier, const Ketchup_Patches &later)
+{
+	uint64_t count = 0, first = 0;
+
+	// Both are sorted & disjoint, so one sweep finds every overlap.
+	auto a = earlier.begin();
+	auto b = later.begin();
+	while (a != earlier.end() && b != later.end()) {
+		uint64_t aend = a->first + a->second.size();
+		uint64_t bend = b->first + b->second.size();
+
+		for (uint64_t i = std::max(a->first, b->first); i < std::min(aend, bend); ++i) {
+			if (a->second[static_cast<size_t>(i - a->first)] == b->second[static_cast<size_t>(i - b->first)]) continue;
+			if (count++ == 0) first = i;
+		}
+
+		if (aend < bend) ++a;
+		else ++b;
+	}
+	return { count, first };
+}
+
+bool KetchupPatch::Parse(const unsigned char *data, size_t size, const KetchupSource &source, Ketchup_Patches &patches, Checks &checks)
+{
+	if (size < 4) return false;
+
+	uint32_t magic;
+	std::memcpy(&magic, data, sizeof(magic));
+
+	checks = {};
+	switch (magic) {
+		case '3FPP': return ParsePPF3(data, size, patches, checks);
+		case 'CTAP': return ParseIPS(data, size, patches);
+		case '1SPU': return ParseUPS(data, size, source, patches, checks);
+		case '1SPB': return ParseBPS(data, size, source, patches, checks);
+		default: return false;
+	}
+}
+
+// Cheap once the image's CRC-32 is known, it's only ever worked out once for
+// an image as long as it's fingerprinted.
+bool KetchupPatch::Check(const Checks &checks, const KetchupSource &source)
+{
+	if (!source.Valid()) return true;
+
+	if (checks.flags & CheckBlock) {
+		unsigned char block[1024];
+		if (!source.Read(checks.block, block, sizeof(block)) || Hash(block, sizeof(block)) != checks.block_hash) return false;
+	}
+	if (checks.flags & CheckImage) {
+		if (source.Size() != checks.size || source.CRC32() != checks.crc) return false;
+	}
+	return true;
+}
+
+void KetchupPatch::Coalesce(Ketchup_Patches &patches, uint64_t offset, const unsigned char *data, size_t size)
+{
+	if (size == 0) return;
+	uint64_t end = offset + size;
+
+	// The runs the record touches or overlaps.
+	auto first = patches.upper_bound(offset);
+	if (first != patches.begin()) {
+		auto prev = std::prev(first);
+		if (prev->first + prev->second.size() >= offset) first = prev;
+	}
+	auto last = first;
+	while (last != patches.end() && last->first <= end) {
+		end = std::max<uint64_t>(end, last->first + last->second.size());
+		++last;
+	}
+
+	// Grown from the first run if it starts before the record, so records in
+	// order append rather than copy the run each time.
+	uint64_t start = offset;
+	std::vector<unsigned char> run;
+	auto it = first;
+	if (it != last && it->first <= offset) {
+		start = it->first;
+		run = std::move(it->second);
+		++it;
+	}
+	run.resize(static_cast<size_t>(end - start));
+	for (; it != last; ++it) {
+		std::copy(it->second.begin(), it->second.end(), run.begin() + static_cast<size_t>(it->first - start));
+	}
+	std::copy(data, data + size, run.begin() + static_cast<size_t>(offset - start));
+
+	patches.erase(first, last);
+	patches.emplace_hint(last, start, std::move(run));
+}
+
+// "PPF30", encoding, description[50], image type, block check, undo, dummy,
+// the 1024 byte block check if any, then `u64 offset, u8 size, data[size]`
+// records each followed by its undo data if any, and lastly an optional
+// "@BEGIN_FILE_ID.DIZ" text "@END_FILE_ID.DIZ" u16 length. The block check is
+// a copy of the image from 0x9320 for a BIN, or 0x80A0 for a GI.
+bool KetchupPatch::ParsePPF3(const unsigned char *data, size_t size, Ketchup_Patches &patches, Checks &checks)
+{
+	constexpr size_t header = 60;
+	constexpr size_t check = 1024;
+	constexpr std::string_view begin = "@BEGIN_FILE_ID.DIZ";
+	constexpr std::string_view end = "@END_FILE_ID.DIZ";
+
+	if (size < header || data[4] != '0' || data[5] != 2) return false;
+	unsigned char block_check = data[57];
+	unsigned char undo = data[58];
+
+	size_t pos = header + (block_check ? check : 0);
+	if (size < pos) return false;
+
+	if (block_check && data[56] <= 1) {
+		checks.flags |= CheckBlock;
+		checks.block = data[56] == 0 ? 0x9320 : 0x80A0;
+		checks.block_hash = Hash(data + header, check);
+	}
+
+	size_t count = size;
+	if (size - pos >= end.size() + sizeof(uint16_t) &&
+		std::memcmp(data + size - sizeof(uint16_t) - 4, ".DIZ", 4) == 0) {
+		uint16_t length;
+		std::memcpy(&length, data + size - sizeof(length), sizeof(length));
+
+		size_t diz = begin.size() + length + end.size() + sizeof(length);
+		if (size - pos < diz) return false;
+		count = size - diz;
+		if (std::memcmp(data + count, begin.data(), begin.size()) != 0) return false;
+	}
+
+	std::vector<std::tuple<uint64_t, const unsigned char *, size_t>> records;
+	while (pos != count) {
+		if (count - pos < sizeof(uint64_t) + 1) return false;
+
+		uint64_t offset;
+		std::memcpy(&offset, data + pos, sizeof(offset));
+		size_t anz = data[pos + sizeof(offset)];
+		pos += sizeof(offset) + 1;
+
+		size_t length = undo ? anz * 2 : anz;
+		if (count - pos < length) return false;
+		if (offset > UINT64_MAX - anz) return false;
+
+		records.emplace_back(offset, data + pos, anz);
+		pos += length;
+	}
+
+	for (auto &[offset, record, anz] : records) {
+		Coalesce(patches, offset, record, anz);
+	}
+	return true;
+}
+
+// "PATCH", then `u24be offset, u16be size, data[size]` records, or with a
+// zero size `u16be count, u8 value` runs, up to "EOF" and an optional u24be
+// truncated size, which doesn't apply to a disc.
+bool KetchupPatch::ParseIPS(const unsigned char *data, size_t size, Ketchup_Patches &patches)
+{
+	if (size < 8 || std::memcmp(data, "PATCH", 5) != 0) return false;
+
+	Ketchup_Patches runs;
+	std::vector<unsigned char> fill;
+	size_t pos = 5;
+	while (true) {
+		if (size - pos < 3) return false;
+		if (std::memcmp(data + pos, "EOF", 3) == 0) {
+			pos += 3;
+			break;
+		}
+		if (size - pos < 5) return false;
+
+		uint32_t offset = (data[pos] << 16) | (data[pos + 1] << 8) | data[pos + 2];
+		size_t length = (data[pos + 3] << 8) | data[pos + 4];
+		pos += 5;
+
+		if (length != 0) {
+			if (size - pos < length) return false;
+			Coalesce(runs, offset, data + pos, length);
+			pos += length;
+			continue;
+		}
+
+		if (size - pos < 3) return false;
+		fill.assign((data[pos] << 8) | data[pos + 1], data[pos + 2]);
+		Coalesce(runs, offset, fill.data(), fill.size());
+		pos += 3;
+	}
+	if (pos != size && size - pos != 3) return false;
+
+	for (auto &[offset, run] : runs) {
+		Coalesce(patches, offset, run.data(), run.size());
+	}
+	return true;
+}
+
+namespace
+{
+	// The variable length integers UPS & BPS share.
+	bool ReadNumber(const unsigned char *data, size_t size, size_t &pos, uint64_t &value)
+	{
+		value = 0;
+		uint64_t shift = 1;
+		while (pos < size) {
+			unsigned char x = data[pos++];
+			value += (x & 0x7F) * shift;
+			if (x & 0x80) return true;
+			if (shift > (UINT64_MAX >> 7)) return false;
+			shift <<= 7;
+			value += shift;
+		}
+		return false;
+	}
+
+	uint32_t ReadCRC(const unsigned char *data)
+	{
+		uint32_t crc;
+		std::memcpy(&crc, data, sizeof(crc));
+		return crc;
+	}
+}
+
+// "UPS1", source size, target size, then records of a number of bytes to
+// skip and bytes to XOR with the image up to & including a zero, and lastly
+// the CRC-32s of the source, target & patch.
+bool KetchupPatch::ParseUPS(const unsigned char *data, size_t size, const KetchupSource &source, Ketchup_Patches &patches, Checks &checks)
+{
+	constexpr size_t footer = 12;
+	if (size < 4 + footer) return false;
+	if (CRC32(data, size - 4) != ReadCRC(data + size - 4)) return false;
+
+	if (!source.Valid()) {
+		spdlog::warn("[SQ] [Ketchup] UPS patches need the disc image, which isn't available.");
+		return false;
+	}
+
+	size_t end = size - footer;
+	size_t pos = 4;
+	uint64_t source_size, target_size;
+	if (!ReadNumber(data, end, pos, source_size) || !ReadNumber(data, end, pos, target_size)) return false;
+
+	checks = { CheckImage, ReadCRC(data + end), source_size };
+	if (!Check(checks, source)) {
+		spdlog::warn("[SQ] [Ketchup] UPS patch is for a different disc image.");
+		return false;
+	}
+
+	Ketchup_Patches runs;
+	std::vector<unsigned char> run;
+	uint64_t offset = 0;
+	while (pos < end) {
+		uint64_t skip;
+		if (!ReadNumber(data, end, pos, skip)) return false;
+		if (skip > target_size - std::min(offset, target_size)) return false;
+		offset += skip;
+
+		size_t length = 0;
+		while (pos + length < end && data[pos + length] != 0) length++;
+		if (pos + length == end || length > target_size - offset) return false;
+
+		run.resize(length);
+		source.Read(offset, run.data(), length);
+		for (size_t i = 0; i < length; ++i) run[i] ^= data[pos + i];
+		Coalesce(runs, offset, run.data(), length);
+
+		offset += length + 1;
+		pos += length + 1;
+	}
+
+	if (TargetCRC(runs, source, target_size) != ReadCRC(data + end + 4)) return false;
+
+	for (auto &[offset, run] : runs) {
+		Coalesce(patches, offset, run.data(), run.size());
+	}
+	return true;
+}
+
+// "BPS1", source size, target size, metadata size & metadata, then actions
+// each writing on from the last: kept from the image, read from the patch,
+// copied from elsewhere in the image or from what's already written, and
+// lastly the CRC-32s of the source, target & patch.
+bool KetchupPatch::ParseBPS(const unsigned char *data, size_t size, const KetchupSource &source, Ketchup_Patches &patches, Checks &checks)
+{
+	enum { SourceRead, TargetRead, SourceCopy, TargetCopy };
+
+	constexpr size_t footer = 12;
+	if (size < 4 + footer) return false;
+	if (CRC32(data, size - 4) != ReadCRC(data + size - 4)) return false;
+
+	size_t end = size - footer;
+	size_t pos = 4;
+	uint64_t source_size, target_size, metadata;
+	if (!ReadNumber(data, end, pos, source_size) || !ReadNumber(data, end, pos, target_size)) return false;
+	if (!ReadNumber(data, end, pos, metadata) || metadata > end - pos) return false;
+	pos += static_cast<size_t>(metadata);
+
+	// Without the image the patch can still apply if it only ever keeps it as
+	// is, but it can't be checked against it.
+	checks = { CheckImage, ReadCRC(data + end), source_size };
+	if (!Check(checks, source)) {
+		spdlog::warn("[SQ] [Ketchup] BPS patch is for a different disc image.");
+		return false;
+	}
+
+	Ketchup_Patches runs;
+	std::vector<unsigned char> run;
+	uint64_t offset = 0, source_offset = 0, target_offset = 0;
+	while (pos < end) {
+		uint64_t action;
+		if (!ReadNumber(data, end, pos, action)) return false;
+		uint64_t length = (action >> 2) + 1;
+		if (length > target_size - std::min(offset, target_size)) return false;
+
+		uint64_t from = 0, delta;
+		switch (action & 3) {
+			case SourceRead:
+				break;
+			case TargetRead:
+				if (length > end - pos) return false;
+				Coalesce(runs, offset, data + pos, static_cast<size_t>(length));
+				pos += static_cast<size_t>(length);
+				break;
+			case SourceCopy:
+			case TargetCopy: {
+				if (!ReadNumber(data, end, pos, delta)) return false;
+				uint64_t &relative = (action & 3) == SourceCopy ? source_offset : target_offset;
+				relative += (delta & 1) ? 0 - (delta >> 1) : (delta >> 1);
+				from = relative;
+				relative += length;
+
+				if ((action & 3) == SourceCopy) {
+					if (from > source_size || length > source_size - from) return false;
+					if (from == offset) break;
+					if (!source.Valid()) {
+						spdlog::warn("[SQ] [Ketchup] BPS patch copies from the disc image, which isn't available.");
+						return false;
+					}
+					run.resize(static_cast<size_t>(length));
+					source.Read(from, run.data(), run.size());
+					Coalesce(runs, offset, run.data(), run.size());
+					break;
+				}
+
+				// Copies overlapping what they write repeat it, so copy at most
+				// what's already written at a time.
+				if (from >= offset) return false;
+				for (uint64_t done = 0; done < length;) {
+					size_t chunk = static_cast<size_t>(std::min<uint64_t>({ length - done, offset - from, 0x100000 }));
+					run.resize(chunk);
+					if (!source.Valid() && !Covers(runs, from + done, chunk)) {
+						spdlog::warn("[SQ] [Ketchup] BPS patch copies from the disc image, which isn't available.");
+						return false;
+					}
+					ReadTarget(runs, source, from + done, run.data(), chunk);
+					Coalesce(runs, offset + done, run.data(), chunk);
+					done += chunk;
+				}
+				break;
+			}
+		}
+		offset += length;
+	}
+	if (offset != target_size) return false;
+
+	if (source.Valid() && TargetCRC(runs, source, target_size) != ReadCRC(data + end + 4)) return false;
+
+	for (auto &[offset, run] : runs) {
+		Coalesce(patches, offset, run.data(), run.size());
+	}
+	return true;
+}
+
+bool KetchupPatch::ReadTarget(const Ketchup_Patches &runs, const KetchupSource &source, uint64_t offset, unsigned char *data, size_t size)
+{
+	bool read = source.Read(offset, data, size);
+
+	uint64_t end = offset + size;
+	auto it = runs.upper_bound(offset);
+	if (it != runs.begin()) --it;
+	for (; it != runs.end() && it->first < end; ++it) {
+		uint64_t begin = std::max(it->first, offset);
+		uint64_t until = std::min<uint64_t>(it->first + it->second.size(), end);
+		if (begin >= until) continue;
+		std::copy_n(it->second.begin() + static_cast<size_t>(begin - it->first), static_cast<size_t>(until - begin),
+			data + static_cast<size_t>(begin - offset));
+	}
+	return read;
+}
+
+bool KetchupPatch::Covers(const Ketchup_Patches &runs, uint64_t offset, size_t size)
+{
+	auto it = runs.upper_bound(offset);
+	if (it == runs.begin()) return false;
+	--it;
+	return it->first + it->second.size() >= offset + size;
+}
+
+uint32_t KetchupPatch::TargetCRC(const Ketchup_Patches &runs, const KetchupSource &source, uint64_t size)
+{
+	std::vector<unsigned char> chunk(0x100000);
+	uint32_t crc = 0;
+	for (uint64_t offset = 0; offset < size; offset += chunk.size()) {
+		size_t length = static_cast<size_t>(std::min<uint64_t>(chunk.size(), size - offset));
+		ReadTarget(runs, source, offset, chunk.data(), length);
+		crc = CRC32(chunk.data(), length, crc);
+	}
+	return crc;
+}
+
+// Table k gives a byte's CRC with k zero bytes after it, so eight bytes fold
+// in with eight independent lookups rather than eight dependent ones.
+uint32_t KetchupPatch::CRC32(const unsigned char *data, size_t size, uint32_t crc)
+{
+	static const auto table = [] {
+		std::array<std::array<uint32_t, 256>, 8> table {};
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			table[0][i] = c;
+		}
+		for (uint32_t i = 0; i < 256; ++i) {
+			for (int k = 1; k < 8; ++k) table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+		}
+		return table;
+	}();
+
+	crc = ~crc;
+	for (; size >= 8; data += 8, size -= 8) {
+		uint32_t lo = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24));
+		uint32_t hi = data[4] | (data[5] << 8) | (data[6] << 16) | (static_cast<uint32_t>(data[7]) << 24);
+		crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+			table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+	}
+	for (size_t i = 0; i < size; ++i) crc = table[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+// `IndexHeader`, then `u64 offset, u64 size, data[size]` per run.
+bool KetchupPatch::ReadIndex(const std::vector<unsigned char> &index, Ketchup_Patches &patches)
+{
+	size_t pos = sizeof(IndexHeader);
+	if (index.size() < pos) return false;
+
+	IndexHeader header;
+	std::memcpy(&header, index.data(), sizeof(header));
+
+	std::vector<std::tuple<uint64_t, const unsigned char *, size_t>> runs;
+	for (uint64_t i = 0; i < header.runs; ++i) {
+		if (index.size() - pos < sizeof(uint64_t) * 2) return false;
+
+		uint64_t offset, length;
+		std::memcpy(&offset, index.data() + pos, sizeof(offset));
+		std::memcpy(&length, index.data() + pos + sizeof(offset), sizeof(length));
+		pos += sizeof(offset) + sizeof(length);
+
+		if (index.size() - pos < length || offset > UINT64_MAX - length) return false;
+		runs.emplace_back(offset, index.data() + pos, static_cast<size_t>(length));
+		pos += static_cast<size_t>(length);
+	}
+	if (pos != index.size()) return false;
+
+	for (auto &[offset, run, length] : runs) {
+		Coalesce(patches, offset, run, length);
+	}
+	return true;
+}
+
+std::vector<unsigned char> KetchupPatch::BuildIndex(const IndexHeader &header, const Ketchup_Patches &runs)
+{
+	std::vector<unsigned char> index(sizeof(header));
+	std::memcpy(index.data(), &header, sizeof(header));
+
+	for (auto &[offset, run] : runs) {
+		uint64_t length = run.size();
+		size_t pos = index.size();
+		index.resize(pos + sizeof(offset) + sizeof(length) + run.size());
+		std::memcpy(index.data() + pos, &offset, sizeof(offset));
+		std::memcpy(index.data() + pos + sizeof(offset), &length, sizeof(length));
+		std::copy(run.begin(), run.end(), index.begin() + pos + sizeof(offset) + sizeof(length));
+	}
+	return index;
+}
+
+bool KetchupPatch::WriteIndex(const std::filesystem::path &path, const std::vector<unsigned char> &index)
+{
+	// Write aside and swap in, a torn write only ever loses the index.
+	auto temp = path;
+	temp += ".tmp";
+	{
+		std::ofstream file(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file) return false;
+		file.write(reinterpret_cast<const char *>(index.data()), index.size());
+		if (!file) return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(temp, path, ec);
+	return !ec;
+}
+
+// FNV-1a, as for signatures.
+uint64_t KetchupPatch::Hash(const unsigned char *data, size_t size)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
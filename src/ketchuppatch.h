@@ -0,0 +1,156 @@
+#pragma once
+
+#include "stdafx.h"
+
+// Patched bytes by CD-ROM offset, kept as disjoint, non-adjacent runs.
+typedef std::map<uint64_t, std::vector<unsigned char>> Ketchup_Patches;
+
+// A mod file mapped read-only, parsed in place rather than read piecemeal.
+class KetchupFile
+{
+public:
+	explicit KetchupFile(const std::filesystem::path &path);
+	~KetchupFile();
+
+	KetchupFile(const KetchupFile &) = delete;
+	KetchupFile &operator=(const KetchupFile &) = delete;
+
+	const unsigned char *Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+
+private:
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+	const unsigned char *m_data = nullptr;
+	size_t m_size = 0;
+};
+
+class KetchupFingerprint;
+
+// The disc image patches apply to, read on demand at any offset and from any
+// thread. Reads past its end, or from an image that isn't there, come back
+// as zeroes.
+class KetchupSource
+{
+public:
+	KetchupSource();
+	explicit KetchupSource(const std::filesystem::path &path);
+	~KetchupSource();
+
+	KetchupSource(const KetchupSource &) = delete;
+	KetchupSource &operator=(const KetchupSource &) = delete;
+
+	bool Valid() const { return m_file != INVALID_HANDLE_VALUE; }
+	uint64_t Size() const { return m_size; }
+
+	bool Read(uint64_t offset, unsigned char *data, size_t size) const;
+
+	// Starts working out the image's CRC-32 in the background, remembered in
+	// `cache` for as long as the image doesn't change.
+	void Fingerprint(const std::filesystem::path &cache);
+
+	// The CRC-32 of the whole image, waiting on the fingerprint if it was
+	// started or else reading it through here and now. Null if it can't be read.
+	std::optional<uint32_t> CRC32() const;
+
+private:
+	std::filesystem::path m_path;
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	uint64_t m_size = 0;
+
+	std::unique_ptr<KetchupFingerprint> m_fingerprint;
+};
+
+class KetchupPatch
+{
+public:
+	// What a mod says of the image it was made for, checked each time it loads.
+	struct Checks
+	{
+		uint32_t flags = 0;
+		uint32_t crc = 0;
+		uint64_t size = 0;
+		// PPF3's validation block, by where it lies on the image and its hash.
+		uint64_t block = 0;
+		uint64_t block_hash = 0;
+	};
+
+	enum : uint32_t { CheckImage = 1, CheckBlock = 2 };
+
+	// Loads a mod's runs from the index cached next to it, or parses the mod
+	// and caches its index for the next boot.
+	static bool Load(const std::filesystem::path &path, const KetchupSource &source, Ketchup_Patches &patches);
+
+	// The mods in a folder in the order they apply, later ones winning. Those
+	// named in its load order file come first and in that order, the rest
+	// follow in lexical order.
+	static std::vector<std::filesystem::path> LoadOrder(const std::filesystem::path &root);
+
+	// Loads `mods` in parallel and merges them in order, logging wherever a
+	// mod overrides bytes an earlier one patched differently. Mods already in
+	// `loaded` aren't loaded again, those newly loaded are kept there and
+	// those no longer in `mods` are dropped.
+	static void Compose(const std::vector<std::filesystem::path> &mods, const KetchupSource &source, Ketchup_Patches &patches,
+		std::map<std::filesystem::path, Ketchup_Patches> &loaded);
+
+	// Parses a whole PPF3, IPS, UPS or BPS file. Nothing is added unless all
+	// of it is well formed and its checksums hold. UPS, and BPS copying from
+	// the image, need `source`. Whatever the mod says of its image goes in
+	// `checks`, for `Check`.
+	static bool Parse(const unsigned char *data, size_t size, const KetchupSource &source, Ketchup_Patches &patches, Checks &checks);
+
+	// Whether `source` is the image a mod was made for, as far as it says and
+	// the image can be read to tell.
+	static bool Check(const Checks &checks, const KetchupSource &source);
+
+	// Later records win where they overlap, as if written one after another.
+	static void Coalesce(Ketchup_Patches &patches, uint64_t offset, const unsigned char *data, size_t size);
+
+	// The patched image as it would be, read through `runs` onto `source`.
+	// False if the image under them couldn't be read.
+	static bool ReadTarget(const Ketchup_Patches &runs, const KetchupSource &source, uint64_t offset, unsigned char *data, size_t size);
+
+	// Whether `runs` patch every byte of the range, as runs never touch.
+	static bool Covers(const Ketchup_Patches &runs, uint64_t offset, size_t size);
+
+	static uint64_t Hash(const unsigned char *data, size_t size);
+
+	// Eight bytes a step through eight tables rather than one.
+	static uint32_t CRC32(const unsigned char *data, size_t size, uint32_t crc = 0);
+
+	static constexpr const char *IndexExtension = ".kidx";
+	static constexpr const char *LoadOrderFile = "loadorder.txt";
+
+private:
+	// Keyed by the mod's size & modification time, and by its contents in
+	// case only the time changed.
+	struct IndexHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t size;
+		int64_t time;
+		uint64_t hash;
+		uint64_t runs;
+		Checks checks;
+	};
+
+	static constexpr uint32_t m_iIndexMagic = 'XDIK';
+	static constexpr uint32_t m_iIndexVersion = 2;
+
+	// How many bytes `later` patches differently from `earlier`, and the first.
+	static std::pair<uint64_t, uint64_t> Conflicts(const Ketchup_Patches &earlier, const Ketchup_Patches &later);
+
+	static bool ParsePPF3(const unsigned char *data, size_t size, Ketchup_Patches &patches, Checks &checks);
+	static bool ParseIPS(const unsigned char *data, size_t size, Ketchup_Patches &patches);
+	static bool ParseUPS(const unsigned char *data, size_t size, const KetchupSource &source, Ketchup_Patches &patches, Checks &checks);
+	static bool ParseBPS(const unsigned char *data, size_t size, const KetchupSource &source, Ketchup_Patches &patches, Checks &checks);
+
+	// The CRC-32 of the first `size` bytes of the image, patched by `runs`.
+	static uint32_t TargetCRC(const Ketchup_Patches &runs, const KetchupSource &source, uint64_t size);
+
+	static bool ReadIndex(const std::vector<unsigned char> &index, Ketchup_Patches &patches);
+	static std::vector<unsigned char> BuildIndex(const IndexHeader &header, const Ketchup_Patches &runs);
+	static bool WriteIndex(const std::filesystem::path &path, const std::vector<unsigned char> &index);
+
+};
@@ -0,0 +1,102 @@
+#include "ketchupreload.h"
+#include "ketchupiso.h"
+
+void KetchupReload::Update(const std::filesystem::path &root, const KetchupSource &source, bool released, const Builtin &builtin, Ketchup_Patches &patches)
+{
+	patches.clear();
+
+	bool fresh = !m_watch || m_watch->Root() != root;
+	if (fresh) {
+		m_watch = std::make_unique<KetchupWatch>(root);
+		m_mods.clear();
+		m_applied.clear();
+	}
+	else {
+		auto changed = m_watch->Poll();
+		if (changed.empty()) {
+			if (released) patches = m_applied;
+			return;
+		}
+		for (auto &path : changed) {
+			spdlog::info("[SQ] [Ketchup] {} changed.", path.string());
+			m_mods.erase(path);
+		}
+	}
+
+	// Every mod is merged first, then each contiguous run is patched once.
+	std::error_code ec;
+	std::vector<std::filesystem::path> mods;
+	if (std::filesystem::is_directory(root, ec)) mods = KetchupPatch::LoadOrder(root);
+
+	Ketchup_Patches composed;
+	KetchupPatch::Compose(mods, source, composed, m_mods);
+
+	// Replacement files go on top of every mod.
+	KetchupISO::Replace(root / KetchupISO::FilesFolder, source, root / KetchupISO::IndexFile, composed);
+
+	if (fresh || released) patches = composed;
+	else {
+		Ketchup_Patches base;
+		if (builtin) builtin(m_applied, base);
+		patches = Diff(m_applied, composed, base, source);
+		spdlog::info("[SQ] [Ketchup] {} runs differ from those last applied.", patches.size());
+	}
+	m_applied = std::move(composed);
+}
+
+// Only the bytes that differ, as setting a byte to what it already is costs
+// the same as changing it. What's set back is the image with the game's own
+// patches on it, so a built-in patch a removed mod overrode comes back.
+Ketchup_Patches KetchupReload::Diff(const Ketchup_Patches &before, const Ketchup_Patches &after, const Ketchup_Patches &builtin, const KetchupSource &source)
+{
+	// Between any two of these, each side either patches all or none of it.
+	std::vector<uint64_t> bounds;
+	for (const auto *runs : { &before, &after }) {
+		for (auto &[offset, run] : *runs) {
+			bounds.push_back(offset);
+			bounds.push_back(offset + run.size());
+		}
+	}
+	std::sort(bounds.begin(), bounds.end());
+	bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+	Ketchup_Patches diff;
+	std::vector<unsigned char> image;
+	uint64_t lost = 0;
+	auto b = before.begin();
+	auto a = after.begin();
+	for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+		uint64_t start = bounds[i];
+		size_t size = static_cast<size_t>(bounds[i + 1] - start);
+
+		while (b != before.end() && b->first + b->second.size() <= start) ++b;
+		while (a != after.end() && a->first + a->second.size() <= start) ++a;
+		const unsigned char *was = b != before.end() && b->first <= start ? b->second.data() + (start - b->first) : nullptr;
+		const unsigned char *now = a != after.end() && a->first <= start ? a->second.data() + (start - a->first) : nullptr;
+		if (!was && !now) continue;
+
+		if (!now) {
+			image.resize(size);
+			if (!KetchupPatch::ReadTarget(builtin, source, start, image.data(), size) &&
+				!KetchupPatch::Covers(builtin, start, size)) {
+				lost += size;
+				continue;
+			}
+			now = image.data();
+		}
+
+		for (size_t j = 0; j < size;) {
+			if (was && was[j] == now[j]) {
+				++j;
+				continue;
+			}
+			size_t k = j + 1;
+			while (k < size && !(was && was[k] == now[k])) ++k;
+			KetchupPatch::Coalesce(diff, start + j, now + j, k - j);
+			j = k;
+		}
+	}
+
+	if (lost) spdlog::warn("[SQ] [Ketchup] {} bytes no longer patched can't be set back without the disc image.", lost);
+	return diff;
+}
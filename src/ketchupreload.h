@@ -0,0 +1,36 @@
+#pragma once
+
+#include "stdafx.h"
+#include "ketchuppatch.h"
+#include "ketchupwatch.h"
+
+// The mods last applied to a disc, kept so that when they change only the
+// mods that changed are loaded again, and only the bytes that now differ are
+// patched again.
+class KetchupReload
+{
+public:
+	// Reads the game's own patches under the runs given into the second.
+	using Builtin = std::function<void(const Ketchup_Patches &, Ketchup_Patches &)>;
+
+	// What to patch to bring the disc from what was last applied to what the
+	// mods under `root` make it now. All of it for a new folder, or once the
+	// emulator has `released` its patches, else only what differs. Nothing if
+	// no mod changed. A folder that's gone has no mods, so what they patched
+	// is set back to the image under the game's own patches, read through
+	// `builtin` only when something is set back.
+	void Update(const std::filesystem::path &root, const KetchupSource &source, bool released, const Builtin &builtin, Ketchup_Patches &patches);
+
+	// The runs that take `before` to `after`: bytes `after` patches
+	// differently, and bytes only `before` patched set back to the image as
+	// `builtin` patches it.
+	static Ketchup_Patches Diff(const Ketchup_Patches &before, const Ketchup_Patches &after, const Ketchup_Patches &builtin, const KetchupSource &source);
+
+	// What was last applied.
+	const Ketchup_Patches &Applied() const { return m_applied; }
+
+private:
+	std::unique_ptr<KetchupWatch> m_watch;
+	std::map<std::filesystem::path, Ketchup_Patches> m_mods;
+	Ketchup_Patches m_applied;
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "stdafx.h"
+
+// Raw 0x930 byte CD-ROM sectors: sync, header, and for Mode 2 a subheader,
+// then user data and its EDC & ECC, which have to be made again whenever the
+// data changes.
+class KetchupSector
+{
+public:
+	static constexpr size_t Size = 0x930;
+	static constexpr size_t DataSize = 0x800;
+
+	static constexpr unsigned char Sync[12] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+
+	static bool Synced(const unsigned char *sector)
+	{
+		return std::memcmp(sector, Sync, sizeof(Sync)) == 0;
+	}
+
+	static unsigned Mode(const unsigned char *sector)
+	{
+		return sector[0xF];
+	}
+
+	// Mode 2 Form 2 has 0x914 bytes of data and no ECC.
+	static bool Form2(const unsigned char *sector)
+	{
+		return Mode(sector) == 2 && (sector[0x12] & 0x20);
+	}
+
+	// Where the user data starts, or 0 for sectors without any.
+	static size_t DataOffset(const unsigned char *sector)
+	{
+		if (!Synced(sector)) return 0;
+		switch (Mode(sector)) {
+			case 1: return 0x10;
+			case 2: return 0x18;
+			default: return 0;
+		}
+	}
+
+	// Makes the EDC & ECC again for the sector's mode and form.
+	static void Regenerate(unsigned char *sector)
+	{
+		Regenerate(sector, Mode(sector), Form2(sector));
+	}
+
+	static void Regenerate(unsigned char *sector, unsigned mode, bool form2)
+	{
+		switch (mode) {
+			case 1:
+				Store(sector + 0x810, EDC(sector, 0x810));
+				std::memset(sector + 0x814, 0, 8);
+				ECC(sector, false);
+				break;
+			case 2:
+				if (form2) {
+					Store(sector + 0x92C, EDC(sector + 0x10, 0x91C));
+					break;
+				}
+				Store(sector + 0x818, EDC(sector + 0x10, 0x808));
+				ECC(sector, true);
+				break;
+			default: break;
+		}
+	}
+
+	static uint32_t EDC(const unsigned char *data, size_t size, uint32_t edc = 0)
+	{
+		auto & tables = Tables();
+		for (size_t i = 0; i < size; ++i) edc = (edc >> 8) ^ tables.edc[(edc ^ data[i]) & 0xFF];
+		return edc;
+	}
+
+	// The P & Q parity over the header onwards, with the header zeroed for
+	// Mode 2 as it isn't covered there.
+	static void ECC(unsigned char *sector, bool zeroHeader)
+	{
+		unsigned char header[4];
+		if (zeroHeader) {
+			std::memcpy(header, sector + 0xC, sizeof(header));
+			std::memset(sector + 0xC, 0, sizeof(header));
+		}
+
+		Parity(sector + 0xC, 86, 24, 2, 86, sector + 0x81C);
+		Parity(sector + 0xC, 52, 43, 86, 88, sector + 0x8C8);
+
+		if (zeroHeader) std::memcpy(sector + 0xC, header, sizeof(header));
+	}
+
+private:
+	struct Table
+	{
+		unsigned char f[256];
+		unsigned char b[256];
+		uint32_t edc[256];
+	};
+
+	static const Table & Tables()
+	{
+		static const Table tables = [] {
+			Table table {};
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint32_t j = (i << 1) ^ (i & 0x80 ? 0x11D : 0);
+				table.f[i] = static_cast<unsigned char>(j);
+				table.b[i ^ j] = static_cast<unsigned char>(i);
+
+				uint32_t edc = i;
+				for (int k = 0; k < 8; ++k) edc = (edc >> 1) ^ (edc & 1 ? 0xD8018001 : 0);
+				table.edc[i] = edc;
+			}
+			return table;
+		}();
+		return tables;
+	}
+
+	static void Parity(const unsigned char *data, size_t majors, size_t minors, size_t majorMult, size_t minorInc, unsigned char *dest)
+	{
+		auto & tables = Tables();
+		size_t size = majors * minors;
+		for (size_t major = 0; major < majors; ++major) {
+			size_t index = (major >> 1) * majorMult + (major & 1);
+			unsigned char a = 0, b = 0;
+			for (size_t minor = 0; minor < minors; ++minor) {
+				unsigned char value = data[index];
+				index += minorInc;
+				if (index >= size) index -= size;
+				a ^= value;
+				b ^= value;
+				a = tables.f[a];
+			}
+			a = tables.b[tables.f[a] ^ b];
+			dest[major] = a;
+			dest[major + majors] = a ^ b;
+		}
+	}
+
+	static void Store(unsigned char *dest, uint32_t value)
+	{
+		for (int i = 0; i < 4; ++i) dest[i] = static_cast<unsigned char>(value >> (i * 8));
+	}
+};
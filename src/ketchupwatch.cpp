@@ -0,0 +1,57 @@
+#include "ketchupwatch.h"
+#include "ketchuppatch.h"
+#include "ketchupiso.h"
+#include "ketchupoverlay.h"
+
+KetchupWatch::KetchupWatch(const std::filesystem::path &root)
+	: m_root(root), m_files(Scan())
+{
+}
+
+std::vector<std::filesystem::path> KetchupWatch::Poll()
+{
+	auto files = Scan();
+
+	// Both are sorted, so one sweep finds what's new, gone or different.
+	std::vector<std::filesystem::path> changed;
+	auto a = m_files.begin();
+	auto b = files.begin();
+	while (a != m_files.end() || b != files.end()) {
+		if (b == files.end() || (a != m_files.end() && a->first < b->first)) {
+			changed.push_back((a++)->first);
+		}
+		else if (a == m_files.end() || b->first < a->first) {
+			changed.push_back((b++)->first);
+		}
+		else {
+			if (!(a->second == b->second)) changed.push_back(b->first);
+			++a; ++b;
+		}
+	}
+
+	m_files = std::move(files);
+	return changed;
+}
+
+// A file that goes away mid scan is just left out, and seen on the next.
+std::map<std::filesystem::path, KetchupWatch::Stamp> KetchupWatch::Scan() const
+{
+	std::map<std::filesystem::path, Stamp> files;
+
+	std::error_code ec;
+	for (std::filesystem::recursive_directory_iterator it(m_root, ec), end; !ec && it != end; it.increment(ec)) {
+		std::error_code error;
+		if (!it->is_regular_file(error)) continue;
+
+		auto extension = it->path().extension();
+		if (extension == KetchupPatch::IndexExtension || extension == KetchupOverlay::Extension || extension == ".tmp") continue;
+		if (it->path().filename() == KetchupISO::IndexFile) continue;
+
+		uint64_t size = it->file_size(error);
+		if (error) continue;
+		int64_t time = it->last_write_time(error).time_since_epoch().count();
+		if (error) continue;
+		files[it->path()] = { size, time };
+	}
+	return files;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "stdafx.h"
+
+// The files under a mod folder by size & modification time. It's polled
+// rather than notified, so it works the same everywhere and costs nothing
+// between the points mods are applied at.
+class KetchupWatch
+{
+public:
+	explicit KetchupWatch(const std::filesystem::path &root);
+
+	const std::filesystem::path &Root() const { return m_root; }
+
+	// The files added, changed or removed since the last poll, or since it
+	// was made. Indexes & overlays written alongside the mods are left out.
+	std::vector<std::filesystem::path> Poll();
+
+private:
+	struct Stamp
+	{
+		uint64_t size;
+		int64_t time;
+
+		bool operator==(const Stamp &other) const { return size == other.size && time == other.time; }
+	};
+
+	std::map<std::filesystem::path, Stamp> Scan() const;
+
+	std::filesystem::path m_root;
+	std::map<std::filesystem::path, Stamp> m_files;
+};
@@ -46,6 +46,8 @@ void M2Config::Load()
     inipp::get_value(ini.sections["Squirrel Debugger"], "AutoUpdate", bDebuggerAutoUpdate);
     inipp::get_value(ini.sections["Squirrel Debugger"], "Exclusive", bDebuggerExclusive);
 
+    inipp::get_value(ini.sections["Squirrel Hooks"], "Trampolines", bHookTrampolines);
+
     {
         bool _bSmoothing;
         if (inipp::get_value(ini.sections["Screen"], "Smoothing", _bSmoothing))
@@ -66,6 +68,7 @@ void M2Config::Load()
     inipp::get_value(ini.sections["Tracing"], "Console", bConsole);
     inipp::get_value(ini.sections["Tracing"], "Error", bError);
     inipp::get_value(ini.sections["Tracing"], "Level", iLevel);
+    inipp::get_value(ini.sections["Tracing"], "DebugInfo", sDebugInfo);
     inipp::get_value(ini.sections["Tracing"], "NativeLevel", iNativeLevel);
     inipp::get_value(ini.sections["Tracing"], "EmulatorLevel", iEmulatorLevel);
     inipp::get_value(ini.sections["Tracing"], "RendererLevel", iRendererLevel);
@@ -142,6 +145,7 @@ void M2Config::Load()
     spdlog::info("[Config] iDebuggerPort: {}", iDebuggerPort);
     spdlog::info("[Config] bDebuggerAutoUpdate: {}", bDebuggerAutoUpdate);
     spdlog::info("[Config] bDebuggerExclusive: {}", bDebuggerExclusive);
+    spdlog::info("[Config] bHookTrampolines: {}", bHookTrampolines);
     if (bSmoothing) spdlog::info("[Config] bSmoothing: {}", *bSmoothing);
     if (bScanline)  spdlog::info("[Config] bScanline: {}", *bScanline);
     if (bDotMatrix) spdlog::info("[Config] bDotMatrix: {}", *bDotMatrix);
@@ -149,6 +153,7 @@ void M2Config::Load()
     spdlog::info("[Config] bConsole: {}", bConsole);
     spdlog::info("[Config] bError: {}", bError);
     spdlog::info("[Config] iLevel: {}", iLevel);
+    spdlog::info("[Config] sDebugInfo: {}", sDebugInfo);
     spdlog::info("[Config] iNativeLevel: {}", iNativeLevel);
     spdlog::info("[Config] iEmulatorLevel: {}", iEmulatorLevel);
     spdlog::info("[Config] iRendererLevel: {}", iRendererLevel);
@@ -33,6 +33,7 @@ public:
     static inline int iDebuggerPort;
     static inline bool bDebuggerAutoUpdate;
     static inline bool bDebuggerExclusive;
+    static inline bool bHookTrampolines;
     static inline std::optional<bool> bSmoothing;
     static inline std::optional<bool> bScanline;
     static inline std::optional<bool> bDotMatrix;
@@ -40,6 +41,7 @@ public:
     static inline bool bConsole;
     static inline bool bError;
     static inline int iLevel;
+    static inline std::string sDebugInfo = "*";
     static inline int iNativeLevel;
     static inline int iEmulatorLevel;
     static inline int iRendererLevel;
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// [Tracing] DebugInfo, the scripts compiled with line ops: comma separated
+// parts of script names, or * for all of them.
+class M2DebugInfo
+{
+public:
+    // Whether `list` names any of `scripts`. A batch of no scripts at all,
+    // as between loads, is only named by *.
+    static bool Matches(std::string_view list, const std::vector<std::string> &scripts)
+    {
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view name = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view {} : list.substr(comma + 1);
+
+            size_t first = name.find_first_not_of(" \t");
+            if (first == std::string_view::npos) continue;
+            name = name.substr(first, name.find_last_not_of(" \t") + 1 - first);
+            if (name == "*") return true;
+
+            for (auto &script : scripts) {
+                if (script.find(name) != std::string::npos) return true;
+            }
+        }
+        return false;
+    }
+};
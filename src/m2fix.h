@@ -100,6 +100,10 @@ public:
         M2Utils::CompatibilityWarnings();
         if (M2Config::bBreak) __debugbreak();
 
+        if (auto appdata = std::getenv("APPDATA")) {
+            M2Hook::UseCache(std::filesystem::path(appdata) / "M2Fix" / "signature_cache.json");
+        }
+
         if (M2Fix::DetectGame())
         {
             spdlog::info("{} v{} started for {}.",
@@ -111,6 +115,8 @@ public:
 
             if (M2Config::bConsole) M2Fix::Console();
 
+            M2Hook::Defer();
+
             EPI::LoadInstance();
             SQHook<>::LoadInstance();
 
@@ -123,6 +129,8 @@ public:
             }
             Game.Load();
 
+            M2Hook::Commit();
+
             spdlog::info("----------");
         }
 
@@ -263,8 +271,15 @@ public:
         );
         spdlog::info("----------");
 
+        hook.Prefetch({
+            M2Signature::Data("43 4C 41 53 53 4E 41 4D 45 20 3D 20"),
+            M2Signature::Data("43 41 50 54 49 4F 4E 20 3D 20"),
+            M2Signature::Data("42 41 43 4B 55 50 5F 42 41 53 45 5F 50 41 54 48 20 3D 20"),
+            M2Signature::Data("53 71 75 69 72 72 65 6C 20 32 2E 32 2E 34 20 73 74 61 62 6C 65"),
+        });
+
         uintptr_t _classname = M2Hook::GetInstance().Scan(
-            "43 4C 41 53 53 4E 41 4D 45 20 3D 20",
+            M2Signature::Data("43 4C 41 53 53 4E 41 4D 45 20 3D 20"),
             0xC // `CLASSNAME = `
         );
         for (auto & [type, info] : M2Fix::GetInstance().m_kGames)
@@ -279,13 +294,13 @@ public:
 
                 m_kGame->title = M2Hook::ReadUntilTabOrCRLF(
                     M2Hook::GetInstance().Scan(
-                        "43 41 50 54 49 4F 4E 20 3D 20",
+                        M2Signature::Data("43 41 50 54 49 4F 4E 20 3D 20"),
                         0xA
                     )); // `CAPTION = `
 
                 const std::string_view path = M2Hook::ReadUntilTabOrCRLF(
                     M2Hook::GetInstance().Scan(
-                        "42 41 43 4B 55 50 5F 42 41 53 45 5F 50 41 54 48 20 3D 20",
+                        M2Signature::Data("42 41 43 4B 55 50 5F 42 41 53 45 5F 50 41 54 48 20 3D 20"),
                         0x13
                     )); // `BACKUP_BASE_PATH = `
 
@@ -319,7 +334,7 @@ public:
         );
 
         if (M2Hook::GetInstance().Scan(
-            "53 71 75 69 72 72 65 6C 20 32 2E 32 2E 34 20 73 74 61 62 6C 65",
+            M2Signature::Data("53 71 75 69 72 72 65 6C 20 32 2E 32 2E 34 20 73 74 61 62 6C 65"),
             0 /* `Squirrel 2.2.4 stable` */) != 0) {
             message += fmt::format(
                 "This may be due to a {} bug, faulty install, a recent game update or the game is a fresh release requiring an update to {}."
@@ -1,6 +1,12 @@
 #pragma once
 
 #include "stdafx.h"
+#include "m2pe.h"
+#include "m2scan.h"
+#include "m2scancache.h"
+#include "m2signature.h"
+
+#include <atomic>
 
 class M2Hook
 {
@@ -16,7 +22,8 @@ public:
 
     static auto & GetInstance(std::optional<std::string> name = std::nullopt, HMODULE module = nullptr)
     {
-        static std::map<std::optional<std::string>, M2Hook> instances;
+        std::lock_guard lock(InstancesMutex());
+        auto & instances = Instances();
         if (name && name->empty()) name = std::nullopt;
         if (instances.count(name) == 0) {
             if (!module) module = GetModuleHandle(name ? name->c_str() : nullptr);
@@ -30,9 +37,144 @@ public:
         GetInstance(".", reinterpret_cast<HMODULE>(hinstDLL));
     }
 
+    // What a signature based Hook/MidHook/Patch did. Only true once applied,
+    // a call queued while deferred is pending, which tests false so that an
+    // `if (!ret)` fallback is queued after it, but isn't a failure.
+    class Result
+    {
+    public:
+        enum class State { Failed, Applied, Queued };
+
+        Result(bool applied) : m_state(applied ? State::Applied : State::Failed) {}
+        Result(State state) : m_state(state) {}
+
+        explicit operator bool() const { return m_state == State::Applied; }
+        bool Pending() const { return m_state == State::Queued; }
+
+    private:
+        State m_state;
+    };
+
+    // Between Defer() and Commit(), signature based Hook/MidHook/Patch calls are
+    // queued and return a pending Result, Commit() then resolves every queued
+    // signature of a module in one pass over its image and applies them in their
+    // original order. Everything else still happens as it's called, so a hook or
+    // patch by address, or a Scan, goes ahead of queued ones called before it.
+    // Nothing called while deferred reads bytes a queued call rewrites.
+    static void Defer()
+    {
+        s_deferred = true;
+    }
+
+    static void Commit()
+    {
+        s_deferred = false;
+
+        // Node references hold as instances are added, which a hook applied
+        // here may do, so the lock isn't held over them.
+        std::vector<M2Hook *> hooks;
+        {
+            std::lock_guard lock(InstancesMutex());
+            for (auto & [name, hook] : Instances()) hooks.push_back(&hook);
+        }
+
+        for (auto *hook : hooks) {
+            std::vector<Deferred> deferred;
+            {
+                std::lock_guard lock(hook->m_mutex);
+                deferred = std::move(hook->m_deferred);
+                hook->m_deferred.clear();
+            }
+            if (deferred.empty()) continue;
+
+            std::vector<M2Signature> signatures;
+            for (auto & entry : deferred) signatures.push_back(entry.signature);
+            hook->Prefetch(signatures);
+
+            bool applied = false;
+            for (auto & entry : deferred) {
+                if (entry.otherwise && applied) continue;
+                applied = entry.apply();
+            }
+        }
+
+        s_committed = true;
+        SaveCache();
+    }
+
+    // Keeps resolved signature RVAs in `file` across launches.
+    static void UseCache(const std::filesystem::path & file)
+    {
+        Cache().Open(file);
+    }
+
+    // Marks the next Hook/MidHook/Patch as a fallback for the previous one, as
+    // whether that applied is only known at Commit(). Does nothing otherwise.
+    void Otherwise() const
+    {
+        std::lock_guard lock(m_mutex);
+        m_otherwise = s_deferred;
+    }
+
+    // Resolves a set of signatures in one pass, later Scan calls for them are
+    // answered from the results.
+    void Prefetch(const std::vector<M2Signature> & signatures) const
+    {
+        std::lock_guard lock(m_mutex);
+        auto base = reinterpret_cast<unsigned char *>(m_module);
+
+        std::vector<const M2Signature *> pending;
+        for (auto & signature : signatures) {
+            if (!signature.Valid() || m_signatures.count(signature.Hash())) continue;
+            if (std::any_of(pending.begin(), pending.end(), [&](auto p) { return p->Hash() == signature.Hash(); })) continue;
+
+            if (auto result = CacheLookup(signature)) {
+                m_signatures[signature.Hash()] = result;
+                continue;
+            }
+
+            pending.push_back(&signature);
+        }
+        if (pending.empty()) return;
+
+        std::vector<M2Scan::Request> requests;
+        for (auto signature : pending) requests.push_back(signature->Request());
+
+        // One pass per region over its own sections, then whatever is still
+        // missing gets a pass over the whole image.
+        for (auto region : { M2Signature::Region::Code, M2Signature::Region::Data }) {
+            std::vector<size_t> indices;
+            for (size_t i = 0; i < pending.size(); ++i) {
+                if (pending[i]->Area() == region) indices.push_back(i);
+            }
+            FindAll(requests, indices, ModuleRanges(region));
+        }
+
+        std::vector<size_t> missing;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            if (requests[i].result == M2Scan::npos) missing.push_back(i);
+        }
+        if (!missing.empty() && !ModuleImage().empty()) {
+            FindAll(requests, missing, { { 0, ModuleSize(m_module) } });
+        }
+
+        for (size_t i = 0; i < pending.size(); ++i) {
+            auto result = requests[i].result;
+            m_signatures[pending[i]->Hash()] = result == M2Scan::npos ? nullptr : base + result;
+            if (result != M2Scan::npos) Cache().Store(ModuleIdentity(), pending[i]->Hash(), result);
+        }
+    }
+
     template<typename Function>
-    bool Hook(const char *signature, std::ptrdiff_t offset, Function && function, const char *label = nullptr)
+    Result Hook(const M2Signature & signature, std::ptrdiff_t offset, Function && function, const char *label = nullptr)
     {
+        if (s_deferred) {
+            Queue(signature, [this, signature, offset, function, label] {
+                return static_cast<bool>(Hook(signature, offset, function, label));
+            });
+            return Result::State::Queued;
+        }
+
         void *addr = reinterpret_cast<void *>(Scan(signature, offset, label));
         if (!addr) return false;
 
@@ -52,8 +194,15 @@ public:
         return true;
     }
 
-    bool MidHook(const char *signature, std::ptrdiff_t offset, safetyhook::MidHookFn function, const char *label = nullptr)
+    Result MidHook(const M2Signature & signature, std::ptrdiff_t offset, safetyhook::MidHookFn function, const char *label = nullptr)
     {
+        if (s_deferred) {
+            Queue(signature, [this, signature, offset, function, label] {
+                return static_cast<bool>(MidHook(signature, offset, function, label));
+            });
+            return Result::State::Queued;
+        }
+
         void *addr = reinterpret_cast<void *>(Scan(signature, offset, label));
         if (!addr) return false;
 
@@ -183,23 +332,19 @@ public:
         return hook.call<Return>(std::forward<Args>(args) ...);
     }
 
-    uintptr_t Scan(const char *signature, std::ptrdiff_t offset, const char *label = nullptr) const
+    uintptr_t Scan(const M2Signature & signature, std::ptrdiff_t offset, const char *label = nullptr) const
     {
-        uint8_t *result = PatternScan(m_module, signature);
-        if (!result) {
-            if (label) spdlog::warn("{} pattern scan failed.", label);
-            return 0;
-        }
-
-        result += offset;
-        if (label) spdlog::info("{} is {}.", label, fmt::ptr(result));
-        return (uintptr_t) result;
+        return Located(PatternLookup(signature), offset, label);
     }
 
+    // Bytes known at runtime often hold relocated pointers, so they're looked
+    // up each launch rather than cached.
     uintptr_t Scan(void *data, size_t size, std::ptrdiff_t offset, const char *label = nullptr) const
     {
-        auto signature = BufferToPattern(data, size);
-        return Scan(signature.c_str(), offset, label);
+        if (size <= M2Signature::Capacity) return Located(PatternLookup(M2Signature::FromBytes(data, size), false), offset, label);
+
+        auto base = reinterpret_cast<unsigned char *>(m_module);
+        return Located(FindBytes(data, size, base, ModuleSize(m_module)), offset, label);
     }
 
     template <typename ... Types>
@@ -211,33 +356,33 @@ public:
     }
 
     template <typename ... Types>
-    std::tuple<Types ...> Unpack(const char *signature, std::ptrdiff_t offset, std::array<std::ptrdiff_t, sizeof...(Types)> offsets, const char *label = nullptr) const
+    std::tuple<Types ...> Unpack(const M2Signature & signature, std::ptrdiff_t offset, std::array<std::ptrdiff_t, sizeof...(Types)> offsets, const char *label = nullptr) const
     {
         void *addr = reinterpret_cast<void *>(Scan(signature, offset, label));
         return Unpack<Types ...>(addr, offsets, label);
     }
 
-    uintptr_t ScanBuffer(const char *signature, std::ptrdiff_t offset, void* buffer, size_t length, const char *label = nullptr) const
+    uintptr_t ScanBuffer(const M2Signature & signature, std::ptrdiff_t offset, void* buffer, size_t length, const char *label = nullptr) const
     {
-        uint8_t *result = PatternScanBuffer(buffer, length, signature);
-        if (!result) {
-            if (label) spdlog::warn("{} pattern scan failed.", label);
-            return 0;
-        }
-
-        result += offset;
-        if (label) spdlog::info("{} is {}.", label, fmt::ptr(result));
-        return (uintptr_t) result;
+        return Located(signature.Find(buffer, length), offset, label);
     }
 
     uintptr_t ScanBuffer(void *data, size_t size, std::ptrdiff_t offset, void* buffer, size_t length, const char *label = nullptr) const
     {
-        auto signature = BufferToPattern(data, size);
-        return ScanBuffer(signature.c_str(), offset, buffer, length, label);
+        if (size <= M2Signature::Capacity) return ScanBuffer(M2Signature::FromBytes(data, size), offset, buffer, length, label);
+
+        return Located(FindBytes(data, size, buffer, length), offset, label);
     }
 
-    bool Patch(const char *signature, std::ptrdiff_t offset, const char *data, const char *label = nullptr) const
+    Result Patch(const M2Signature & signature, std::ptrdiff_t offset, const char *data, const char *label = nullptr) const
     {
+        if (s_deferred) {
+            Queue(signature, [this, signature, offset, data = std::string(data), label] {
+                return static_cast<bool>(Patch(signature, offset, data.c_str(), label));
+            });
+            return Result::State::Queued;
+        }
+
         void *addr = reinterpret_cast<void *>(Scan(signature, offset, label));
         if (!addr) return false;
 
@@ -406,6 +551,18 @@ public:
 
 
 private:
+    static std::map<std::optional<std::string>, M2Hook> & Instances()
+    {
+        static std::map<std::optional<std::string>, M2Hook> instances;
+        return instances;
+    }
+
+    static std::mutex & InstancesMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
     template<size_t N, typename ... Types>
     struct UnpackValue
     {
@@ -491,42 +648,214 @@ private:
         return bytes;
     };
 
-    // CSGOSimple's pattern scan
-    // https://github.com/OneshotGH/CSGOSimple-master/blob/master/CSGOSimple/helpers/utils.cpp
-    static unsigned char *PatternScanBuffer(void *buffer, size_t size, const char *signature)
-    {
-        auto patternBytes = PatternToByte(signature);
-        auto scanBytes = reinterpret_cast<unsigned char *>(buffer);
 
-        auto s = patternBytes.size();
-        auto d = patternBytes.data();
+    static size_t ModuleSize(void *module)
+    {
+        auto dosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(module);
+        auto ntHeaders = reinterpret_cast<PIMAGE_NT_HEADERS>(
+            reinterpret_cast<unsigned char *>(module) + dosHeader->e_lfanew
+        );
+        return ntHeaders->OptionalHeader.SizeOfImage;
+    }
 
-        for (unsigned i = 0; i < size - s; ++i) {
-            bool found = true;
-            for (unsigned j = 0; j < s; ++j) {
-                if (scanBytes[i + j] != d[j] && d[j] != -1) {
-                    found = false;
-                    break;
-                }
+    // Section table of the module, empty if its headers couldn't be read.
+    const std::vector<M2PE::Section> & ModuleImage() const
+    {
+        std::lock_guard lock(m_mutex);
+        if (!m_image) {
+            auto image = M2PE::Parse(m_module, ModuleSize(m_module));
+            m_image = image ? image->Sections() : std::vector<M2PE::Section> {};
+            if (image) {
+                m_codeRanges = image->CodeRanges();
+                m_dataRanges = image->DataRanges();
             }
-            if (found) {
-                return &scanBytes[i];
+        }
+        return *m_image;
+    }
+
+    std::vector<M2PE::Range> ModuleRanges(M2Signature::Region region) const
+    {
+        std::lock_guard lock(m_mutex);
+        ModuleImage();
+        auto & ranges = region == M2Signature::Region::Code ? m_codeRanges : m_dataRanges;
+        if (ranges.empty()) return { { 0, ModuleSize(m_module) } };
+        return ranges;
+    }
+
+    // Looks in the sections for the signature's region first, and only falls
+    // back to the whole image when nothing matched there.
+    unsigned char *PatternScan(const M2Signature & signature) const
+    {
+        auto base = reinterpret_cast<unsigned char *>(m_module);
+        auto ranges = ModuleRanges(signature.Area());
+        for (auto & [begin, end] : ranges) {
+            if (auto result = signature.Find(base + begin, end - begin)) return result;
+        }
+
+        size_t size = ModuleSize(m_module);
+        if (ranges.size() == 1 && ranges[0].first == 0 && ranges[0].second == size) return nullptr;
+        return signature.Find(base, size);
+    }
+
+    // Runs the selected requests over each range in address order, the first
+    // range a request matches in wins. Results are offsets from the module.
+    void FindAll(std::vector<M2Scan::Request> & requests, const std::vector<size_t> & indices, const std::vector<M2PE::Range> & ranges) const
+    {
+        auto base = reinterpret_cast<unsigned char *>(m_module);
+
+        std::vector<size_t> remaining = indices;
+        for (auto & [begin, end] : ranges) {
+            if (remaining.empty()) break;
+
+            std::vector<M2Scan::Request> batch;
+            for (auto i : remaining) batch.push_back(requests[i]);
+            M2Scan::FindAll(base + begin, end - begin, batch);
+
+            std::vector<size_t> next;
+            for (size_t j = 0; j < remaining.size(); ++j) {
+                if (batch[j].result == M2Scan::npos) next.push_back(remaining[j]);
+                else requests[remaining[j]].result = begin + batch[j].result;
             }
+            remaining = std::move(next);
+        }
+    }
+
+    // Answers from prefetched results while they still match, since a patch
+    // applied in between may have rewritten the bytes, else scans again.
+    // Held over the scan, so a signature looked for from two threads at once
+    // is only scanned for once.
+    unsigned char *PatternLookup(const M2Signature & signature, bool cached = true) const
+    {
+        if (!signature.Valid()) return nullptr;
+
+        std::lock_guard lock(m_mutex);
+
+        auto it = m_signatures.find(signature.Hash());
+        if (it != m_signatures.end()) {
+            if (!it->second) return nullptr;
+            if (signature.Match(it->second)) return it->second;
+            m_signatures.erase(it);
+        }
+
+        if (!cached) return PatternScan(signature);
+
+        if (auto result = CacheLookup(signature)) {
+            SaveLate();
+            return result;
+        }
+
+        auto base = reinterpret_cast<unsigned char *>(m_module);
+        auto result = PatternScan(signature);
+        if (result) {
+            Cache().Store(ModuleIdentity(), signature.Hash(), result - base);
+            SaveLate();
+        }
+        return result;
+    }
+
+    // Buffers longer than a signature holds are looked for as they are, over
+    // the whole of `buffer`, and aren't cached.
+    static unsigned char *FindBytes(const void *data, size_t size, const void *buffer, size_t length)
+    {
+        auto bytes = static_cast<const unsigned char *>(data);
+        std::vector<int> pattern(bytes, bytes + size);
+        return M2Scan::Find(buffer, length, pattern.data(), pattern.size());
+    }
+
+    static uintptr_t Located(unsigned char *result, std::ptrdiff_t offset, const char *label)
+    {
+        if (!result) {
+            if (label) spdlog::warn("{} pattern scan failed.", label);
+            return 0;
+        }
+
+        result += offset;
+        if (label) spdlog::info("{} is {}.", label, fmt::ptr(result));
+        return (uintptr_t) result;
+    }
+
+    // Only trusts a cached RVA if the signature still matches there.
+    unsigned char *CacheLookup(const M2Signature & signature) const
+    {
+        auto & cache = Cache();
+        if (!cache.Enabled()) return nullptr;
+
+        const auto & module = ModuleIdentity();
+        auto rva = cache.Find(module, signature.Hash());
+        if (!rva) return nullptr;
+
+        auto base = reinterpret_cast<unsigned char *>(m_module);
+        if (*rva + signature.Length() <= module.size && signature.Match(base + *rva)) {
+            return base + *rva;
         }
+
+        cache.Erase(module, signature.Hash());
         return nullptr;
     }
 
-    static unsigned char *PatternScan(void *module, const char *signature)
+    const M2ScanCache::Module & ModuleIdentity() const
     {
-        auto dosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(module);
-        auto ntHeaders = reinterpret_cast<PIMAGE_NT_HEADERS>(
-            reinterpret_cast<unsigned char *>(module) + dosHeader->e_lfanew
-        );
-        auto sizeOfImage = ntHeaders->OptionalHeader.SizeOfImage;
-        return PatternScanBuffer(module, sizeOfImage, signature);
+        std::lock_guard lock(m_mutex);
+        if (!m_identity) {
+            m_identity = M2ScanCache::Module {
+                ModulePath(),
+                ModuleTimestamp(),
+                static_cast<uint32_t>(ModuleSize(m_module))
+            };
+        }
+        return *m_identity;
+    }
+
+    static M2ScanCache & Cache()
+    {
+        static M2ScanCache cache;
+        return cache;
     }
 
+    static void SaveCache()
+    {
+        if (!Cache().Save()) spdlog::warn("Signature cache couldn't be saved.");
+    }
+
+    // Commit() saves what loading found. What's found past it is saved once
+    // more, the first time anything changes, and after that only in memory
+    // until the next launch finds it again.
+    static void SaveLate()
+    {
+        if (!s_committed || !Cache().Dirty() || s_savedLate.exchange(true)) return;
+        SaveCache();
+    }
+
+    struct Deferred
+    {
+        M2Signature signature;
+        std::function<bool()> apply;
+        bool otherwise;
+    };
+
+    void Queue(const M2Signature & signature, std::function<bool()> apply) const
+    {
+        std::lock_guard lock(m_mutex);
+        m_deferred.push_back({ signature, std::move(apply), m_otherwise });
+        m_otherwise = false;
+    }
+
+    static inline std::atomic<bool> s_deferred = false;
+    static inline std::atomic<bool> s_committed = false;
+    static inline std::atomic<bool> s_savedLate = false;
+
     HMODULE m_module;
+    // Guards what's worked out on demand below, Scan is called from the
+    // game's threads once hooks are in. Hooks themselves are only added
+    // from the thread loading the fix.
+    mutable std::recursive_mutex m_mutex;
+    mutable std::map<uint64_t, unsigned char *> m_signatures;
+    mutable std::vector<Deferred> m_deferred;
+    mutable bool m_otherwise = false;
+    mutable std::optional<M2ScanCache::Module> m_identity;
+    mutable std::optional<std::vector<M2PE::Section>> m_image;
+    mutable std::vector<M2PE::Range> m_codeRanges;
+    mutable std::vector<M2PE::Range> m_dataRanges;
     std::map<void *, safetyhook::InlineHook> m_hooks;
     std::map<void *, safetyhook::MidHook>    m_midHooks;
     union {
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// An open addressing table keyed by the address of an interned object, such
+// as the VM's SQStrings, so a lookup is a linear probe from the key's own
+// hash comparing pointers, and never the strings. Keys aren't owned, whoever
+// fills the table keeps them alive for as long as it's used.
+template <typename Key, typename Value>
+class M2InternTable
+{
+public:
+    // Empties the table, sized so `count` keys fill no more than half of it
+    // and a probe always ends at an empty slot.
+    void Reset(size_t count)
+    {
+        size_t capacity = 16;
+        while (capacity < count * 2) capacity *= 2;
+        m_slots.assign(capacity, Slot {});
+        m_mask = capacity - 1;
+        m_size = 0;
+    }
+
+    // The value for `key`, added as a Value {} the first time. No more keys
+    // than were given to Reset() may be added.
+    Value &Insert(const Key *key, size_t hash)
+    {
+        for (size_t i = hash & m_mask;; i = (i + 1) & m_mask) {
+            auto &slot = m_slots[i];
+            if (slot.key == key) return slot.value;
+            if (!slot.key) {
+                slot.key = key;
+                ++m_size;
+                return slot.value;
+            }
+        }
+    }
+
+    const Value *Find(const Key *key, size_t hash) const
+    {
+        if (!key || m_slots.empty()) return nullptr;
+
+        for (size_t i = hash & m_mask;; i = (i + 1) & m_mask) {
+            auto &slot = m_slots[i];
+            if (slot.key == key) return &slot.value;
+            if (!slot.key) return nullptr;
+        }
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    size_t Capacity() const
+    {
+        return m_slots.size();
+    }
+
+private:
+    struct Slot
+    {
+        const Key *key = nullptr;
+        Value value = {};
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_mask = 0;
+    size_t m_size = 0;
+};
+
+// Call & return hooks by interned name, for SQDispatch. The first hook
+// listed for a name wins, as with a lookup down the lists in order.
+template <typename Key, typename Function>
+class M2HookTable
+{
+public:
+    struct Entry
+    {
+        Function call = nullptr;
+        Function ret = nullptr;
+        // The hooks read the hooked function's own frame, so they can only
+        // run from inside its call/return events.
+        bool scoped = false;
+    };
+
+    using Table = std::vector<std::pair<std::string, Function>>;
+
+    // `intern(name)` gives the name's interned key and its hash, as a pair.
+    template <typename Intern>
+    void Build(const Table &calls, const Table &returns, const std::vector<std::string> &scoped, Intern &&intern)
+    {
+        m_entries.Reset(calls.size() + returns.size() + scoped.size());
+
+        auto insert = [&](const std::string &name) -> Entry & {
+            auto [key, hash] = intern(name);
+            return m_entries.Insert(key, hash);
+        };
+        for (auto &[name, func] : calls) {
+            auto &entry = insert(name);
+            if (!entry.call) entry.call = func;
+        }
+        for (auto &[name, func] : returns) {
+            auto &entry = insert(name);
+            if (!entry.ret) entry.ret = func;
+        }
+        for (auto &name : scoped) {
+            insert(name).scoped = true;
+        }
+    }
+
+    const Entry *Find(const Key *key, size_t hash) const
+    {
+        return m_entries.Find(key, hash);
+    }
+
+private:
+    M2InternTable<Key, Entry> m_entries;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+// The methods of one script global, each resolved once, misses and all, and
+// kept for as long as the global holds the same object in the same VM, and
+// no one has bumped the generation to have them all looked up again.
+template <typename Handle>
+class M2MethodCache
+{
+public:
+    // Ties the cache to the VM with this shared state & root table. A new
+    // one drops what's cached without releasing it, as it belonged to a VM
+    // that may be gone, and returns true for the key to be made again.
+    bool Bind(const void *state, uint64_t root)
+    {
+        if (m_bound && m_state == state && m_root == root) return false;
+
+        m_bound = true;
+        m_state = state;
+        m_root = root;
+        m_current = false;
+        m_methods.clear();
+        return true;
+    }
+
+    // Whether what's cached is still for the global's object, going by its
+    // type & value, as of `generation`.
+    bool Current(uint64_t type, uint64_t value, unsigned generation) const
+    {
+        return m_current && m_type == type && m_value == value && m_generation == generation;
+    }
+
+    // Lets go of every method through `release`, to start over for the
+    // object given.
+    template <typename Release>
+    void Reset(uint64_t type, uint64_t value, unsigned generation, Release &&release)
+    {
+        for (auto &[name, method] : m_methods) release(method);
+        m_methods.clear();
+
+        m_current = true;
+        m_type = type;
+        m_value = value;
+        m_generation = generation;
+    }
+
+    // The method cached for `name`, or else what `resolve()` gives for it.
+    template <typename Resolve>
+    Handle Find(std::string_view name, Resolve &&resolve)
+    {
+        auto it = m_methods.find(name);
+        if (it != m_methods.end()) return it->second;
+
+        Handle method = resolve();
+        m_methods.emplace(name, method);
+        return method;
+    }
+
+    size_t Size() const
+    {
+        return m_methods.size();
+    }
+
+private:
+    bool m_bound = false;
+    const void *m_state = nullptr;
+    uint64_t m_root = 0;
+
+    bool m_current = false;
+    uint64_t m_type = 0;
+    uint64_t m_value = 0;
+    unsigned m_generation = 0;
+
+    std::map<std::string, Handle, std::less<>> m_methods;
+};
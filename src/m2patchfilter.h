@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Patch filters, kept in a form that's cheap to test against: file name
+// prefixes as a trie, data patterns bucketed by length & digest, and IDs or
+// addresses as sorted, merged ranges. Each is built up as filters are added,
+// so matching never depends on how many there are.
+class M2PatchFilter
+{
+public:
+    void AddFile(std::string_view prefix)
+    {
+        size_t node = 0;
+        for (char c : prefix) {
+            auto & children = m_nodes[node].children;
+            auto it = std::lower_bound(children.begin(), children.end(), c,
+                [](const auto & child, char c) { return child.first < c; });
+            if (it == children.end() || it->first != c) {
+                size_t next = m_nodes.size();
+                it = children.insert(it, { c, next });
+                m_nodes.emplace_back();
+            }
+            node = it->second;
+        }
+        m_nodes[node].terminal = true;
+        m_files = true;
+    }
+
+    void AddData(const std::vector<unsigned char> & data)
+    {
+        if (data.empty()) return;
+        m_patterns.push_back(data);
+        m_digests[data.size()].emplace_back(Digest(data.data(), data.size()), m_patterns.size() - 1);
+    }
+
+    // [first, last], merged into the ranges already added.
+    void AddRange(uint32_t first, uint32_t last)
+    {
+        auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), first,
+            [](const auto & range, uint32_t first) { return range.second < first && first - range.second > 1; });
+        while (it != m_ranges.end() && (last == UINT32_MAX || it->first <= last + 1)) {
+            first = std::min(first, it->first);
+            last = std::max(last, it->second);
+            it = m_ranges.erase(it);
+        }
+        m_ranges.insert(it, { first, last });
+    }
+
+    bool HasFiles() const
+    {
+        return m_files;
+    }
+
+    bool HasData() const
+    {
+        return !m_patterns.empty();
+    }
+
+    bool HasRanges() const
+    {
+        return !m_ranges.empty();
+    }
+
+    // Whether any prefix added starts `name`.
+    bool MatchFile(std::string_view name) const
+    {
+        if (!m_files) return false;
+
+        size_t node = 0;
+        for (char c : name) {
+            if (m_nodes[node].terminal) return true;
+            auto & children = m_nodes[node].children;
+            auto it = std::lower_bound(children.begin(), children.end(), c,
+                [](const auto & child, char c) { return child.first < c; });
+            if (it == children.end() || it->first != c) return false;
+            node = it->second;
+        }
+        return m_nodes[node].terminal;
+    }
+
+    // Whether the `size` bytes `byte(i)` returns equal a pattern added. It
+    // returns a negative value for anything that isn't a byte, and is only
+    // called if a pattern has that length.
+    template<typename Byte>
+    bool MatchData(size_t size, Byte && byte) const
+    {
+        auto bucket = m_digests.find(size);
+        if (bucket == m_digests.end()) return false;
+
+        uint64_t digest = m_iBasis;
+        for (size_t i = 0; i < size; ++i) {
+            int value = byte(i);
+            if (value < 0 || value > 0xFF) return false;
+            digest = Feed(digest, static_cast<unsigned char>(value));
+        }
+
+        for (auto & [hash, index] : bucket->second) {
+            if (hash != digest) continue;
+
+            auto & pattern = m_patterns[index];
+            bool same = true;
+            for (size_t i = 0; i < size && same; ++i) same = byte(i) == pattern[i];
+            if (same) return true;
+        }
+        return false;
+    }
+
+    bool MatchRange(uint32_t value) const
+    {
+        auto it = std::upper_bound(m_ranges.begin(), m_ranges.end(), value,
+            [](uint32_t value, const auto & range) { return value < range.first; });
+        if (it == m_ranges.begin()) return false;
+        return value <= std::prev(it)->second;
+    }
+
+private:
+    static constexpr uint64_t m_iBasis = 0xCBF29CE484222325ull;
+
+    // FNV-1a, as for signatures.
+    static uint64_t Feed(uint64_t hash, unsigned char byte)
+    {
+        return (hash ^ byte) * 0x100000001B3ull;
+    }
+
+    static uint64_t Digest(const unsigned char * data, size_t size)
+    {
+        uint64_t hash = m_iBasis;
+        for (size_t i = 0; i < size; ++i) hash = Feed(hash, data[i]);
+        return hash;
+    }
+
+    struct Node
+    {
+        std::vector<std::pair<char, size_t>> children;
+        bool terminal = false;
+    };
+
+    std::vector<Node> m_nodes = { Node {} };
+    bool m_files = false;
+
+    std::vector<std::vector<unsigned char>> m_patterns;
+    std::unordered_map<size_t, std::vector<std::pair<uint64_t, size_t>>> m_digests;
+
+    std::vector<std::pair<uint32_t, uint32_t>> m_ranges;
+};
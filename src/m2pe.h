@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal PE32/PE32+ header reader, enough to tell code from data.
+// Works on a module as loaded (sections at their RVA) or as a file on disk
+// (sections at their raw offset), without relying on Windows headers.
+class M2PE
+{
+public:
+    enum class Layout
+    {
+        Image,
+        File,
+    };
+
+    struct Section
+    {
+        std::string name;
+        uint32_t address;       // RVA
+        uint32_t virtualSize;
+        uint32_t rawOffset;
+        uint32_t rawSize;
+        uint32_t characteristics;
+
+        bool Executable() const
+        {
+            return characteristics & (m_iCode | m_iExecute);
+        }
+
+        bool Readable() const
+        {
+            return characteristics & m_iRead;
+        }
+
+        // Initialised, readable and not code, where strings & tables live.
+        bool Data() const
+        {
+            if (Executable() || !Readable()) return false;
+            return characteristics & m_iInitialized;
+        }
+    };
+
+    // A section as a [begin, end) byte range of the parsed buffer.
+    using Range = std::pair<size_t, size_t>;
+
+    static std::optional<M2PE> Parse(const void *data, size_t size, Layout layout = Layout::Image)
+    {
+        auto bytes = static_cast<const unsigned char *>(data);
+        if (!data || size < 0x40) return std::nullopt;
+        if (Read<uint16_t>(bytes, 0) != 0x5A4D) return std::nullopt; // MZ
+
+        size_t nt = Read<uint32_t>(bytes, 0x3C);
+        if (nt > size || size - nt < 0x18) return std::nullopt;
+        if (Read<uint32_t>(bytes, nt) != 0x00004550) return std::nullopt; // PE\0\0
+
+        M2PE pe;
+        pe.m_layout = layout;
+        pe.m_size = size;
+
+        size_t file = nt + 4;
+        uint16_t sections = Read<uint16_t>(bytes, file + 2);
+        pe.m_timestamp = Read<uint32_t>(bytes, file + 4);
+        uint16_t optionalSize = Read<uint16_t>(bytes, file + 16);
+
+        size_t optional = file + 20;
+        if (optionalSize < 0x40 || size - optional < optionalSize) return std::nullopt;
+
+        uint16_t magic = Read<uint16_t>(bytes, optional);
+        if (magic == 0x10B) pe.m_64 = false;
+        else if (magic == 0x20B) pe.m_64 = true;
+        else return std::nullopt;
+        pe.m_sizeOfImage = Read<uint32_t>(bytes, optional + 56);
+
+        size_t table = optional + optionalSize;
+        if (size - table < static_cast<size_t>(sections) * 40) return std::nullopt;
+
+        for (uint16_t i = 0; i < sections; ++i) {
+            size_t header = table + i * 40;
+
+            char name[9] = {};
+            std::memcpy(name, bytes + header, 8);
+
+            pe.m_sections.push_back({
+                name,
+                Read<uint32_t>(bytes, header + 12),
+                Read<uint32_t>(bytes, header + 8),
+                Read<uint32_t>(bytes, header + 20),
+                Read<uint32_t>(bytes, header + 16),
+                Read<uint32_t>(bytes, header + 36),
+            });
+        }
+        return pe;
+    }
+
+    bool Is64() const
+    {
+        return m_64;
+    }
+
+    uint32_t Timestamp() const
+    {
+        return m_timestamp;
+    }
+
+    uint32_t SizeOfImage() const
+    {
+        return m_sizeOfImage;
+    }
+
+    const std::vector<Section> & Sections() const
+    {
+        return m_sections;
+    }
+
+    // Where a section's bytes are in the parsed buffer, clamped to it.
+    std::optional<Range> Locate(const Section & section) const
+    {
+        size_t begin, length;
+        if (m_layout == Layout::Image) {
+            begin = section.address;
+            length = section.virtualSize ? section.virtualSize : section.rawSize;
+        }
+        else {
+            begin = section.rawOffset;
+            length = section.rawSize;
+        }
+
+        if (begin >= m_size || length == 0) return std::nullopt;
+        return Range { begin, begin + std::min(length, m_size - begin) };
+    }
+
+    // Sorted, merged ranges of every executable section.
+    std::vector<Range> CodeRanges() const
+    {
+        return Ranges([](const Section & section) { return section.Executable(); });
+    }
+
+    // Sorted, merged ranges of every readable data section.
+    std::vector<Range> DataRanges() const
+    {
+        return Ranges([](const Section & section) { return section.Data(); });
+    }
+
+private:
+    static constexpr uint32_t m_iCode        = 0x00000020; // IMAGE_SCN_CNT_CODE
+    static constexpr uint32_t m_iInitialized = 0x00000040; // IMAGE_SCN_CNT_INITIALIZED_DATA
+    static constexpr uint32_t m_iExecute     = 0x20000000; // IMAGE_SCN_MEM_EXECUTE
+    static constexpr uint32_t m_iRead        = 0x40000000; // IMAGE_SCN_MEM_READ
+
+    template<typename T>
+    static T Read(const unsigned char *bytes, size_t offset)
+    {
+        T value = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            value |= static_cast<T>(static_cast<T>(bytes[offset + i]) << (i * 8));
+        }
+        return value;
+    }
+
+    template<typename Predicate>
+    std::vector<Range> Ranges(Predicate && predicate) const
+    {
+        std::vector<Range> ranges;
+        for (auto & section : m_sections) {
+            if (!predicate(section)) continue;
+            if (auto range = Locate(section)) ranges.push_back(*range);
+        }
+
+        std::sort(ranges.begin(), ranges.end());
+        std::vector<Range> merged;
+        for (auto & range : ranges) {
+            if (!merged.empty() && range.first <= merged.back().second) {
+                merged.back().second = std::max(merged.back().second, range.second);
+                continue;
+            }
+            merged.push_back(range);
+        }
+        return merged;
+    }
+
+    Layout m_layout = Layout::Image;
+    size_t m_size = 0;
+    bool m_64 = false;
+    uint32_t m_timestamp = 0;
+    uint32_t m_sizeOfImage = 0;
+    std::vector<Section> m_sections;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "m2/psx.h"
+
+// The PSX machine's DRAM at the offsets GetRamValue/SetRamValue take, read
+// and written straight through MemoryDRAM where it can be, or else a value
+// at a time through the accessors given.
+//
+// Straight writes don't go through the script's SetRamValue, so neither the
+// native it ends in nor SQNative_setRamValue sees them: they're never taken
+// for one of the game's RAM patches, filtered by PatchesDisableRAM, or step
+// M2RamPatches on through a patch being written. That's what the fix's own
+// writes (Ketchup's mapped CD-ROM writes, MGS1's loader name) want. Anything
+// that should be treated as the game's own has to call SetRamValue instead.
+class M2Ram
+{
+public:
+    static constexpr unsigned int Size = 0x200000;
+
+    // DRAM behind [address, address + size), or null if the machine isn't
+    // running or the range isn't all inside it. Takes the script's integers
+    // as they are, so a negative or over 32-bit one isn't truncated into range.
+    template <typename Address>
+    static unsigned char *Resolve(const M2_EmuPSX *psx, Address address, size_t size)
+    {
+        if (!psx || !psx->MemoryDRAM) return nullptr;
+        if constexpr (std::is_signed_v<Address>) {
+            if (address < 0) return nullptr;
+        }
+        auto offset = static_cast<std::make_unsigned_t<Address>>(address);
+        if (offset > UINT_MAX) return nullptr;
+        if (offset > Size || size > Size - offset) return nullptr;
+        return static_cast<unsigned char *>(psx->MemoryDRAM) + offset;
+    }
+
+    // `size` bytes of `data` to `address`, or through `set(bits, address, value)`
+    // 32, then 16, then 8 bits at a time.
+    template <typename Address, typename Set>
+    static void Write(const M2_EmuPSX *psx, Address address, const void *data, size_t size, Set &&set)
+    {
+        if (auto ram = Resolve(psx, address, size)) {
+            std::memcpy(ram, data, size);
+            return;
+        }
+
+        auto bytes = static_cast<const unsigned char *>(data);
+        while (size != 0) {
+            size_t width = Width(size);
+            uint32_t value = 0;
+            std::memcpy(&value, bytes, width);
+            set(static_cast<int>(width * CHAR_BIT), address, value);
+            size -= width; bytes += width; address += static_cast<Address>(width);
+        }
+    }
+
+    // `size` bytes at `address` into `data`, or through `get(bits, address)`
+    // as Write() does.
+    template <typename Address, typename Get>
+    static void Read(const M2_EmuPSX *psx, void *data, Address address, size_t size, Get &&get)
+    {
+        if (auto ram = Resolve(psx, address, size)) {
+            std::memcpy(data, ram, size);
+            return;
+        }
+
+        auto bytes = static_cast<unsigned char *>(data);
+        while (size != 0) {
+            size_t width = Width(size);
+            auto value = static_cast<uint32_t>(get(static_cast<int>(width * CHAR_BIT), address));
+            std::memcpy(bytes, &value, width);
+            size -= width; bytes += width; address += static_cast<Address>(width);
+        }
+    }
+
+    // memcmp of the bytes at `address` against `data`.
+    template <typename Address, typename Get>
+    static int Compare(const M2_EmuPSX *psx, Address address, const void *data, size_t size, Get &&get)
+    {
+        if (auto ram = Resolve(psx, address, size)) {
+            return std::memcmp(ram, data, size);
+        }
+
+        std::vector<unsigned char> buffer(size);
+        Read(psx, buffer.data(), address, size, get);
+        return std::memcmp(buffer.data(), data, size);
+    }
+
+private:
+    static size_t Width(size_t size)
+    {
+        if (size >= sizeof(uint32_t)) return sizeof(uint32_t);
+        if (size >= sizeof(uint16_t)) return sizeof(uint16_t);
+        return sizeof(uint8_t);
+    }
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The RAM patches the game writes a value at a time, indexed by the offset
+// each starts at, and the one being written followed through its values.
+class M2RamPatches
+{
+public:
+    // Where a write falls: the patch's start & length, and which of its
+    // values it is.
+    struct Write
+    {
+        uint32_t address;
+        uint32_t length;
+        uint32_t index;
+    };
+
+    void Clear()
+    {
+        m_index.clear();
+        m_indexed = false;
+    }
+
+    void Add(uint32_t offset, uint32_t length)
+    {
+        m_index.emplace_back(offset, length);
+    }
+
+    // Sorts what was added. The first added wins where several start at the
+    // same offset, as with a scan in order.
+    void Finish()
+    {
+        std::stable_sort(m_index.begin(), m_index.end(),
+            [](const auto & a, const auto & b) { return a.first < b.first; });
+        m_indexed = true;
+    }
+
+    bool Indexed() const
+    {
+        return m_indexed;
+    }
+
+    size_t Size() const
+    {
+        return m_index.size();
+    }
+
+    // A write to `offset` starts a patch there, or else carries on the one
+    // already started. False for writes outside of any.
+    bool Next(uint32_t offset, Write & write)
+    {
+        if (!m_active) {
+            auto patch = std::lower_bound(m_index.begin(), m_index.end(), offset,
+                [](const auto & patch, uint32_t offset) { return patch.first < offset; });
+            if (patch == m_index.end() || patch->first != offset) return false;
+
+            m_current = { patch->first, patch->second, 0 };
+            m_active = true;
+        }
+
+        write = m_current;
+        if (m_current.length != 0 && ++m_current.index == m_current.length) m_active = false;
+        return true;
+    }
+
+private:
+    std::vector<std::pair<uint32_t, uint32_t>> m_index;
+    bool m_indexed = false;
+
+    Write m_current = {};
+    bool m_active = false;
+};
@@ -0,0 +1,141 @@
+#include "m2readahead.h"
+#include "spdlog.h"
+
+#include <algorithm>
+#include <cstring>
+
+// The reader is called from both the caller's thread and the worker.
+M2ReadAhead::M2ReadAhead(Reader reader, size_t capacity, uint32_t lookahead)
+    : m_reader(std::move(reader)),
+      m_capacity(std::max<size_t>(capacity, static_cast<size_t>(lookahead) + 1)),
+      m_lookahead(lookahead)
+{
+    m_thread = std::thread(&M2ReadAhead::Worker, this);
+}
+
+M2ReadAhead::~M2ReadAhead()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_queued.notify_all();
+    m_thread.join();
+
+    LogStats();
+}
+
+bool M2ReadAhead::Read(uint32_t lba, unsigned char * sector)
+{
+    std::unique_lock lock(m_mutex);
+
+    m_streak = lba == m_next ? m_streak + 1 : 0;
+    m_next = lba + 1;
+    if (!m_streak) m_queue.clear();
+
+    if (m_lookahead && m_streak + 1 >= m_iStreak) {
+        for (uint32_t i = 1; i <= m_lookahead && lba + i > lba; ++i) {
+            uint32_t ahead = lba + i;
+            if (m_entries.count(ahead) || std::find(m_queue.begin(), m_queue.end(), ahead) != m_queue.end()) continue;
+            m_queue.push_back(ahead);
+        }
+        m_queued.notify_one();
+    }
+
+    auto it = m_entries.find(lba);
+    if (it != m_entries.end() && !it->second.ready) {
+        m_counters.waits++;
+        m_ready.wait(lock, [&] {
+            it = m_entries.find(lba);
+            return it == m_entries.end() || it->second.ready;
+        });
+    }
+    if (it != m_entries.end()) {
+        m_counters.hits++;
+        std::memcpy(sector, it->second.data.get(), SectorSize);
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+        return true;
+    }
+
+    // Read here and now, so the worker mustn't start on it as well.
+    m_counters.misses++;
+    m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), lba), m_queue.end());
+    lock.unlock();
+
+    auto data = std::make_unique<unsigned char[]>(SectorSize);
+    if (!m_reader(lba, data.get())) return false;
+    std::memcpy(sector, data.get(), SectorSize);
+
+    lock.lock();
+    if (m_entries.count(lba)) return true;
+
+    Evict();
+    m_lru.push_front(lba);
+    auto & entry = m_entries[lba];
+    entry.data = std::move(data);
+    entry.lru = m_lru.begin();
+    entry.ready = true;
+    return true;
+}
+
+M2ReadAhead::Counters M2ReadAhead::Stats() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_counters;
+}
+
+void M2ReadAhead::LogStats() const
+{
+    auto counters = Stats();
+    spdlog::info("[CD-ROM] Read-ahead: {} hits ({} waited on), {} misses, {} sectors read ahead.",
+        counters.hits, counters.waits, counters.misses, counters.prefetched);
+}
+
+void M2ReadAhead::Worker()
+{
+    std::unique_lock lock(m_mutex);
+    for (;;) {
+        m_queued.wait(lock, [&] { return m_stop || !m_queue.empty(); });
+        if (m_stop) return;
+
+        uint32_t lba = m_queue.front();
+        m_queue.pop_front();
+        if (m_entries.count(lba)) continue;
+
+        // In the cache before it's read, so a read of it waits here rather
+        // than reading it again.
+        Evict();
+        m_lru.push_front(lba);
+        auto & entry = m_entries[lba];
+        entry.data = std::make_unique<unsigned char[]>(SectorSize);
+        entry.lru = m_lru.begin();
+        unsigned char * data = entry.data.get();
+
+        lock.unlock();
+        bool read = m_reader(lba, data);
+        lock.lock();
+
+        auto it = m_entries.find(lba);
+        if (read) {
+            it->second.ready = true;
+            m_counters.prefetched++;
+        } else {
+            m_lru.erase(it->second.lru);
+            m_entries.erase(it);
+        }
+        m_ready.notify_all();
+    }
+}
+
+void M2ReadAhead::Evict()
+{
+    auto it = m_lru.end();
+    while (m_entries.size() >= m_capacity && it != m_lru.begin()) {
+        --it;
+        auto entry = m_entries.find(*it);
+        if (!entry->second.ready) continue;
+
+        m_entries.erase(entry);
+        it = m_lru.erase(it);
+    }
+}
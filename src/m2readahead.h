@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// A bounded LRU of raw 0x930 byte CD-ROM sectors in front of a slow reader.
+// Once reads run sequentially, the sectors after them are read on a worker
+// thread, so a stream of reads finds them waiting rather than stalling on
+// each one. A jump drops whatever was queued but not yet started. Nothing
+// reads through it yet: that takes a hook on DevCDROM's reads, whose layout
+// isn't mapped.
+class M2ReadAhead
+{
+public:
+    static constexpr size_t SectorSize = 0x930;
+
+    using Reader = std::function<bool(uint32_t lba, unsigned char * sector)>;
+
+    struct Counters
+    {
+        uint64_t hits;
+        uint64_t misses;
+        // Hits that had to wait for the worker to finish the sector.
+        uint64_t waits;
+        uint64_t prefetched;
+    };
+
+    M2ReadAhead(Reader reader, size_t capacity, uint32_t lookahead);
+    ~M2ReadAhead();
+
+    M2ReadAhead(const M2ReadAhead &) = delete;
+    M2ReadAhead & operator=(const M2ReadAhead &) = delete;
+
+    bool Read(uint32_t lba, unsigned char * sector);
+
+    Counters Stats() const;
+    void LogStats() const;
+
+private:
+    // Sequential reads it takes before reading ahead.
+    static constexpr uint32_t m_iStreak = 2;
+
+    struct Entry
+    {
+        std::unique_ptr<unsigned char[]> data;
+        std::list<uint32_t>::iterator lru;
+        bool ready = false;
+    };
+
+    void Worker();
+
+    // Makes room for one more, never evicting a sector still being read.
+    void Evict();
+
+    Reader m_reader;
+    size_t m_capacity;
+    uint32_t m_lookahead;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queued;
+    std::condition_variable m_ready;
+
+    std::unordered_map<uint32_t, Entry> m_entries;
+    std::list<uint32_t> m_lru;
+    std::deque<uint32_t> m_queue;
+
+    uint32_t m_next = UINT32_MAX;
+    uint32_t m_streak = 0;
+    Counters m_counters = {};
+    bool m_stop = false;
+
+    std::thread m_thread;
+};
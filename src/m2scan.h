@@ -0,0 +1,301 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#define M2SCAN_TARGET_AVX2
+#else
+#define M2SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+class M2Scan
+{
+public:
+    static constexpr size_t npos = SIZE_MAX;
+
+    struct Request
+    {
+        const int *pattern;
+        size_t length;
+        // Offset of the first match from the start of the buffer, or `npos`.
+        size_t result = npos;
+        // Precomputed Gram() of the pattern, or `npos` to work it out here.
+        size_t gram = npos;
+    };
+
+    // Pattern bytes are 0x00 - 0xFF, or -1 for a `??` wildcard.
+    static unsigned char *Find(const void *buffer, size_t size, const int *pattern, size_t length)
+    {
+        auto [first, second] = Anchors(pattern, length);
+        return Find(buffer, size, pattern, length, first, second);
+    }
+
+    // As above, with the anchors from Anchors() already worked out.
+    static unsigned char *Find(const void *buffer, size_t size, const int *pattern, size_t length, size_t first, size_t second)
+    {
+        auto scanBytes = reinterpret_cast<const unsigned char *>(buffer);
+        if (!buffer || length == 0 || size < length) return nullptr;
+
+        if (first == length) {
+            // Nothing but wildcards, anything matches.
+            return const_cast<unsigned char *>(scanBytes);
+        }
+        if (second == length) second = first;
+
+        size_t last = size - length;
+        size_t i = 0;
+
+        if (HasAVX2()) {
+            i = FindAVX2(scanBytes, last, pattern, length, first, second);
+        } else {
+            i = FindSSE2(scanBytes, last, pattern, length, first, second);
+        }
+        if (i <= last) return const_cast<unsigned char *>(scanBytes + i);
+
+        return nullptr;
+    }
+
+    // Resolves many patterns in a single pass over the buffer.
+    // Each pattern is keyed on its rarest pair of adjacent fixed bytes, the
+    // pass looks every byte pair up in a 64K-bit filter and only runs a full
+    // compare on a hit. The buffer is split into chunks across a few threads.
+    static void FindAll(const void *buffer, size_t size, std::vector<Request> &requests)
+    {
+        auto data = reinterpret_cast<const unsigned char *>(buffer);
+
+        std::vector<std::pair<unsigned, size_t>> grams;
+        std::vector<size_t> anchors(requests.size(), 0);
+        for (size_t i = 0; i < requests.size(); ++i) {
+            auto & request = requests[i];
+            request.result = npos;
+            if (!buffer || request.length == 0 || size < request.length) continue;
+
+            size_t at = request.gram != npos ? request.gram : Gram(request.pattern, request.length);
+            if (at == request.length) {
+                // No two adjacent fixed bytes to key on, scan for it alone.
+                auto result = Find(buffer, size, request.pattern, request.length);
+                if (result) request.result = result - data;
+                continue;
+            }
+
+            anchors[i] = at;
+            grams.push_back({ Key(request.pattern[at], request.pattern[at + 1]), i });
+        }
+        if (grams.empty()) return;
+
+        std::ranges::sort(grams);
+        std::vector<uint64_t> filter(0x10000 / 64, 0);
+        for (auto & [key, index] : grams) {
+            filter[key / 64] |= 1ull << (key % 64);
+        }
+
+        auto worker = [&](size_t begin, size_t end, std::vector<size_t> & found) {
+            found.assign(requests.size(), npos);
+            size_t remaining = grams.size();
+            for (size_t p = begin; p < end && remaining; ++p) {
+                unsigned key = Key(data[p], data[p + 1]);
+                if (!(filter[key / 64] & (1ull << (key % 64)))) continue;
+
+                auto range = std::ranges::equal_range(grams, key, {}, &std::pair<unsigned, size_t>::first);
+                for (auto & [_, index] : range) {
+                    auto & request = requests[index];
+                    if (found[index] != npos || p < anchors[index]) continue;
+
+                    size_t start = p - anchors[index];
+                    if (start + request.length > size) continue;
+                    if (!Match(data + start, request.pattern, request.length)) continue;
+
+                    found[index] = start;
+                    --remaining;
+                }
+            }
+        };
+
+        // Key positions run up to the second last byte of the buffer.
+        size_t positions = size - 1;
+        size_t count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 4);
+        count = std::min<size_t>(count, (positions >> 20) + 1);
+        size_t chunk = (positions + count - 1) / count;
+
+        std::vector<std::vector<size_t>> results(count);
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < count; ++i) {
+            size_t begin = i * chunk;
+            size_t end = std::min(positions, begin + chunk);
+            threads.emplace_back(worker, begin, end, std::ref(results[i]));
+        }
+        worker(0, std::min(positions, chunk), results[0]);
+        for (auto & thread : threads) thread.join();
+
+        // Chunks are in address order, the first one to find a pattern wins.
+        for (auto & found : results) {
+            for (size_t i = 0; i < requests.size(); ++i) {
+                if (requests[i].result == npos) requests[i].result = found[i];
+            }
+        }
+    }
+
+    // Picks the two rarest non-wildcard positions of a pattern, rarest first.
+    // Either is `length` when the pattern doesn't have that many fixed bytes.
+    static constexpr std::pair<size_t, size_t> Anchors(const int *pattern, size_t length)
+    {
+        size_t first = length, second = length;
+        for (size_t i = 0; i < length; ++i) {
+            if (pattern[i] < 0) continue;
+            if (first == length || Rank(pattern[i]) < Rank(pattern[first])) {
+                second = first;
+                first = i;
+            }
+            else if (second == length || Rank(pattern[i]) < Rank(pattern[second])) {
+                second = i;
+            }
+        }
+        return { first, second };
+    }
+
+    // Rough frequency of a byte in x86/x64 code & data, lower is rarer.
+    static constexpr unsigned Rank(int byte)
+    {
+        constexpr unsigned char common[] = {
+            0x00, 0xFF, 0x8B, 0x48, 0x89, 0x24, 0xCC, 0x44, 0x4C, 0xE8,
+            0x0F, 0x85, 0x01, 0x83, 0x74, 0x45, 0x8D, 0xC0, 0x75, 0x90,
+            0x08, 0x10, 0x20, 0x04, 0x02, 0x4D, 0x41, 0xC3, 0x84, 0xEB,
+            0x33, 0x5C, 0x49, 0x40, 0x80, 0xC7, 0x03, 0x28, 0x18, 0x30,
+        };
+        for (size_t i = 0; i < std::size(common); ++i) {
+            if (common[i] == static_cast<unsigned char>(byte)) {
+                return static_cast<unsigned>(std::size(common) - i);
+            }
+        }
+        return 0;
+    }
+
+    // Picks the rarest pair of adjacent fixed bytes, or `length` for none.
+    static constexpr size_t Gram(const int *pattern, size_t length)
+    {
+        size_t best = length;
+        for (size_t i = 0; i + 1 < length; ++i) {
+            if (pattern[i] < 0 || pattern[i + 1] < 0) continue;
+            unsigned rank = Rank(pattern[i]) + Rank(pattern[i + 1]);
+            if (best == length || rank < Rank(pattern[best]) + Rank(pattern[best + 1])) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    static bool Match(const unsigned char *data, const int *pattern, size_t length)
+    {
+        for (size_t j = 0; j < length; ++j) {
+            if (pattern[j] >= 0 && data[j] != pattern[j]) return false;
+        }
+        return true;
+    }
+
+private:
+    static unsigned Key(int a, int b)
+    {
+        return static_cast<unsigned char>(a) | (static_cast<unsigned char>(b) << 8);
+    }
+
+    static bool HasAVX2()
+    {
+        static const bool avx2 = [] {
+#if defined(_MSC_VER)
+            int info[4] = {};
+            __cpuid(info, 0);
+            if (info[0] < 7) return false;
+
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            bool avx = (info[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx) return false;
+            if ((_xgetbv(0) & 0x6) != 0x6) return false;
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }();
+        return avx2;
+    }
+
+    static unsigned TrailingZeros(unsigned mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    // Both finders test 16/32 candidate start positions at once against the two
+    // anchor bytes, and only fall back to a full compare where both agree.
+    // They return the first matching start position, or `last + 1` for none.
+    static size_t FindSSE2(const unsigned char *data, size_t last, const int *pattern, size_t length, size_t first, size_t second)
+    {
+        const __m128i a = _mm_set1_epi8(static_cast<char>(pattern[first]));
+        const __m128i b = _mm_set1_epi8(static_cast<char>(pattern[second]));
+
+        size_t i = 0;
+        for (; i + 16 <= last + 1; i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + first));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + second));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(x, a), _mm_cmpeq_epi8(y, b))
+            ));
+            while (mask) {
+                size_t j = i + TrailingZeros(mask);
+                if (Match(data + j, pattern, length)) return j;
+                mask &= mask - 1;
+            }
+        }
+
+        for (; i <= last; ++i) {
+            if (data[i + first] != pattern[first]) continue;
+            if (Match(data + i, pattern, length)) return i;
+        }
+        return last + 1;
+    }
+
+    M2SCAN_TARGET_AVX2
+    static size_t FindAVX2(const unsigned char *data, size_t last, const int *pattern, size_t length, size_t first, size_t second)
+    {
+        const __m256i a = _mm256_set1_epi8(static_cast<char>(pattern[first]));
+        const __m256i b = _mm256_set1_epi8(static_cast<char>(pattern[second]));
+
+        size_t i = 0;
+        for (; i + 32 <= last + 1; i += 32) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + first));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + second));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(x, a), _mm256_cmpeq_epi8(y, b))
+            ));
+            while (mask) {
+                size_t j = i + TrailingZeros(mask);
+                if (Match(data + j, pattern, length)) return j;
+                mask &= mask - 1;
+            }
+        }
+
+        // Finish the remainder with the narrower path.
+        if (i > last) return last + 1;
+        size_t j = FindSSE2(data + i, last - i, pattern, length, first, second);
+        return i + j;
+    }
+};
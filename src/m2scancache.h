@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+// Remembers where signatures resolved to, per module, across launches.
+// Entries are keyed by module path and invalidated as a whole when the
+// module's TimeDateStamp or SizeOfImage change, signatures by their hash.
+// Callers must still verify a cached RVA against the signature before
+// trusting it. Each signature keeps the last launch it was looked up in, and
+// ones not looked up for a few launches are dropped on save, so patterns
+// built from relocated pointers don't pile up. That's only brought up to date
+// every few launches, so a launch that finds everything where it was has
+// nothing to write. Launches are counted by saves. Safe to use from any thread.
+class M2ScanCache
+{
+public:
+    struct Module
+    {
+        std::string path;
+        uint32_t timestamp;
+        uint32_t size;
+    };
+
+    M2ScanCache() = default;
+
+    explicit M2ScanCache(std::filesystem::path file)
+    {
+        Open(std::move(file));
+    }
+
+    // Starts over from what's saved in `file`, an empty path disables it.
+    void Open(std::filesystem::path file)
+    {
+        std::lock_guard lock(m_mutex);
+        m_file = std::move(file);
+        m_dirty = false;
+        Load();
+    }
+
+    bool Enabled() const
+    {
+        std::lock_guard lock(m_mutex);
+        return !m_file.empty();
+    }
+
+    std::optional<size_t> Find(const Module & module, uint64_t signature)
+    {
+        std::lock_guard lock(m_mutex);
+        auto entry = Entry(module);
+        if (!entry) return std::nullopt;
+
+        auto & signatures = (*entry)["signatures"];
+        auto it = signatures.find(Key(signature));
+        if (it == signatures.end() || !Valid(*it)) return std::nullopt;
+
+        size_t rva = (*it)[0].get<size_t>();
+        if (rva >= module.size) return std::nullopt;
+
+        Touch(*it);
+        return rva;
+    }
+
+    void Store(const Module & module, uint64_t signature, size_t rva)
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_file.empty() || rva >= module.size) return;
+
+        auto & entry = m_data["modules"][module.path];
+        if (!Current(entry, module)) {
+            entry = {
+                { "timestamp", module.timestamp },
+                { "size", module.size },
+                { "signatures", nlohmann::json::object() },
+            };
+        }
+
+        auto & value = entry["signatures"][Key(signature)];
+        if (Valid(value) && value[0].get<size_t>() == rva) {
+            Touch(value);
+            return;
+        }
+
+        value = { rva, m_session };
+        m_dirty = true;
+    }
+
+    // Drops an entry that failed verification.
+    void Erase(const Module & module, uint64_t signature)
+    {
+        std::lock_guard lock(m_mutex);
+        auto entry = Entry(module);
+        if (!entry) return;
+        if ((*entry)["signatures"].erase(Key(signature))) m_dirty = true;
+    }
+
+    // Something changed since it was last saved.
+    bool Dirty() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_dirty;
+    }
+
+    // Writes the cache out if anything changed since it was last saved.
+    bool Save()
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_file.empty() || !m_dirty) return true;
+
+        for (auto & entry : m_data["modules"]) {
+            if (!entry.is_object() || !entry.contains("signatures")) continue;
+
+            auto & signatures = entry["signatures"];
+            for (auto i = signatures.begin(); i != signatures.end();) {
+                if (Valid(*i) && (*i)[1].get<uint32_t>() + m_iKeepSessions >= m_session) {
+                    ++i;
+                    continue;
+                }
+                i = signatures.erase(i);
+            }
+        }
+        m_data["session"] = m_session;
+
+        std::error_code ec;
+        std::filesystem::create_directories(m_file.parent_path(), ec);
+
+        // Write aside and swap in, a torn write only ever loses the cache.
+        auto temp = m_file;
+        temp += ".tmp";
+        {
+            std::ofstream file(temp, std::ios::out | std::ios::trunc);
+            if (!file) return false;
+            file << m_data.dump();
+            if (!file) return false;
+        }
+
+        std::filesystem::rename(temp, m_file, ec);
+        if (ec) return false;
+
+        m_dirty = false;
+        return true;
+    }
+
+    static std::string Key(uint64_t hash)
+    {
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string text(16, '0');
+        for (size_t i = 0; i < 16; ++i) {
+            text[15 - i] = digits[(hash >> (i * 4)) & 0xF];
+        }
+        return text;
+    }
+
+private:
+    static constexpr int m_iVersion = 2;
+
+    // Launches a signature is kept for without being looked up, and how old
+    // the launch it was last looked up in gets before that's updated.
+    static constexpr uint32_t m_iKeepSessions = 8;
+    static constexpr uint32_t m_iRefreshSessions = m_iKeepSessions / 2;
+
+    void Load()
+    {
+        m_data = nlohmann::json::object();
+
+        std::ifstream file(m_file);
+        if (file) {
+            auto data = nlohmann::json::parse(file, nullptr, false);
+            if (!data.is_discarded() && data.is_object() &&
+                data.value("version", 0) == m_iVersion &&
+                data.contains("modules") && data["modules"].is_object()) {
+                m_data = std::move(data);
+            }
+        }
+
+        auto session = m_data.find("session");
+        m_session = session != m_data.end() && session->is_number_unsigned() ? session->get<uint32_t>() + 1 : 1;
+
+        m_data["version"] = m_iVersion;
+        if (!m_data.contains("modules")) m_data["modules"] = nlohmann::json::object();
+    }
+
+    // An entry is `[rva, session last looked up in]`.
+    static bool Valid(const nlohmann::json & value)
+    {
+        return value.is_array() && value.size() == 2 &&
+            value[0].is_number_unsigned() && value[1].is_number_unsigned();
+    }
+
+    void Touch(nlohmann::json & value)
+    {
+        uint32_t last = value[1].get<uint32_t>();
+        if (last <= m_session && m_session - last < m_iRefreshSessions) return;
+        value[1] = m_session;
+        m_dirty = true;
+    }
+
+    static bool Current(const nlohmann::json & entry, const Module & module)
+    {
+        if (!entry.is_object()) return false;
+        if (!entry.contains("signatures") || !entry["signatures"].is_object()) return false;
+
+        auto timestamp = entry.find("timestamp");
+        auto size = entry.find("size");
+        if (timestamp == entry.end() || !timestamp->is_number_unsigned()) return false;
+        if (size == entry.end() || !size->is_number_unsigned()) return false;
+
+        return timestamp->get<uint32_t>() == module.timestamp && size->get<uint32_t>() == module.size;
+    }
+
+    nlohmann::json *Entry(const Module & module)
+    {
+        auto & modules = m_data["modules"];
+        auto it = modules.find(module.path);
+        if (it == modules.end() || !Current(*it, module)) return nullptr;
+        return &*it;
+    }
+
+    mutable std::mutex m_mutex;
+    std::filesystem::path m_file;
+    nlohmann::json m_data = nlohmann::json::object();
+    uint32_t m_session = 1;
+    bool m_dirty = false;
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "m2scan.h"
+
+// A byte pattern such as "8B 4C 24 ?? 0F" parsed into bytes & wildcards.
+// String literals convert at compile time, so malformed patterns fail the
+// build and the scan anchors are worked out ahead of time. Patterns only
+// known at runtime go through Parse() / FromBytes() instead.
+class M2Signature
+{
+public:
+    static constexpr size_t Capacity = 96;
+
+    // Which sections of a module a signature is looked for in.
+    enum class Region
+    {
+        Code,
+        Data,
+    };
+
+    template<size_t N>
+    consteval M2Signature(const char (&text)[N])
+    {
+        static_assert(N > 1, "Signature is empty.");
+        if (!Read(std::string_view(text, N - 1))) {
+            throw "Signature is malformed, expected space separated `XX` or `??` bytes.";
+        }
+        if (m_first == m_length) {
+            throw "Signature needs at least one fixed byte.";
+        }
+    }
+
+    // For strings & tables, looked for in data sections rather than code.
+    template<size_t N>
+    static consteval M2Signature Data(const char (&text)[N])
+    {
+        M2Signature signature(text);
+        signature.m_region = Region::Data;
+        signature.Finish();
+        return signature;
+    }
+
+    static constexpr M2Signature Parse(std::string_view text, Region region = Region::Code)
+    {
+        M2Signature signature;
+        signature.m_region = region;
+        if (!signature.Read(text)) signature = {};
+        return signature;
+    }
+
+    // Byte buffers are mostly pointers or values, so default to data. Invalid
+    // for an empty buffer or one longer than Capacity, which M2Hook scans for
+    // without a signature.
+    static M2Signature FromBytes(const void *data, size_t size, Region region = Region::Data)
+    {
+        M2Signature signature;
+        if (size == 0 || size > Capacity) return signature;
+
+        auto bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; ++i) signature.m_pattern[i] = bytes[i];
+        signature.m_length = size;
+        signature.m_region = region;
+        signature.Finish();
+        return signature;
+    }
+
+    constexpr bool Valid() const
+    {
+        return m_length != 0;
+    }
+
+    constexpr const int *Pattern() const
+    {
+        return m_pattern;
+    }
+
+    constexpr size_t Length() const
+    {
+        return m_length;
+    }
+
+    constexpr size_t First() const
+    {
+        return m_first;
+    }
+
+    constexpr size_t Second() const
+    {
+        return m_second;
+    }
+
+    constexpr size_t Gram() const
+    {
+        return m_gram;
+    }
+
+    constexpr Region Area() const
+    {
+        return m_region;
+    }
+
+    // FNV-1a over the canonical `XX ?? XX` text, so a signature hashes the
+    // same whichever way it was built. Data signatures get a `D:` prefix.
+    constexpr uint64_t Hash() const
+    {
+        return m_hash;
+    }
+
+    bool Match(const unsigned char *data) const
+    {
+        return M2Scan::Match(data, m_pattern, m_length);
+    }
+
+    unsigned char *Find(const void *buffer, size_t size) const
+    {
+        if (!Valid()) return nullptr;
+        return M2Scan::Find(buffer, size, m_pattern, m_length, m_first, m_second);
+    }
+
+    M2Scan::Request Request() const
+    {
+        return { m_pattern, m_length, M2Scan::npos, m_gram == m_length ? M2Scan::npos : m_gram };
+    }
+
+private:
+    constexpr M2Signature() = default;
+
+    static constexpr int Digit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+
+    constexpr bool Read(std::string_view text)
+    {
+        size_t i = 0;
+        while (i < text.size()) {
+            if (text[i] == ' ') {
+                ++i;
+                continue;
+            }
+            if (m_length == Capacity) return false;
+
+            if (text[i] == '?') {
+                ++i;
+                if (i < text.size() && text[i] == '?') ++i;
+                m_pattern[m_length++] = -1;
+            }
+            else {
+                int high = Digit(text[i]);
+                int low = i + 1 < text.size() ? Digit(text[i + 1]) : -1;
+                if (high < 0 || low < 0) return false;
+                i += 2;
+                m_pattern[m_length++] = high * 16 + low;
+            }
+
+            if (i < text.size() && text[i] != ' ') return false;
+        }
+        if (m_length == 0) return false;
+
+        Finish();
+        return true;
+    }
+
+    constexpr void Finish()
+    {
+        auto [first, second] = M2Scan::Anchors(m_pattern, m_length);
+        m_first = first;
+        m_second = second == m_length ? first : second;
+        m_gram = M2Scan::Gram(m_pattern, m_length);
+
+        constexpr char digits[] = "0123456789ABCDEF";
+        uint64_t hash = 0xCBF29CE484222325ull;
+        auto feed = [&hash](char c) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 0x100000001B3ull;
+        };
+        if (m_region == Region::Data) {
+            feed('D');
+            feed(':');
+        }
+        for (size_t i = 0; i < m_length; ++i) {
+            if (i) feed(' ');
+            if (m_pattern[i] < 0) {
+                feed('?');
+                feed('?');
+            }
+            else {
+                feed(digits[m_pattern[i] >> 4]);
+                feed(digits[m_pattern[i] & 0xF]);
+            }
+        }
+        m_hash = hash;
+    }
+
+    int m_pattern[Capacity] = {};
+    size_t m_length = 0;
+    size_t m_first = 0;
+    size_t m_second = 0;
+    size_t m_gram = 0;
+    uint64_t m_hash = 0;
+    Region m_region = Region::Code;
+};
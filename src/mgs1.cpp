@@ -76,13 +76,11 @@ void MGS1::SQOnUpdateGadgets()
     if (MGS1_GlobalsPTR != 0 && MGS1_LoaderPTR != 0) {
         SQInteger MGS1_StageNamePTR = MGS1_GlobalsPTR;
 
-        char MGS1_StageName[8] = { 0 };
-        char MGS1_LoaderName[8] = { 0 };
-        SQEmuTask<Squirk::Standard>::RamCopy(MGS1_StageName, MGS1_StageNamePTR, sizeof(MGS1_StageName));
-        SQEmuTask<Squirk::Standard>::RamCopy(MGS1_LoaderName, MGS1_LoaderPTR, sizeof(MGS1_LoaderName));
-
         if (M2Config::bGameStageSelect) {
-            if (strcmp(MGS1_LoaderName, "title") == 0 && strcmp(MGS1_StageName, "select") != 0) {
+            // Compared in place, terminators included.
+            if (SQEmuTask<Squirk::Standard>::RamCompare(MGS1_LoaderPTR, "title", sizeof("title")) == 0 &&
+                SQEmuTask<Squirk::Standard>::RamCompare(MGS1_StageNamePTR, "select", sizeof("select")) != 0) {
+                char MGS1_LoaderName[8] = { 0 };
                 strcpy(MGS1_LoaderName, "select");
                 SQEmuTask<Squirk::Standard>::RamCopy(MGS1_LoaderPTR, MGS1_LoaderName, sizeof(MGS1_LoaderName));
                 spdlog::info("[MGS 1] Set mgs_loader_stage to \"{}\".", MGS1_LoaderName);
@@ -145,6 +145,11 @@ int PSX::R3000_Step(M2_EmuR3000 *cpu, int cycle, unsigned int address)
     return ret;
 }
 
+unsigned char *PSX::Ram(unsigned int address, size_t size)
+{
+    return M2Ram::Resolve(Emulator, address, size);
+}
+
 void PSX::main(M2_EmuR3000 *cpu)
 {
     Emulator = cpu->Bus->Machine;
@@ -2,6 +2,7 @@
 
 #include "m2machine.h"
 #include "m2/psx.h"
+#include "m2ram.h"
 #include "m2hook.h"
 #include "stdafx.h"
 
@@ -27,6 +28,10 @@ public:
 
     static void main(struct M2_EmuR3000 *cpu);
 
+    // Guest DRAM at the same offsets GetRamValue/SetRamValue take, or null
+    // if no machine is running or [address, address + size) is outside it.
+    static unsigned char *Ram(unsigned int address, size_t size);
+
 private:
     static M2_EmuPSX_Module *LoadSystemModule(M2_EmuPSX_Module *mod);
     static M2_EmuPSX_Module *LoadKernelModule(M2_EmuPSX_Module *mod);
@@ -67,6 +72,8 @@ public:
     static inline unsigned int VideoMode = 0;
     static inline M2_EmuPSX *Emulator = nullptr;
 
+    static constexpr unsigned int RamSize = M2Ram::Size;
+
 private:
 
     static std::map<unsigned, PSXFUNCTION> VectorHandlers;
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "stdafx.h"
+#include "m2interntable.h"
+
+// Maps script function names to their call/return hooks by the VM's interned
+// SQString pointer, so a debug hook event costs one probe and no string
+// compares. Names are interned once per shared state, and kept referenced so
+// their pointers stay valid for as long as the table does.
+template <Squirk Q>
+class SQDispatch
+{
+public:
+	using Entry = typename M2HookTable<SQString<Q>, SQFUNCTION<Q>>::Entry;
+	using Table = typename M2HookTable<SQString<Q>, SQFUNCTION<Q>>::Table;
+
+	void Build(HSQUIRRELVM<Q> v, const Table &calls, const Table &returns, const std::vector<std::string> &scoped = {})
+	{
+		m_names.clear();
+		m_table.Build(calls, returns, scoped, [&](const std::string &name) {
+			SQString<Q> *string = SQString<Q>::Create(_ss(v), name.c_str(), name.size());
+			m_names.push_back(SQObjectPtr<Q>(string));
+			return std::pair<const SQString<Q> *, size_t>(string, string->_hash);
+		});
+	}
+
+	const Entry *Find(const SQString<Q> *name) const
+	{
+		if (!name) return nullptr;
+		return m_table.Find(name, name->_hash);
+	}
+
+private:
+	M2HookTable<SQString<Q>, SQFUNCTION<Q>> m_table;
+	std::vector<SQObjectPtr<Q>> m_names;
+};
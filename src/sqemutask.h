@@ -1,7 +1,10 @@
 #pragma once
 
 #include "sqinvoker.h"
+#include "psx.h"
+#include "m2ram.h"
 
+#include <cstring>
 #include <type_traits>
 
 template <Squirk Q>
@@ -69,49 +72,39 @@ public:
 		return SQEmuTask().Invoke<void>(__func__);
 	}
 
+	// Copies straight to/from the PSX machine's DRAM when it's running and
+	// the range is inside it, otherwise a word at a time through the script.
+	// The straight copies bypass SetRamValue and the SQNative_setRamValue
+	// filter, see M2Ram.
 	template <typename Source, typename Destination>
 	static Destination RamCopy(Destination dst, Source src, std::size_t size) {
-		Destination dest = dst;
 		if constexpr (std::is_pointer_v<Source> && std::is_integral_v<Destination>) {
-			const uint8_t * _src = reinterpret_cast<const uint8_t *>(src);
-			while (size >= sizeof(uint32_t)) {
-				const uint32_t * __src = reinterpret_cast<const uint32_t *>(_src);
-				SetRamValue(sizeof(uint32_t) * CHAR_BIT, dst, *__src);
-				size -= sizeof(uint32_t); _src += sizeof(uint32_t); dst += sizeof(uint32_t);
-			}
-			if (size >= sizeof(uint16_t)) {
-				const uint16_t * __src = reinterpret_cast<const uint16_t *>(_src);
-				SetRamValue(sizeof(uint16_t) * CHAR_BIT, dst, *__src);
-				size -= sizeof(uint16_t); _src += sizeof(uint16_t); dst += sizeof(uint16_t);
-			}
-			if (size >= sizeof(uint8_t)) {
-				const uint8_t * __src = reinterpret_cast<const uint8_t *>(_src);
-				SetRamValue(sizeof(uint8_t) * CHAR_BIT, dst, *__src);
-				size -= sizeof(uint8_t); _src += sizeof(uint8_t); dst += sizeof(uint8_t);
-			}
-			return dest;
+			M2Ram::Write(PSX::Emulator, dst, src, size, [](int bits, Destination at, uint32_t value) {
+				SetRamValue(bits, static_cast<SQInteger>(at), value);
+			});
 		}
 		else if constexpr (std::is_pointer_v<Destination> && std::is_integral_v<Source>) {
-			uint8_t * _dst = reinterpret_cast<uint8_t *>(dst);
-			while (size >= sizeof(uint32_t)) {
-				uint32_t * __dst = reinterpret_cast<uint32_t *>(_dst);
-				*__dst = GetRamValue(sizeof(uint32_t) * CHAR_BIT, src);
-				size -= sizeof(uint32_t); src += sizeof(uint32_t); _dst += sizeof(uint32_t);
-			}
-			if (size >= sizeof(uint16_t)) {
-				uint16_t * __dst = reinterpret_cast<uint16_t *>(_dst);
-				*__dst = GetRamValue(sizeof(uint16_t) * CHAR_BIT, src);
-				size -= sizeof(uint16_t); src += sizeof(uint16_t); _dst += sizeof(uint16_t);
-			}
-			if (size >= sizeof(uint8_t)) {
-				uint8_t * __dst = reinterpret_cast<uint8_t *>(_dst);
-				*__dst = GetRamValue(sizeof(uint8_t) * CHAR_BIT, src);
-				size -= sizeof(uint8_t); src += sizeof(uint8_t); _dst += sizeof(uint8_t);
-			}
-			return dest;
+			M2Ram::Read(PSX::Emulator, dst, src, size, [](int bits, Source at) {
+				return GetRamValue(bits, static_cast<SQInteger>(at));
+			});
 		}
 		else static_assert(false);
-		return dest;
+		return dst;
+	}
+
+	// The machine's DRAM behind `address`, if it's a 32-bit address at all, so
+	// a script's out of range SQInteger isn't truncated into DRAM.
+	template <typename Address>
+	static unsigned char *Ram(Address address, std::size_t size) {
+		return M2Ram::Resolve(PSX::Emulator, address, size);
+	}
+
+	// memcmp of guest RAM at `address` against `data`.
+	template <typename Address>
+	static int RamCompare(Address address, const void *data, std::size_t size) {
+		return M2Ram::Compare(PSX::Emulator, address, data, size, [](int bits, Address at) {
+			return GetRamValue(bits, static_cast<SQInteger>(at));
+		});
 	}
 
 };
@@ -11,6 +11,7 @@
 #include "sqsystemdata.h"
 
 #include "m2/epi.h"
+#include "m2debuginfo.h"
 #include "ketchup.h"
 
 template <Squirk Q>
@@ -36,6 +37,15 @@ std::vector<std::pair<std::string, SQFUNCTION<Q>>> SQHook<Q>::ReturnTable = {
     {"constructor",                             SQReturn_constructor},
 };
 
+// Hooks that read the hooked function's own frame, which only the debug hook
+// events can see. Trampolines turn the debug hook on for these calls instead.
+template <Squirk Q>
+std::vector<std::string> SQHook<Q>::FrameTable = {
+    "util_load_script",
+    "util_get_multimonitor_screen_bounds",
+    "constructor",
+};
+
 template <Squirk Q>
 std::vector<std::pair<std::string, SQInteger(*)(HSQUIRRELVM<Q>, HSQOBJECT<Q>)>> SQHook<Q>::ConstructorTable = {
 };
@@ -57,6 +67,8 @@ std::vector<std::pair<const SQChar *, SQFUNCTION<Q>>> SQHook<Q>::NativeTable = {
     {"setDotmatrix",                            SQNative_setDotmatrix},
     {"entryTexturePatch",                       SQNative_entryTexturePatch},
     {"releaseTexturePatch",                     SQNative_releaseTexturePatch},
+    {"printf",                                  SQNative_print},
+    {"print",                                   SQNative_print},
 };
 
 template <Squirk Q>
@@ -67,22 +79,106 @@ void SQHook<Q>::SetHook(HSQUIRRELVM<Q> v)
         sq_rdbg_waitforconnections(DBG);
     }
 
+    if (Trampolined()) {
+        SetTrampolines(v, EnsureFixData(v));
+        return;
+    }
+
     if (sq_isnull(v->_debughook)) {
-        sq_pushregistrytable(v);
-        sq_pushstring(v, _SC("_m2_debug_hook_"), -1);
-        sq_pushuserpointer(v, v);
-        sq_newclosure(v, Hook, 1);
-        sq_newslot(v, -3, false);
-        sq_pop(v, 1);
+        v->_debughook = DebugHook(v);
+    }
+}
 
-        sq_pushregistrytable(v);
-        sq_pushstring(v, _SC("_m2_debug_hook_"), -1);
-        sq_rawget(v, -2);
-        sq_setdebughook(v);
-        sq_pop(v, 1);
+template <Squirk Q>
+SQObjectPtr<Q> SQHook<Q>::DebugHook(HSQUIRRELVM<Q> v)
+{
+    // One hook closure per shared state, kept in the registry.
+    SQTable<Q> *registry = _table(_ss(v)->_registry);
+    SQObjectPtr<Q> key = SQObjectPtr<Q>(SQString<Q>::Create(_ss(v), _SC("_m2_debug_hook_")));
+    SQObjectPtr<Q> hook;
+    if (registry->Get(key, hook)) return hook;
+
+    sq_pushuserpointer(v, v);
+    sq_newclosure(v, Hook, 1);
+    hook = stack_get(v, -1);
+    sq_pop(v, 1);
+
+    registry->NewSlot(key, hook);
+    return hook;
+}
+
+template <Squirk Q>
+bool SQHook<Q>::Settled(HSQUIRRELVM<Q> v, M2FixData<Q> *data)
+{
+    // Whether SetHook has anything left to do.
+    if (M2Config::bDebuggerEnabled && !DBG) return false;
+    if (!Trampolined()) return !sq_isnull(v->_debughook);
+
+    if (!data->hooked || SQResource<Q>::Pending() || ErrorPending(v, data)) return false;
+    return data->dispatch_version == DispatchVersion && !data->trampolines.Stale(v, data->dispatch_version);
+}
+
+template <Squirk Q>
+bool SQHook<Q>::Trampolined()
+{
+    // Tracing & the debugger want to see every event.
+    if (!M2Config::bHookTrampolines || M2Config::bDebuggerEnabled || M2Config::bError) return false;
+    return M2Config::iLevel < 1 && M2Config::iNativeLevel < 1;
+}
+
+template <Squirk Q>
+void SQHook<Q>::SetTrampolines(HSQUIRRELVM<Q> v, M2FixData<Q> *data)
+{
+    // The parts of the debug hook that don't need its events.
+    if (!data->hooked) {
+        data->hooked = true;
+        Main(v);
+    }
+    if (ErrorPending(v, data)) {
+        Sqrat::Error<Q>::Clear(v);
+    }
+    if (SQResource<Q>::Pending()) {
+        SQResource<Q>::GetInstance().Poll();
+    }
+
+    EnsureDispatch(v, data);
+    if (!data->trampolines.Stale(v, data->dispatch_version)) return;
+
+    // Only the classes something wants construction of, the instance table
+    // is only kept while the debug hook sees every constructor anyway.
+    std::vector<std::string> constructors;
+    for (auto & [name, func] : ConstructorTable) constructors.push_back(name);
+
+    size_t wrapped = data->trampolines.Sync(v, data->dispatch, data->dispatch_version, DebugHook(v), constructors);
+    if (wrapped) {
+        spdlog::info("[SQ] SQVM {} wrapped {} hooked closures.", fmt::ptr(v), wrapped);
+        // Methods may have been wrapped under cached handles.
+        SQInvoker<Q>::Invalidate();
     }
 }
 
+template <Squirk Q>
+bool SQHook<Q>::DebugInfo(const std::vector<std::string> &scripts)
+{
+    // Line ops only raise line events, which only tracing & the debugger use.
+    if (!M2Config::bDebuggerEnabled && M2Config::iLevel < 1) return false;
+
+    return M2DebugInfo::Matches(M2Config::sDebugInfo, scripts);
+}
+
+template <Squirk Q>
+void SQHook<Q>::EnsureDispatch(HSQUIRRELVM<Q> v, M2FixData<Q> *data)
+{
+    if (data->dispatch_version == DispatchVersion) return;
+
+    typename SQDispatch<Q>::Table natives;
+    for (auto & [name, func] : NativeTable) natives.push_back({ name, func });
+
+    data->dispatch.Build(v, CallTable, ReturnTable, FrameTable);
+    data->natives.Build(v, natives, {});
+    data->dispatch_version = DispatchVersion;
+}
+
 template <Squirk Q>
 #ifdef _WIN64
 HSQUIRRELVM<Q> SQHook<Q>::CreateVM(HSQUIRRELVM<Q> v, SQSharedState<Q> *ss)
@@ -102,7 +198,7 @@ HSQUIRRELVM<Q> __fastcall SQHook<Q>::CreateVM(HSQUIRRELVM<Q> v, uintptr_t _EDX,
     Sqrat::DefaultVM<Q>::Set(v);
     spdlog::info("[SQ] SQVM is {}, SQSharedState is {} & scratchpad is {} ({} bytes).",
         fmt::ptr(v), fmt::ptr(_ss(v)), fmt::ptr(scratchpad), scratchpadsize);
-    _ss(v)->_debuginfo = true;
+    _ss(v)->_debuginfo = DebugInfo();
 
     return v;
 }
@@ -114,9 +210,22 @@ bool SQHook<Q>::CallNative(HSQUIRRELVM<Q> v, SQNativeClosure<Q> *nclosure, SQInt
 bool __fastcall SQHook<Q>::CallNative(HSQUIRRELVM<Q> v, uintptr_t _EDX, SQNativeClosure<Q> *nclosure, SQInteger nargs, SQInteger stackbase, SQObjectPtr<Q> &retval, bool &suspend)
 #endif
 {
-    M2FixData<Q> *data = EnsureFixData(v);
     SQFUNCTION<Q> function = nclosure->_function;
 
+    // The debug hook runs on every event, let it straight through, along
+    // with the trampolines which only forward to script.
+    if (function == Hook || function == SQTrampoline<Q>::Call) {
+        return v->CallNative(nclosure, nargs, stackbase, retval, suspend);
+    }
+
+    // Natives without a hook go straight through once the script hooks are
+    // in place, without the function swap or a trip through HookNative.
+    M2FixData<Q> *data = EnsureFixData(v);
+    if (M2Config::iNativeLevel < 1 && !NativeHook(v, data, nclosure) && Settled(v, data)) {
+        Sqrat::DefaultVM<Q>::Set(v);
+        return v->CallNative(nclosure, nargs, stackbase, retval, suspend);
+    }
+
     data->native = function;
     nclosure->_function = HookNative;
 
@@ -230,12 +339,14 @@ template <Squirk Q>
 void SQHook<Q>::SetCallHook(const char *name, SQFUNCTION<Q> func)
 {
     CallTable.push_back({ name, func });
+    DispatchVersion++;
 }
 
 template <Squirk Q>
 void SQHook<Q>::SetReturnHook(const char *name, SQFUNCTION<Q> func)
 {
     ReturnTable.push_back({ name, func });
+    DispatchVersion++;
 }
 
 template <Squirk Q>
@@ -248,24 +359,25 @@ template <Squirk Q>
 void SQHook<Q>::SetNativeCallHook(const char *name, SQFUNCTION<Q> func)
 {
     NativeTable.push_back({ name, func });
+    DispatchVersion++;
 }
 
 template <Squirk Q>
 void SQHook<Q>::SetPatchFileBlacklist(std::string file)
 {
-    FileBlacklist.push_back(file);
+    CdRomBlacklist.AddFile(file);
 }
 
 template <Squirk Q>
 void SQHook<Q>::SetPatchDataBlacklist(std::vector<unsigned char> data)
 {
-    DataBlacklist.push_back(data);
+    CdRomBlacklist.AddData(data);
 }
 
 template <Squirk Q>
 void SQHook<Q>::SetTextureWhitelist(unsigned int id)
 {
-    TextureWhitelist.push_back(id);
+    TextureWhitelist.AddRange(id, id);
 }
 
 template <Squirk Q>
@@ -326,6 +438,9 @@ SQInteger SQHook<Q>::SQCall_util_load_script(HSQUIRRELVM<Q> v)
     for (std::string & script : LoadScript) {
         spdlog::info("[SQ] Loading script {}.", script);
     }
+
+    // Only emit line ops for the scripts whose lines someone is watching.
+    _ss(v)->_debuginfo = DebugInfo(LoadScript);
     return 0;
 }
 
@@ -340,6 +455,10 @@ SQInteger SQHook<Q>::SQReturn_util_load_script(HSQUIRRELVM<Q> v)
         }
     }
     LoadScript = {};
+    _ss(v)->_debuginfo = DebugInfo();
+
+    // New scripts may have (re)defined hooked functions.
+    EnsureFixData(v)->trampolines.Invalidate();
     return 0;
 }
 
@@ -473,47 +592,52 @@ SQInteger SQHook<Q>::SQNative_setRamValue(HSQUIRRELVM<Q> v)
     unsigned offset = SQHelper<Q>::GetObject(3).Cast<unsigned>();
     unsigned value = SQHelper<Q>::GetObject(4).Cast<unsigned>();
 
-    Sqrat::RootTable root = Sqrat::RootTable<Q>();
-    Sqrat::Array<Q> patches = root.GetSlot("s_ram_patch_binary");
-
-    static unsigned address = 0;
-    static unsigned length = 0;
-    static unsigned index = 0;
-
-    if (address == 0) {
-        for (int i = 0; i < patches.Length(); ++i) {
-            Sqrat::Table<Q> _patch = *patches.GetValue<Sqrat::Table<Q>>(i);
-            unsigned addr = _patch["offset"].Cast<unsigned>() & 0xFFFFFF;
-            if (addr != offset) continue;
-            if (_patch.HasKey("data")) {
-                Sqrat::Array<Q> data = _patch["data"].Cast<Sqrat::Array<Q>>();
-                length = data.Length();
-            }
-            else {
-                Sqrat::Object<Q> _binary = _patch["binary"].Cast<Sqrat::Object<Q>>();
-                SQBinary<Q> binary = _binary.GetObject();
-                length = binary.Size();
-            }
-            address = addr;
-            break;
-        }
-    }
-    if (address == 0) return ret;
+    if (!RamPatches.Indexed()) IndexRamPatches();
+
+    M2RamPatches::Write write;
+    if (!RamPatches.Next(offset, write)) return ret;
 
-    if (M2Config::bPatchesDisableRAM && address != 0x200000) {
-        if (index == 0) {
-            spdlog::info("[SQ] [Patch] filtering RAM patch offset 0x{:x} with size 0x{:x}.", address, length);
+    if (M2Config::bPatchesDisableRAM && write.address != 0x200000) {
+        if (write.index == 0) {
+            spdlog::info("[SQ] [Patch] filtering RAM patch offset 0x{:x} with size 0x{:x}.", write.address, write.length);
         }
         ret = 1;
     }
 
-    if (length != 0 && ++index == length) {
-        address = 0;
-        length = 0;
-        index = 0;
+    return ret;
+}
+
+// Rebuilt when the disk patch is set. The first patch listed wins where
+// several start at the same offset, as with the scan before.
+template <Squirk Q>
+void SQHook<Q>::IndexRamPatches()
+{
+    RamPatches.Clear();
+
+    // Not set up yet, look again next time.
+    Sqrat::RootTable root = Sqrat::RootTable<Q>();
+    Sqrat::Object<Q> slot = root.GetSlot("s_ram_patch_binary");
+    if (slot.GetType() != OT_ARRAY) return;
+
+    Sqrat::Array<Q> patches = slot;
+    for (int i = 0; i < patches.Length(); ++i) {
+        Sqrat::Table<Q> _patch = *patches.GetValue<Sqrat::Table<Q>>(i);
+        unsigned addr = _patch["offset"].Cast<unsigned>() & 0xFFFFFF;
+        unsigned length = 0;
+        if (_patch.HasKey("data")) {
+            Sqrat::Array<Q> data = _patch["data"].Cast<Sqrat::Array<Q>>();
+            length = data.Length();
+        }
+        else {
+            Sqrat::Object<Q> _binary = _patch["binary"].Cast<Sqrat::Object<Q>>();
+            SQBinary<Q> binary = _binary.GetObject();
+            length = binary.Size();
+        }
+        RamPatches.Add(addr, length);
     }
 
-    return ret;
+    RamPatches.Finish();
+    spdlog::info("[SQ] [Patch] indexed {} RAM patches.", RamPatches.Size());
 }
 
 template <Squirk Q>
@@ -532,40 +656,63 @@ SQInteger SQHook<Q>::SQNative_entryCdRomPatch(HSQUIRRELVM<Q> v)
     if (patch.GetType() != OT_TABLE) patch = SQHelper<Q>::GetObject(-10);
 
     auto file = patch["file"].Cast<std::string>();
-    auto buffer = SQHelper<Q>::template MakeVector<unsigned char>(data);
+
+    // Read where it is, only the length is needed unless a pattern has it.
+    SQArray<Q> *buffer = data.GetType() == OT_ARRAY ? _array(data.GetObject()) : nullptr;
+    size_t size = buffer ? buffer->_values.size() : 0;
 
     if (M2Config::bPatchesDisableCDROM && !file.empty()) {
         spdlog::info("[SQ] [Patch] filtering CD-ROM patch file {}.", file);
         return 1;
     }
-    if (M2Config::bPatchesDisableCDROM && !buffer.empty()) {
+    if (M2Config::bPatchesDisableCDROM && size != 0) {
         spdlog::info("[SQ] [Patch] filtering CD-ROM patch offset 0x{:x}.", offset);
         return 1;
     }
 
-    for (auto &filter : FileBlacklist)
-    {
-        if (file.empty()) break;
-        if (file.starts_with(filter)) {
-            spdlog::info("[SQ] [Patch] filtering CD-ROM patch file {}.", file);
-            return 1;
-        }
+    if (!file.empty() && CdRomBlacklist.MatchFile(file)) {
+        spdlog::info("[SQ] [Patch] filtering CD-ROM patch file {}.", file);
+        return 1;
     }
-    for (auto &filter : DataBlacklist)
-    {
-        if (buffer.empty()) break;
-        if (filter == buffer) {
-            spdlog::info("[SQ] [Patch] filtering CD-ROM patch offset 0x{:x}.", offset);
-            return 1;
+    if (size != 0 && CdRomBlacklist.MatchData(size, [buffer](size_t i) {
+        auto &value = buffer->_values[i];
+        return sq_isinteger(value) ? static_cast<int>(static_cast<unsigned char>(_integer(value))) : -1;
+    })) {
+        spdlog::info("[SQ] [Patch] filtering CD-ROM patch offset 0x{:x}.", offset);
+        return 1;
+    }
+
+    // Kept for Ketchup to set back to once a mod over it goes. Only the
+    // length of the game's own binaries is asked for here.
+    if (!CdRomPatchEntering) {
+        if (data.GetType() == OT_INSTANCE) {
+            SQBinary<Q> binary = data.GetObject();
+            size = static_cast<size_t>(binary.Size());
+        }
+        if (size != 0) {
+            HSQOBJECT<Q> object = data.GetObject();
+            sq_addref(v, &object);
+            CdRomPatches.push_back({ offset, size, object });
         }
     }
 
     return 0;
 }
 
+template <Squirk Q>
+void SQHook<Q>::ClearCdRomPatches(HSQUIRRELVM<Q> v)
+{
+    for (auto &patch : CdRomPatches) {
+        sq_release(v, &patch.data);
+    }
+    CdRomPatches.clear();
+}
+
 template <Squirk Q>
 SQInteger SQHook<Q>::SQNative_releaseCdRomPatch(HSQUIRRELVM<Q> v)
 {
+    CdRomPatchReleased = true;
+    ClearCdRomPatches(v);
     spdlog::info("[SQ] [Patch] CD-ROM patch released.");
     return 0;
 }
@@ -582,11 +729,8 @@ SQInteger SQHook<Q>::SQNative_entryTexturePatch(HSQUIRRELVM<Q> v)
 {
     unsigned id = SQHelper<Q>::GetObject(2).Cast<unsigned>();
 
-    if (TextureWhitelist.empty()) return 0;
-    for (auto &filter : TextureWhitelist)
-    {
-        if (filter == id) return 0;
-    }
+    if (!TextureWhitelist.HasRanges()) return 0;
+    if (TextureWhitelist.MatchRange(id)) return 0;
 
     spdlog::info("[SQ] [Patch] filtering texture patch ID 0x{:x}.", id);
     return 1;
@@ -595,6 +739,9 @@ SQInteger SQHook<Q>::SQNative_entryTexturePatch(HSQUIRRELVM<Q> v)
 template <Squirk Q>
 SQInteger SQHook<Q>::SQNative_setupCdRom(HSQUIRRELVM<Q> v)
 {
+    // A new image starts without patches.
+    CdRomPatchReleased = true;
+    ClearCdRomPatches(v);
     spdlog::info("[SQ] CD-ROM image is {}.", SQTitleProf<Q>::GetDisk());
     return 0;
 }
@@ -615,16 +762,39 @@ SQInteger SQHook<Q>::SQNative_setLogFilename(HSQUIRRELVM<Q> v)
 }
 
 template <Squirk Q>
-bool SQHook<Q>::FixNative(HSQUIRRELVM<Q> v, SQFUNCTION<Q> func, SQNativeClosure<Q> *closure, const SQChar *name)
+SQInteger SQHook<Q>::SQNative_print(HSQUIRRELVM<Q> v)
 {
-    if (!name) return true;
+    SQChar *cstr = nullptr;
+    SQInteger length = 0;
+    const SQChar *format = SQHelper<Q>::GetObject(2).Cast<const SQChar *>();
+    if (format && *format != 0 && SQ_SUCCEEDED(sqstd_format(v, 2, &length, &cstr))) {
+        cstr[scstrcspn(cstr, "\r\n")] = 0;
+    }
+    std::string str;
+    if (cstr) str = cstr;
 
-    for (auto &func : NativeTable) {
-        if (strcmp(name, func.first) == 0) {
-            if (func.second(v)) return false;
-            break;
-        }
+    if (!str.empty()) {
+        spdlog::info("[SQ] [printf] {}", str);
     }
+    return 0;
+}
+
+template <Squirk Q>
+const typename SQDispatch<Q>::Entry *SQHook<Q>::NativeHook(HSQUIRRELVM<Q> v, M2FixData<Q> *data, SQNativeClosure<Q> *closure)
+{
+    if (!closure || !sq_isstring(closure->_name)) return nullptr;
+
+    // Closure names are interned, so this is one probe by pointer.
+    EnsureDispatch(v, data);
+    auto entry = data->natives.Find(_string(closure->_name));
+    return entry && entry->call ? entry : nullptr;
+}
+
+template <Squirk Q>
+bool SQHook<Q>::FixNative(HSQUIRRELVM<Q> v, M2FixData<Q> *data, SQNativeClosure<Q> *closure)
+{
+    auto entry = NativeHook(v, data, closure);
+    if (entry && entry->call(v)) return false;
 
     return true;
 }
@@ -650,6 +820,7 @@ SQInteger SQHook<Q>::SQReturn_setSmoothing(HSQUIRRELVM<Q> v)
 template <Squirk Q>
 SQInteger SQHook<Q>::_SQReturn_set_disk_patch(HSQUIRRELVM<Q> v)
 {
+    IndexRamPatches();
     Ketchup<Q>::Process(v);
     return 0;
 }
@@ -749,24 +920,20 @@ template <Squirk Q>
 void SQHook<Q>::FixScript(HSQUIRRELVM<Q> v)
 {
     M2FixData<Q> *data = EnsureFixData(v);
-    if (data->func.empty()) return;
+    if (!data->name || data->name->_len == 0) return;
 
     SQResource<Q>::GetInstance().Poll();
-    
+
+    EnsureDispatch(v, data);
+    auto entry = data->dispatch.Find(data->name);
+    if (!entry) return;
+
     switch (data->event_type) {
         case 'c':
-            for (auto &func : CallTable) {
-                if (func.first != data->func) continue;
-                func.second(v);
-                break;
-            }
+            if (entry->call) entry->call(v);
             break;
         case 'r':
-            for (auto &func : ReturnTable) {
-                if (func.first != data->func) continue;
-                func.second(v);
-                break;
-            }
+            if (entry->ret) entry->ret(v);
             break;
         default: break;
     }
@@ -798,22 +965,7 @@ SQInteger SQHook<Q>::HookNative(HSQUIRRELVM<Q> v)
         TraceNative(v, func, closure, name);
     }
 
-    if (name && (strcmp(name, "printf") == 0 || strcmp(name, "print") == 0)) {
-        SQChar *cstr = nullptr;
-        SQInteger length = 0;
-        const SQChar *format = SQHelper<Q>::GetObject(2).Cast<const SQChar *>();
-        if (format && *format != 0 && SQ_SUCCEEDED(sqstd_format(v, 2, &length, &cstr))) {
-            cstr[scstrcspn(cstr, "\r\n")] = 0;
-        }
-        std::string str;
-        if (cstr) str = cstr;
-
-        if (!str.empty()) {
-            spdlog::info("[SQ] [printf] {}", str);
-        }
-    }
-
-    if (FixNative(v, func, closure, name)) {
+    if (FixNative(v, data, closure)) {
         return func(v);
     }
 
@@ -827,6 +979,12 @@ M2FixData<Q> *SQHook<Q>::EnsureFixData(HSQUIRRELVM<Q> v)
     return SQHelper<Q>::template AcquireForeignObject<M2FixData<Q>>(v);
 }
 
+template <Squirk Q>
+bool &SQTrampoline<Q>::Dispatching(HSQUIRRELVM<Q> v)
+{
+    return SQHelper<Q>::template AcquireForeignObject<M2FixData<Q>>(v)->dispatching;
+}
+
 template <Squirk Q>
 bool SQHook<Q>::Main(HSQUIRRELVM<Q> v)
 {
@@ -978,17 +1136,58 @@ void SQHook<Q>::Command()
     spdlog::info("[SQ] [Command] {}", response);
 }
 
+template <Squirk Q>
+bool SQHook<Q>::ErrorPending(HSQUIRRELVM<Q> v, M2FixData<Q> *data)
+{
+    // Same lookup as Sqrat::Error::Occurred, without interning the key or
+    // touching the stack on every event.
+    if (sq_isnull(data->error_key)) {
+        data->error_key = SQObjectPtr<Q>(SQString<Q>::Create(_ss(v), _SC("__error")));
+    }
+
+    SQObjectPtr<Q> error;
+    return _table(_ss(v)->_registry)->Get(data->error_key, error);
+}
+
+template <Squirk Q>
+bool SQHook<Q>::Subscribed(HSQUIRRELVM<Q> v, M2FixData<Q> *data)
+{
+    if (!data->hooked) return true;
+    if (M2Config::iLevel >= 1 || M2Config::iNativeLevel >= 1) return true;
+    if (M2Config::bDebuggerEnabled && !M2Config::bDebuggerExclusive && DBG) return true;
+    if (M2Config::bError && sq_isstring(v->_lasterror)) return true;
+    if (SQResource<Q>::Pending()) return true;
+    return ErrorPending(v, data);
+}
+
 template <Squirk Q> SQInteger debug_hook(HSQUIRRELVM<Q> v, HSQUIRRELVM<Q> _v, HSQREMOTEDBG<Q> rdbg);
 template <Squirk Q>
 SQInteger SQHook<Q>::Hook(HSQUIRRELVM<Q> v)
 {
     Sqrat::DefaultVM<Q>::Set(v);
+    M2FixData<Q> *data = SQHook<Q>::EnsureFixData(v);
+
+    // Event data stays borrowed from the hook's arguments, nothing is copied
+    // unless a consumer below asks for it.
+    auto &type = stack_get(v, 2);
+    auto &src  = stack_get(v, 3);
+    auto &line = stack_get(v, 4);
+    auto &func = stack_get(v, 5);
+    data->event_type = sq_isinteger(type) ? static_cast<char>(_integer(type)) : 0;
+    data->line       = sq_isinteger(line) ? static_cast<unsigned>(_integer(line)) : 0;
+    data->name       = sq_isstring(func) ? _string(func) : nullptr;
+
+    // Fast path, for the events nothing but the call/return hooks care about.
+    if (!Subscribed(v, data)) {
+        sq_reseterror(v);
+        if (data->event_type != 'c' && data->event_type != 'r') return 0;
+        if (data->dispatch_version == DispatchVersion && !data->dispatch.Find(data->name)) return 0;
+    }
+
     SQObjectPtr debughook = v->_debughook;
     v->_debughook = _null_<Q>;
 
-    Sqrat::RootTable<Q> root = Sqrat::RootTable<Q>();
-
-    std::string message = Sqrat::Error<Q>::Message(v);
+    std::string message = ErrorPending(v, data) ? Sqrat::Error<Q>::Message(v) : std::string {};
     if (M2Config::bError) {
         if (sq_isstring(v->_lasterror) && !message.empty()) {
             spdlog::error("[SQ] [Error] [#1] {} [#2] {}", _stringval(v->_lasterror), message);
@@ -1008,23 +1207,24 @@ SQInteger SQHook<Q>::Hook(HSQUIRRELVM<Q> v)
         debug_hook(static_cast<HSQUIRRELVM<Q>>(nullptr), v, DBG);
     }
 
-    M2FixData<Q> *data = SQHook<Q>::EnsureFixData(v);
-
     if (!data->hooked) {
         data->hooked = true;
         if (Main(v)) return 0;
     }
 
-    data->event_type = SQHelper<Q>::GetObject(2).Cast<int>();
-    data->src        = SQHelper<Q>::GetObject(3).Cast<std::string>();
-    data->line       = SQHelper<Q>::GetObject(4).Cast<unsigned>();
-    data->func       = SQHelper<Q>::GetObject(5).Cast<std::string>();
+    // Only native call tracing reads the source back, after the event.
+    if (M2Config::iNativeLevel >= 1) {
+        data->src = sq_isstring(src) ? _stringval(src) : "";
+    }
 
     if (M2Config::iLevel >= 1) {
         Trace(v);
     }
 
-    FixScript(v);
+    {
+        typename SQTrampoline<Q>::Dispatch dispatch(v);
+        FixScript(v);
+    }
 
     v->_debughook = debughook;
     return 0;
@@ -1155,13 +1355,14 @@ void SQHook<Q>::Load()
         case M2FixGame::NMA1:
         case M2FixGame::NMA2:
         {
-            bool ret = false;
+            M2Hook::Result ret = false;
 
             ret = M2Hook::GetInstance().Hook(
                 "C7 86 D4 00 00 00 FF FF FF FF 89 86 D0 00 00 00",
                 -0x185, SQHook<Squirk::AlignObject>::CreateVM, "[SQ-32<AlignObject>] SQVM::SQVM"
             );
             if (!ret) {
+                M2Hook::GetInstance().Otherwise();
                 M2Hook::GetInstance().Hook(
                     "C7 86 C4 00 00 00 FF FF FF FF 89 86 C0 00 00 00",
                     -0x138, SQHook<Squirk::AlignObjectShared>::CreateVM, "[SQ-32<AlignObjectShared>] SQVM::SQVM"
@@ -1173,6 +1374,7 @@ void SQHook<Q>::Load()
                 -0x2C3, SQHook<Squirk::AlignObject>::CallNative, "[SQ-32<AlignObject>] SQVM::CallNative"
             );
             if (!ret) {
+                M2Hook::GetInstance().Otherwise();
                 M2Hook::GetInstance().Hook(
                     "FF D0 8B 4D 18 83 C4 04 FF 8E B8 00 00 00 C6 01",
                     -0x2DB, SQHook<Squirk::AlignObjectShared>::CallNative, "[SQ-32<AlignObjectShared>] SQVM::CallNative"
@@ -1184,6 +1386,7 @@ void SQHook<Q>::Load()
                 -0x58, SQHook<Squirk::AlignObject>::BindFunc, "[SQ-32<AlignObject>] Sqrat::BindFunc"
             );
             if (!ret) {
+                M2Hook::GetInstance().Otherwise();
                 M2Hook::GetInstance().Hook(
                     "0F B6 43 18 83 C4 04 8B 4E 08 BA FD FF FF FF 50",
                     -0x17E, SQHook<Squirk::AlignObjectShared>::BindFunc, "[SQ-32<AlignObjectShared>] Sqrat::BindFunc"
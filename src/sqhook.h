@@ -1,8 +1,12 @@
 #pragma once
 
 #include "m2fixbase.h"
+#include "m2patchfilter.h"
+#include "m2rampatches.h"
 
 #include "sqhelper.h"
+#include "sqdispatch.h"
+#include "sqtrampoline.h"
 
 #include "sqrdbg.h"
 #include "sqdbgserver.h"
@@ -20,12 +24,26 @@ public:
     // Restored and called by the hook.
     SQFUNCTION<Q> native;
     // Last-seen source-level debug information from line evaluation.
-    // Deferred for native call logging where this is otherwise lost.
+    // Deferred for native call logging where this is otherwise lost, so
+    // `src` is only copied out while native tracing is enabled.
     // This can only be populated as a consequence of enabling debuginfo.
     char event_type;
     std::string src;
     unsigned line;
-    std::string func;
+    // Interned name of the function the last event was for, borrowed from the
+    // event's stack frame and only valid for the duration of the event.
+    SQString<Q> *name;
+    // Interned `__error` key, to check for Sqrat errors without allocating.
+    SQObjectPtr<Q> error_key;
+    // Call/return & native hooks keyed by interned name, rebuilt whenever
+    // the hook tables change.
+    SQDispatch<Q> dispatch;
+    SQDispatch<Q> natives;
+    unsigned dispatch_version;
+    // Wrappers for hooked closures, when hooking without the debug hook.
+    SQTrampoline<Q> trampolines;
+    // Set while a hook runs on this VM, see SQTrampoline::Dispatching.
+    bool dispatching;
 };
 
 template <Squirk Q = Squirk::Standard>
@@ -65,6 +83,38 @@ public:
         return CdRomShellOpen;
     }
 
+    // Whether the emulator has dropped its CD-ROM patches since Ketchup last
+    // entered its own.
+    static bool IsCdRomPatchReleased()
+    {
+        return CdRomPatchReleased;
+    }
+
+    static void SetCdRomPatchEntered()
+    {
+        CdRomPatchReleased = false;
+    }
+
+    // A CD-ROM patch the game entered itself, kept until the emulator
+    // releases it.
+    struct CdRomPatch
+    {
+        uint64_t offset;
+        size_t size;
+        HSQOBJECT<Q> data;
+    };
+
+    static const std::vector<CdRomPatch> &GetCdRomPatches()
+    {
+        return CdRomPatches;
+    }
+
+    // Set while Ketchup enters its own, so they aren't kept as the game's.
+    static void SetCdRomPatchEntering(bool entering)
+    {
+        CdRomPatchEntering = entering;
+    }
+
 #ifdef _WIN64
     static HSQUIRRELVM<Q> CreateVM(HSQUIRRELVM<Q> v, SQSharedState<Q> *ss);
     static bool CallNative(HSQUIRRELVM<Q> v, SQNativeClosure<Q> *nclosure, SQInteger nargs, SQInteger stackbase, SQObjectPtr<Q> &retval, bool &suspend);
@@ -81,12 +131,23 @@ private:
     static bool Main(HSQUIRRELVM<Q> v);
 
     static SQInteger Hook(HSQUIRRELVM<Q> v);
+    static bool Subscribed(HSQUIRRELVM<Q> v, M2FixData<Q> *data);
+    static bool ErrorPending(HSQUIRRELVM<Q> v, M2FixData<Q> *data);
     static void SetHook(HSQUIRRELVM<Q> v);
+    static SQObjectPtr<Q> DebugHook(HSQUIRRELVM<Q> v);
+    static bool Settled(HSQUIRRELVM<Q> v, M2FixData<Q> *data);
+    static bool Trampolined();
+    static void SetTrampolines(HSQUIRRELVM<Q> v, M2FixData<Q> *data);
+    static void EnsureDispatch(HSQUIRRELVM<Q> v, M2FixData<Q> *data);
+    static bool DebugInfo(const std::vector<std::string> &scripts = {});
 
     static SQInteger HookNative(HSQUIRRELVM<Q> v);
 
     static void FixScript(HSQUIRRELVM<Q> v);
-    static bool FixNative(HSQUIRRELVM<Q> v, SQFUNCTION<Q> func, SQNativeClosure<Q> *closure, const SQChar *name);
+    static const typename SQDispatch<Q>::Entry *NativeHook(HSQUIRRELVM<Q> v, M2FixData<Q> *data, SQNativeClosure<Q> *closure);
+    static bool FixNative(HSQUIRRELVM<Q> v, M2FixData<Q> *data, SQNativeClosure<Q> *closure);
+    static void IndexRamPatches();
+    static void ClearCdRomPatches(HSQUIRRELVM<Q> v);
 
     static void TraceParameter(std::stringstream & trace, SQObjectPtr<Q> obj, int level);
     static void TraceNext(std::stringstream & trace, HSQUIRRELVM<Q> v);
@@ -122,6 +183,7 @@ private:
     static SQInteger SQ_SystemEtc_setStartPadId(HSQUIRRELVM<Q> v);
     static SQInteger SQ_SystemEtc_getStartPadId(HSQUIRRELVM<Q> v);
 
+    static SQInteger SQNative_print(HSQUIRRELVM<Q> v);
     static SQInteger SQNative_setRamValue(HSQUIRRELVM<Q> v);
     static SQInteger SQNative_setupCdRom(HSQUIRRELVM<Q> v);
     static SQInteger SQNative_entryCdRomPatch(HSQUIRRELVM<Q> v);
@@ -134,9 +196,10 @@ private:
 
 private:
     static inline HSQREMOTEDBG<Q> DBG = nullptr;
-    static inline std::vector<std::string> FileBlacklist = {};
-    static inline std::vector<std::vector<unsigned char>> DataBlacklist = {};
-    static inline std::vector<unsigned int> TextureWhitelist = {};
+    static inline M2PatchFilter CdRomBlacklist = {};
+    static inline M2PatchFilter TextureWhitelist = {};
+    // Start offset & size of each RAM patch in s_ram_patch_binary, by offset.
+    static inline M2RamPatches RamPatches = {};
     static inline unsigned int ThreadCount           = 0;
     static inline unsigned int InitializeFinishCount = 0;
     static inline unsigned int ScreenWidth  = 0;
@@ -147,6 +210,9 @@ private:
     static inline bool LaunchIntent    = true;
     static inline SQInteger StartPadId = 4;
     static inline bool CdRomShellOpen  = false;
+    static inline bool CdRomPatchReleased = true;
+    static inline bool CdRomPatchEntering = false;
+    static inline std::vector<CdRomPatch> CdRomPatches = {};
     static inline bool Smoothing       = false;
     static inline std::vector<std::string> LoadScript = {};
 
@@ -156,6 +222,8 @@ private:
 private:
     static std::vector<std::pair<std::string, SQFUNCTION<Q>>> CallTable;
     static std::vector<std::pair<std::string, SQFUNCTION<Q>>> ReturnTable;
+    static inline unsigned DispatchVersion = 1;
+    static std::vector<std::string> FrameTable;
     static std::vector<std::pair<std::string, SQInteger(*)(HSQUIRRELVM<Q>, HSQOBJECT<Q>)>> ConstructorTable;
     static std::vector<std::pair<std::string, SQFUNCTION<Q>>> LoadScriptTable;
     static std::vector<std::pair<const SQChar *, SQFUNCTION<Q>>> NativeTable;
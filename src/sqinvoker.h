@@ -2,10 +2,15 @@
 
 #include "sqpcheader.h"
 #include "sqvm.h"
+#include "sqtable.h"
 #include "sqrat.h"
+#include "m2methodcache.h"
 
 #include <cctype>
+#include <cstring>
+#include <map>
 #include <string>
+#include <vector>
 
 template <Squirk Q>
 class SQInvoker
@@ -13,6 +18,13 @@ class SQInvoker
 public:
 	SQInvoker(const SQChar *name)
 	{
+		HSQUIRRELVM<Q> v = Sqrat::DefaultVM<Q>::Get();
+		m_handles = Handles::Acquire(v, name);
+		if (m_handles) {
+			m_instance = Sqrat::Table<Q>(m_handles->instance, v);
+			return;
+		}
+
 		Sqrat::RootTable root = Sqrat::RootTable<Q>();
 		m_instance = root.GetSlot(name);
 	}
@@ -30,11 +42,24 @@ public:
 	inline void SetInstance(HSQOBJECT<Q> instance)
 	{
 		m_instance = instance;
+		m_handles = nullptr;
+	}
+
+	// Drops every cached method, for when script methods were replaced in
+	// place rather than by assigning the global.
+	static void Invalidate()
+	{
+		Handles::Generation()++;
 	}
 
 protected:
 	inline Sqrat::Function<Q> Function(const char *function)
 	{
+		if (m_handles) {
+			HSQUIRRELVM<Q> v = m_instance.GetVM();
+			return Sqrat::Function<Q>(v, m_handles->instance, m_handles->Find(v, function));
+		}
+
 		std::string name(function);
 		name[0] = tolower(name[0]);
 		return m_instance.GetFunction(name.c_str());
@@ -64,6 +89,97 @@ protected:
 		return Invoke<Return>(Function(function), args ...);
 	}
 
+private:
+	// The methods of one global, resolved once and pinned. Checked against
+	// the root table on every use, so reassigning the global drops them.
+	// Never freed, a VM may be closed before or after static destruction.
+	struct Handles
+	{
+		std::string name;
+		HSQOBJECT<Q> key = _null_<Q>;
+		HSQOBJECT<Q> instance = _null_<Q>;
+		M2MethodCache<HSQOBJECT<Q>> methods;
+
+		static unsigned & Generation()
+		{
+			static unsigned generation = 0;
+			return generation;
+		}
+
+		static Handles *Acquire(HSQUIRRELVM<Q> v, const SQChar *name)
+		{
+			static auto & cache = *new std::vector<Handles *>();
+			if (!v || !sq_istable(v->_roottable)) return nullptr;
+
+			Handles *handles = nullptr;
+			for (auto entry : cache) {
+				if (entry->name != name) continue;
+				handles = entry;
+				break;
+			}
+			if (!handles) {
+				handles = new Handles();
+				handles->name = name;
+				cache.push_back(handles);
+			}
+
+			// A new VM, whatever was pinned belonged to the old one which may
+			// be gone, so let it go without releasing.
+			if (handles->methods.Bind(_ss(v), _rawval(v->_roottable))) {
+				handles->instance = _null_<Q>;
+
+				SQObjectPtr<Q> key = SQString<Q>::Create(_ss(v), name);
+				handles->key = key;
+				sq_addref(v, &handles->key);
+			}
+
+			SQObjectPtr<Q> instance;
+			if (!_table(v->_roottable)->Get(handles->key, instance)) {
+				handles->Reset(v, _null_<Q>);
+				return nullptr;
+			}
+			if (!handles->methods.Current(obj_type(instance), _rawval(instance), Generation())) {
+				handles->Reset(v, instance);
+			}
+			return handles;
+		}
+
+		void Reset(HSQUIRRELVM<Q> v, const SQObjectPtr<Q> &value)
+		{
+			methods.Reset(obj_type(value), _rawval(value), Generation(), [v](HSQOBJECT<Q> &method) {
+				sq_release(v, &method);
+			});
+			sq_release(v, &instance);
+
+			instance = value;
+			sq_addref(v, &instance);
+		}
+
+		// Misses are cached too, as null.
+		HSQOBJECT<Q> Find(HSQUIRRELVM<Q> v, const char *function)
+		{
+			return methods.Find(function, [&] {
+				std::string name(function);
+				name[0] = tolower(name[0]);
+
+				HSQOBJECT<Q> method = _null_<Q>;
+				sq_pushobject(v, instance);
+				sq_pushstring(v, name.c_str(), -1);
+				if (SQ_SUCCEEDED(sq_get(v, -2))) {
+					if (sq_gettype(v, -1) == OT_CLOSURE || sq_gettype(v, -1) == OT_NATIVECLOSURE) {
+						sq_getstackobj(v, -1, &method);
+						sq_addref(v, &method);
+					}
+					sq_pop(v, 1);
+				}
+				sq_pop(v, 1);
+				return method;
+			});
+		}
+	};
+
+	Handles *m_handles = nullptr;
+
 protected:
 	Sqrat::Table<Q> m_instance;
 };
@@ -44,8 +44,13 @@ public:
 		return this->Invoke<Sqrat::Object<Q>>(__func__, path);
 	}
 
+	// Static so the debug hook can check it without constructing the instance.
+	static bool Pending() {
+		return !ResourceTable.empty();
+	}
+
 	void Poll() {
-		if (GetLoading()) return;
+		if (!Pending() || GetLoading()) return;
 
 		for (auto it = ResourceTable.begin(); it != ResourceTable.end(); ++it)
 		{
@@ -75,7 +80,7 @@ public:
 	}
 
 private:
-	std::unordered_multimap<std::string, std::pair<RSCFUNCTION<Q>, std::any>> ResourceTable;
+	static inline std::unordered_multimap<std::string, std::pair<RSCFUNCTION<Q>, std::any>> ResourceTable;
 };
 
 template SQResource<Squirk::Standard>;
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "stdafx.h"
+
+#include "sqdispatch.h"
+
+// Wraps the script closures that have call/return hooks in native closures,
+// so the hooks run without the global debug hook firing on every line.
+// Closures are found by their function name, the same name the debug hook
+// dispatches on, in the root table and in the tables & classes directly in it.
+// Hooks that read the hooked function's frame are run by turning the debug
+// hook on for just that call instead. A wrapped function can't suspend its
+// thread, as the wrapper is a native call. Class constructors are only
+// wrapped in the classes asked for, as every object built would go through
+// its wrapper.
+template <Squirk Q>
+class SQTrampoline
+{
+public:
+	// Set on a VM while a hook runs on it, hooks don't fire for calls they
+	// make themselves, just as the debug hook is off while it runs. Defined
+	// where the VM's own data is.
+	static bool &Dispatching(HSQUIRRELVM<Q> v);
+
+	// Sets the flag for a scope, putting it back however the scope is left.
+	class Dispatch
+	{
+	public:
+		explicit Dispatch(HSQUIRRELVM<Q> v) : m_flag(Dispatching(v)), m_was(std::exchange(m_flag, true)) {}
+		~Dispatch() { m_flag = m_was; }
+
+		Dispatch(const Dispatch &) = delete;
+		Dispatch &operator=(const Dispatch &) = delete;
+
+	private:
+		bool &m_flag;
+		bool m_was;
+	};
+
+	// Something rewrote the root or the scripts were reloaded since the last
+	// sync. Slot replacements by scripts already loaded go unnoticed.
+	bool Stale(HSQUIRRELVM<Q> v, unsigned version) const
+	{
+		return m_dirty || m_version != version || m_count != _table(v->_roottable)->CountUsed();
+	}
+
+	void Invalidate()
+	{
+		m_dirty = true;
+	}
+
+	// Wraps every hooked closure that isn't yet. `hook` is the debug hook
+	// closure to install around scoped calls, `constructors` the classes in
+	// the root table whose constructors are wrapped.
+	size_t Sync(HSQUIRRELVM<Q> v, const SQDispatch<Q> &dispatch, unsigned version, const SQObjectPtr<Q> &hook,
+		const std::vector<std::string> &constructors)
+	{
+		size_t wrapped = 0;
+
+		SQTable<Q> *root = _table(v->_roottable);
+		SQObjectPtr<Q> ref, key, val;
+		for (SQInteger i; (i = root->Next(false, ref, key, val)) != -1; ref = i) {
+			switch (obj_type(val)) {
+				case OT_CLOSURE:
+					if (Wrap(v, dispatch, hook, val, false)) {
+						root->Set(key, val);
+						wrapped++;
+					}
+					break;
+				case OT_TABLE:
+					wrapped += Sync(v, dispatch, hook, _table(val));
+					break;
+				case OT_CLASS: {
+					bool constructor = sq_isstring(key) &&
+						std::find(constructors.begin(), constructors.end(), _stringval(key)) != constructors.end();
+					wrapped += Sync(v, dispatch, hook, _class(val), constructor);
+					break;
+				}
+				default: break;
+			}
+		}
+
+		m_dirty = false;
+		m_version = version;
+		m_count = root->CountUsed();
+		return wrapped;
+	}
+
+	// The wrapper itself, called with the original arguments followed by
+	// the closure, call hook, return hook & scoped debug hook.
+	static SQInteger Call(HSQUIRRELVM<Q> v)
+	{
+		SQInteger nargs = sq_gettop(v) - m_iOuters;
+
+		SQObjectPtr<Q> closure = stack_get(v, nargs + 1);
+		auto call = reinterpret_cast<SQFUNCTION<Q>>(_userpointer(stack_get(v, nargs + 2)));
+		auto ret = reinterpret_cast<SQFUNCTION<Q>>(_userpointer(stack_get(v, nargs + 3)));
+		SQObjectPtr<Q> hook = stack_get(v, nargs + 4);
+		bool scoped = !sq_isnull(hook);
+		bool direct = !scoped && !Dispatching(v);
+
+		if (direct && call) {
+			Dispatch dispatch(v);
+			call(v);
+			sq_settop(v, nargs + m_iOuters);
+		}
+
+		// Scoped calls get their events from the debug hook, the rest run with
+		// it off, so an enclosing scoped call doesn't dispatch them twice.
+		SQObjectPtr<Q> debughook = v->_debughook;
+		v->_debughook = Dispatching(v) ? _null_<Q> : hook;
+
+		// Errors are raised in the call, where the closure's frames are still
+		// there for the error handler to report, as they are unwrapped.
+		sq_pushobject(v, closure);
+		for (SQInteger i = 1; i <= nargs; ++i) sq_push(v, i);
+		SQRESULT result = sq_call(v, nargs, SQTrue, SQTrue);
+
+		v->_debughook = debughook;
+		if (SQ_FAILED(result)) return SQ_ERROR;
+
+		SQObjectPtr<Q> retval = stack_get(v, -1);
+		if (direct && ret) {
+			Dispatch dispatch(v);
+			ret(v);
+		}
+
+		sq_settop(v, nargs + m_iOuters);
+		sq_pushobject(v, retval);
+		return 1;
+	}
+
+private:
+	static constexpr SQInteger m_iOuters = 4;
+
+	size_t Sync(HSQUIRRELVM<Q> v, const SQDispatch<Q> &dispatch, const SQObjectPtr<Q> &hook, SQTable<Q> *table)
+	{
+		size_t wrapped = 0;
+
+		SQObjectPtr<Q> ref, key, val;
+		for (SQInteger i; (i = table->Next(false, ref, key, val)) != -1; ref = i) {
+			if (!Wrap(v, dispatch, hook, val, false)) continue;
+			table->Set(key, val);
+			wrapped++;
+		}
+		return wrapped;
+	}
+
+	// Methods are replaced in place, a class is locked once instantiated.
+	size_t Sync(HSQUIRRELVM<Q> v, const SQDispatch<Q> &dispatch, const SQObjectPtr<Q> &hook, SQClass<Q> *klass, bool constructor)
+	{
+		size_t wrapped = 0;
+
+		for (SQUnsignedInteger i = 0; i < klass->_methods.size(); ++i) {
+			SQObjectPtr<Q> val = klass->_methods[i].val;
+			if (!Wrap(v, dispatch, hook, val, constructor)) continue;
+			klass->_methods[i].val = val;
+			wrapped++;
+		}
+		return wrapped;
+	}
+
+	// Replaces `val` with its wrapper if it's a closure with hooks.
+	static bool Wrap(HSQUIRRELVM<Q> v, const SQDispatch<Q> &dispatch, const SQObjectPtr<Q> &hook, SQObjectPtr<Q> &val, bool constructor)
+	{
+		if (!sq_isclosure(val)) return false;
+
+		SQFunctionProto<Q> *proto = _funcproto(_closure(val)->_function);
+		if (!sq_isstring(proto->_name)) return false;
+		if (!constructor && std::string_view(_stringval(proto->_name)) == "constructor") return false;
+
+		auto entry = dispatch.Find(_string(proto->_name));
+		if (!entry || (!entry->call && !entry->ret)) return false;
+
+		sq_pushobject(v, val);
+		sq_pushuserpointer(v, reinterpret_cast<SQUserPointer>(entry->call));
+		sq_pushuserpointer(v, reinterpret_cast<SQUserPointer>(entry->ret));
+		sq_pushobject(v, entry->scoped ? hook : _null_<Q>);
+		sq_newclosure(v, Call, m_iOuters);
+		sq_setnativeclosurename(v, -1, _stringval(proto->_name));
+
+		val = stack_get(v, -1);
+		sq_pop(v, 1);
+		return true;
+	}
+
+private:
+	bool m_dirty = true;
+	unsigned m_version = 0;
+	SQInteger m_count = -1;
+};
@@ -34,6 +34,7 @@ using namespace StdExt;
 #include <set>
 #include <unordered_set>
 #include <mutex>
+#include <functional>
 #include <regex>
 
 #undef Yield
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdio>
+
+// Failures are counted rather than stopped at, so one run shows them all.
+inline int g_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            ++g_failures; \
+        } \
+    } while (0)
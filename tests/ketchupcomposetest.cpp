@@ -0,0 +1,107 @@
+#include "ketchuppatch.h"
+#include "ketchupiso.h"
+#include "ketchupmods.h"
+#include "check.h"
+
+namespace {
+	const std::filesystem::path g_root = "ketchupcompose";
+
+	std::vector<std::string> Names(const std::vector<std::filesystem::path> &paths)
+	{
+		std::vector<std::string> names;
+		for (auto &path : paths) names.push_back(path.filename().string());
+		return names;
+	}
+
+	void LoadOrder()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root / "folder");
+		for (auto name : { "d.ppf", "c.ppf", "b.ppf", "a.ppf", "a.ppf.kidx", "a.ppf.kidx.tmp", KetchupISO::IndexFile }) Write(g_root / name, PPF3({}));
+
+		// Lexical order without a load order file, indexes and their leftovers left out.
+		CHECK(Names(KetchupPatch::LoadOrder(g_root)) == std::vector<std::string>({ "a.ppf", "b.ppf", "c.ppf", "d.ppf" }));
+
+		// Named ones first, in order, the rest after.
+		{
+			std::ofstream file(g_root / KetchupPatch::LoadOrderFile);
+			file << "# First the fixes.\n\n  c.ppf \r\nmissing.ppf\n\tb.ppf\n";
+		}
+		CHECK(Names(KetchupPatch::LoadOrder(g_root)) == std::vector<std::string>({ "c.ppf", "b.ppf", "a.ppf", "d.ppf" }));
+	}
+
+	void LaterWins()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+
+		// Enough mods that every loader thread has several.
+		std::vector<Records> mods;
+		std::vector<std::filesystem::path> paths;
+		for (int i = 0; i < 40; ++i) {
+			mods.push_back(RandomRecords(30, 0x4000));
+			paths.push_back(g_root / ("mod" + std::to_string(100 + i) + ".ppf"));
+			Write(paths.back(), PPF3(mods.back()));
+		}
+		// One that isn't a mod, which is left out.
+		paths.insert(paths.begin() + 5, g_root / "broken.ppf");
+		Write(paths[5], Bytes(64));
+
+		KetchupSource none;
+		Ketchup_Patches patches;
+		std::map<std::filesystem::path, Ketchup_Patches> loaded;
+		KetchupPatch::Compose(paths, none, patches, loaded);
+
+		Ketchup_Patches want;
+		for (auto &records : mods) want = Expected(records, std::move(want));
+		CHECK(patches == want);
+		CHECK(loaded.size() == mods.size());
+		CHECK(!loaded.count(paths[5]));
+
+		// Those already loaded aren't read again, those dropped are forgotten.
+		Write(paths[0], PPF3({ { 0, Bytes(16) } }));
+		paths.erase(paths.begin() + 1);
+		patches.clear();
+		KetchupPatch::Compose(paths, none, patches, loaded);
+
+		want.clear();
+		for (size_t i = 0; i < mods.size(); ++i) {
+			if (i != 1) want = Expected(mods[i], std::move(want));
+		}
+		CHECK(patches == want);
+		CHECK(loaded.size() == mods.size() - 1);
+	}
+
+	void Reordered()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+
+		Records a = { { 0x100, std::vector<unsigned char>(0x10, 0xAA) } };
+		Records b = { { 0x108, std::vector<unsigned char>(0x10, 0xBB) } };
+		Write(g_root / "a.ppf", PPF3(a));
+		Write(g_root / "b.ppf", PPF3(b));
+
+		KetchupSource none;
+		std::map<std::filesystem::path, Ketchup_Patches> loaded;
+		Ketchup_Patches patches;
+		KetchupPatch::Compose(KetchupPatch::LoadOrder(g_root), none, patches, loaded);
+		CHECK(patches == Expected(b, Expected(a)));
+
+		{
+			std::ofstream file(g_root / KetchupPatch::LoadOrderFile);
+			file << "b.ppf\n";
+		}
+		patches.clear();
+		KetchupPatch::Compose(KetchupPatch::LoadOrder(g_root), none, patches, loaded);
+		CHECK(patches == Expected(a, Expected(b)));
+	}
+}
+
+int main()
+{
+	LoadOrder();
+	LaterWins();
+	Reordered();
+	return g_failures != 0;
+}
@@ -0,0 +1,159 @@
+#include "ketchupfingerprint.h"
+#include "ketchupmods.h"
+#include "check.h"
+
+namespace {
+	const std::filesystem::path g_root = "ketchupfingerprint";
+	const std::filesystem::path g_image = g_root / "image.bin";
+	const std::filesystem::path g_cache = g_root / KetchupFingerprint::CacheFile;
+
+	void Compute()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+
+		// Across more than one chunk, and ending part way into the last.
+		auto image = Bytes(0x900123);
+		Write(g_image, image);
+		KetchupSource source(g_image);
+		CHECK(KetchupFingerprint::Compute(source, image.size()) == KetchupPatch::CRC32(image.data(), image.size()));
+		CHECK(KetchupFingerprint::Compute(source, 0x400000) == KetchupPatch::CRC32(image.data(), 0x400000));
+		CHECK(KetchupFingerprint::Compute(source, 0) == 0u);
+
+		KetchupSource none;
+		CHECK(!KetchupFingerprint::Compute(none, 0x10));
+
+		// Without a fingerprint started, the image is read through on asking.
+		CHECK(source.CRC32() == KetchupPatch::CRC32(image.data(), image.size()));
+		CHECK(!none.CRC32());
+	}
+
+	void Cache()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+
+		auto image = Bytes(0x10000);
+		Write(g_image, image);
+		uint32_t crc = KetchupPatch::CRC32(image.data(), image.size());
+
+		CHECK(KetchupFingerprint(g_image, g_cache).CRC32() == crc);
+		CHECK(std::filesystem::exists(g_cache));
+
+		// Remembered, so what the cache says is taken as is.
+		auto remembered = [](uint32_t crc) {
+			std::ifstream in(g_cache);
+			auto index = nlohmann::json::parse(in);
+			index["images"][std::filesystem::absolute(g_image).string()][2] = crc;
+			std::ofstream out(g_cache, std::ios::trunc);
+			out << index.dump();
+		};
+		remembered(0x12345678);
+		CHECK(KetchupFingerprint(g_image, g_cache).CRC32() == 0x12345678u);
+
+		KetchupSource source(g_image);
+		source.Fingerprint(g_cache);
+		CHECK(source.CRC32() == 0x12345678u);
+
+		// Changed, it's worked out again and remembered anew.
+		auto time = std::filesystem::last_write_time(g_image);
+		image[0] ^= 0xFF;
+		Write(g_image, image);
+		std::filesystem::last_write_time(g_image, time + std::chrono::seconds(10));
+		crc = KetchupPatch::CRC32(image.data(), image.size());
+		CHECK(KetchupFingerprint(g_image, g_cache).CRC32() == crc);
+		CHECK(KetchupFingerprint(g_image, g_cache).CRC32() == crc);
+
+		// As is one that's grown.
+		image.push_back(0);
+		Write(g_image, image);
+		std::filesystem::last_write_time(g_image, time + std::chrono::seconds(10));
+		CHECK(KetchupFingerprint(g_image, g_cache).CRC32() == KetchupPatch::CRC32(image.data(), image.size()));
+
+		// Other images are kept alongside, and a broken cache is written again.
+		auto other = g_root / "other.bin";
+		Write(other, Bytes(0x100));
+		CHECK(KetchupFingerprint(other, g_cache).CRC32().has_value());
+		remembered(0x12345678);
+		CHECK(KetchupFingerprint(g_image, g_cache).CRC32() == 0x12345678u);
+
+		Write(g_cache, Bytes(100));
+		CHECK(KetchupFingerprint(g_image, g_cache).CRC32() == KetchupPatch::CRC32(image.data(), image.size()));
+		remembered(0x12345678);
+		CHECK(KetchupFingerprint(g_image, g_cache).CRC32() == 0x12345678u);
+
+		CHECK(!KetchupFingerprint(g_root / "missing.bin", g_cache).CRC32());
+
+		// Let go of before it's asked for, it's stopped and what's remembered still holds.
+		std::filesystem::remove(g_cache);
+		auto large = g_root / "large.bin";
+		Write(large, Bytes(0x2000000));
+		for (int i = 0; i < 4; ++i) KetchupFingerprint(large, g_cache);
+		KetchupSource whole(large);
+		CHECK(KetchupFingerprint(large, g_cache).CRC32() == whole.CRC32());
+	}
+
+	void Check()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+
+		auto image = Bytes(0x10000);
+		auto swapped = image;
+		swapped[0x9320 + 0x200] ^= 0xFF;
+		Write(g_image, image);
+		Write(g_root / "swapped.bin", swapped);
+		KetchupSource source(g_image);
+		KetchupSource other(g_root / "swapped.bin");
+		KetchupSource none;
+
+		// PPF3's validation block against the image's bytes at 0x9320.
+		std::vector<unsigned char> block(image.begin() + 0x9320, image.begin() + 0x9320 + 1024);
+		auto path = g_root / "block.ppf";
+		auto records = RandomRecords(20);
+		Write(path, PPF3(records, false, block));
+
+		Ketchup_Patches patches;
+		CHECK(KetchupPatch::Load(path, source, patches));
+		CHECK(patches == Expected(records));
+
+		// Checked again when loaded from its index, and passed without an image.
+		patches.clear();
+		CHECK(!KetchupPatch::Load(path, other, patches));
+		CHECK(patches.empty());
+		CHECK(KetchupPatch::Load(path, none, patches));
+		CHECK(patches == Expected(records));
+
+		// UPS & BPS are checked by the image's size & CRC-32.
+		auto target = image;
+		for (size_t i = 0; i < target.size(); i += 0x101) target[i] ^= 0x5A;
+		path = g_root / "image.ups";
+		Write(path, UPS(image, target));
+		patches.clear();
+		CHECK(KetchupPatch::Load(path, source, patches));
+		CHECK(Apply(image, patches) == target);
+		patches.clear();
+		CHECK(!KetchupPatch::Load(path, other, patches));
+
+		KetchupPatch::Checks checks = { KetchupPatch::CheckImage, KetchupPatch::CRC32(image.data(), image.size()), image.size() };
+		CHECK(KetchupPatch::Check(checks, source));
+		CHECK(!KetchupPatch::Check(checks, other));
+		checks.size++;
+		CHECK(!KetchupPatch::Check(checks, source));
+		CHECK(KetchupPatch::Check(checks, none));
+
+		checks = { KetchupPatch::CheckBlock, 0, 0, 0x9320, KetchupPatch::Hash(block.data(), block.size()) };
+		CHECK(KetchupPatch::Check(checks, source));
+		CHECK(!KetchupPatch::Check(checks, other));
+		checks.block = 0x80A0;
+		CHECK(!KetchupPatch::Check(checks, source));
+	}
+}
+
+int main()
+{
+	Compute();
+	Cache();
+	Check();
+	return g_failures != 0;
+}
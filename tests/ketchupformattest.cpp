@@ -0,0 +1,253 @@
+#include "ketchuppatch.h"
+#include "ketchupmods.h"
+#include "check.h"
+
+namespace {
+	void PPF3Records()
+	{
+		KetchupSource none;
+		for (bool undo : { false, true }) {
+			for (std::string_view diz : { std::string_view(), std::string_view("Made for testing.") }) {
+				auto records = RandomRecords(100);
+				auto data = PPF3(records, undo, {}, diz);
+
+				Ketchup_Patches patches;
+				KetchupPatch::Checks checks;
+				CHECK(KetchupPatch::Parse(data.data(), data.size(), none, patches, checks));
+				CHECK(patches == Expected(records));
+				CHECK(checks.flags == 0);
+			}
+		}
+
+		// The validation block is kept to check the image against.
+		auto block = Bytes(1024);
+		auto data = PPF3({ { 0x20, Bytes(4) } }, false, block);
+		Ketchup_Patches patches;
+		KetchupPatch::Checks checks;
+		CHECK(KetchupPatch::Parse(data.data(), data.size(), none, patches, checks));
+		CHECK(checks.flags == KetchupPatch::CheckBlock);
+		CHECK(checks.block == 0x9320);
+		CHECK(checks.block_hash == KetchupPatch::Hash(block.data(), block.size()));
+	}
+
+	void PPF3Malformed()
+	{
+		KetchupSource none;
+		auto data = PPF3({ { 0x10, Bytes(16) }, { 0x40, Bytes(16) } }, false, {}, "DIZ");
+
+		auto parses = [&none](const std::vector<unsigned char> &data) {
+			Ketchup_Patches patches;
+			KetchupPatch::Checks checks;
+			return KetchupPatch::Parse(data.data(), data.size(), none, patches, checks);
+		};
+		CHECK(parses(data));
+
+		// Cut off in a record, or in the header.
+		auto cut = PPF3({ { 0x10, Bytes(16) } });
+		cut.pop_back();
+		CHECK(!parses(cut));
+		CHECK(!parses(std::vector<unsigned char>(data.begin(), data.begin() + 40)));
+
+		// Not PPF 3.0's encoding.
+		auto other = data;
+		other[5] = 1;
+		CHECK(!parses(other));
+
+		// A DIZ length running past the records.
+		auto diz = data;
+		diz[diz.size() - 2] = 0xFF;
+		CHECK(!parses(diz));
+
+		// Nothing is added from a file that doesn't parse.
+		Ketchup_Patches patches;
+		KetchupPatch::Checks checks;
+		CHECK(!KetchupPatch::Parse(cut.data(), cut.size(), none, patches, checks));
+		CHECK(patches.empty());
+	}
+
+	void IndexCache()
+	{
+		std::filesystem::create_directories("ketchupformat");
+		std::filesystem::path path = "ketchupformat/mod.ppf";
+		auto cache = path;
+		cache += KetchupPatch::IndexExtension;
+		std::filesystem::remove(cache);
+
+		auto records = RandomRecords(50);
+		Write(path, PPF3(records));
+
+		KetchupSource none;
+		Ketchup_Patches patches;
+		CHECK(KetchupPatch::Load(path, none, patches));
+		CHECK(patches == Expected(records));
+		CHECK(std::filesystem::exists(cache));
+
+		// Same size and time, so read from the index without parsing: a mod
+		// changed in place behind its back still loads as it was.
+		auto time = std::filesystem::last_write_time(path);
+		auto changed = records;
+		changed[0].second[0] ^= 0xFF;
+		Write(path, PPF3(changed));
+		std::filesystem::last_write_time(path, time);
+		patches.clear();
+		CHECK(KetchupPatch::Load(path, none, patches));
+		CHECK(patches == Expected(records));
+
+		// A new time with new contents is parsed again.
+		std::filesystem::last_write_time(path, time + std::chrono::seconds(10));
+		patches.clear();
+		CHECK(KetchupPatch::Load(path, none, patches));
+		CHECK(patches == Expected(changed));
+
+		// Only touched, the index is kept and brought up to date.
+		auto indexed = std::filesystem::last_write_time(cache);
+		std::filesystem::last_write_time(path, time + std::chrono::seconds(20));
+		patches.clear();
+		CHECK(KetchupPatch::Load(path, none, patches));
+		CHECK(patches == Expected(changed));
+		CHECK(std::filesystem::last_write_time(cache) >= indexed);
+
+		// A broken index is parsed past and written again.
+		Write(cache, Bytes(100));
+		patches.clear();
+		CHECK(KetchupPatch::Load(path, none, patches));
+		CHECK(patches == Expected(changed));
+		patches.clear();
+		std::filesystem::last_write_time(path, time + std::chrono::seconds(30));
+		CHECK(KetchupPatch::Load(path, none, patches));
+		CHECK(patches == Expected(changed));
+
+		// Not a mod at all.
+		Write(path, Bytes(100));
+		std::filesystem::last_write_time(path, time + std::chrono::seconds(40));
+		patches.clear();
+		CHECK(!KetchupPatch::Load(path, none, patches));
+		CHECK(!KetchupPatch::Load("ketchupformat/missing.ppf", none, patches));
+	}
+
+	const std::filesystem::path g_image = "ketchupformat/image.bin";
+
+	// Parses `data` against the image at `path`, false if it doesn't.
+	bool Parses(const std::vector<unsigned char> &data, const std::filesystem::path &path, Ketchup_Patches &patches)
+	{
+		KetchupSource source(path);
+		KetchupPatch::Checks checks;
+		patches.clear();
+		return KetchupPatch::Parse(data.data(), data.size(), source, patches, checks);
+	}
+
+	void IPSRecords()
+	{
+		auto records = RandomRecords(100, 0xFFFF00);
+		std::vector<Fill> fills = { { 0x10, 0x200, 0xAB }, { 0x20, 1, 0xCD } };
+		auto data = IPS(records, fills);
+
+		Ketchup_Patches patches;
+		CHECK(Parses(data, {}, patches));
+		Ketchup_Patches want = Expected(records);
+		for (auto &fill : fills) {
+			std::vector<unsigned char> bytes(fill.count, fill.value);
+			KetchupPatch::Coalesce(want, fill.offset, bytes.data(), bytes.size());
+		}
+		CHECK(patches == want);
+
+		// A truncated size after EOF is allowed, and ignored.
+		auto truncated = data;
+		Append(truncated, 0x123456, 3);
+		CHECK(Parses(truncated, {}, patches));
+		CHECK(patches == want);
+
+		// Cut off, or without EOF.
+		CHECK(!Parses(std::vector<unsigned char>(data.begin(), data.end() - 3), {}, patches));
+		CHECK(!Parses(std::vector<unsigned char>(data.begin(), data.end() - 5), {}, patches));
+		CHECK(patches.empty());
+	}
+
+	void UPSRecords()
+	{
+		auto image = Bytes(0x10000);
+		Write(g_image, image);
+
+		auto target = image;
+		for (auto &[offset, bytes] : RandomRecords(40, 0xFF00)) {
+			std::copy(bytes.begin(), bytes.end(), target.begin() + static_cast<ptrdiff_t>(offset));
+		}
+		target.back() = image.back();
+		auto data = UPS(image, target);
+
+		Ketchup_Patches patches;
+		CHECK(Parses(data, g_image, patches));
+		CHECK(Apply(image, patches) == target);
+
+		// A corrupt patch, one without its image, and one for another image.
+		auto corrupt = data;
+		corrupt[20] ^= 1;
+		CHECK(!Parses(corrupt, g_image, patches));
+		CHECK(!Parses(data, {}, patches));
+
+		auto other = image;
+		other[0] ^= 1;
+		Write("ketchupformat/other.bin", other);
+		CHECK(!Parses(data, "ketchupformat/other.bin", patches));
+	}
+
+	void BPSActions()
+	{
+		auto image = Bytes(0x10000);
+		Write(g_image, image);
+
+		// Every action, with copies back and forth and a repeating one.
+		std::vector<Action> actions = {
+			{ Action::SourceRead, 0x1000 },
+			{ Action::TargetRead, 0x100 },
+			{ Action::SourceCopy, 0x800, 0x8000 },
+			{ Action::SourceCopy, 0x200, -0x4000 },
+			{ Action::TargetCopy, 0x400, 0x10 },
+			{ Action::TargetRead, 1 },
+			{ Action::TargetCopy, 0x300, 0x1AEF },
+			{ Action::SourceCopy, 0x10000 - 0x2201, -0x4A00 + 0x2201 },
+		};
+		std::vector<unsigned char> target;
+		auto data = BPS(image, actions, target);
+		CHECK(target.size() == image.size());
+
+		Ketchup_Patches patches;
+		CHECK(Parses(data, g_image, patches));
+		CHECK(Apply(image, patches) == target);
+
+		// Copies from the image need it there.
+		CHECK(!Parses(data, {}, patches));
+
+		// Only keeping and replacing bytes applies without it.
+		std::vector<Action> simple = {
+			{ Action::SourceRead, 0x100 },
+			{ Action::TargetRead, 0x10 },
+			{ Action::TargetCopy, 0x20, 0x100 },
+			{ Action::SourceRead, 0x10000 - 0x130 },
+		};
+		data = BPS(image, simple, target);
+		CHECK(Parses(data, {}, patches));
+		CHECK(Apply(image, patches) == target);
+
+		auto corrupt = data;
+		corrupt[corrupt.size() - 5] ^= 1;
+		CHECK(!Parses(corrupt, g_image, patches));
+
+		auto other = image;
+		other[0] ^= 1;
+		Write("ketchupformat/other.bin", other);
+		data = BPS(image, actions, target);
+		CHECK(!Parses(data, "ketchupformat/other.bin", patches));
+	}
+}
+
+int main()
+{
+	PPF3Records();
+	PPF3Malformed();
+	IndexCache();
+	IPSRecords();
+	UPSRecords();
+	BPSActions();
+	return g_failures != 0;
+}
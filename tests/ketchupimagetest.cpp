@@ -0,0 +1,283 @@
+#include "ketchupimage.h"
+#include "ketchupsector.h"
+#include "ketchupmods.h"
+#include "check.h"
+
+#include <atomic>
+
+namespace {
+	constexpr uint32_t g_sectors = 400;
+	constexpr size_t g_frameSize = KetchupSector::Size + 96;
+	constexpr uint32_t g_hunkFrames = 4;
+
+	unsigned char BCD(uint32_t value)
+	{
+		return static_cast<unsigned char>((value / 10) << 4 | value % 10);
+	}
+
+	// Runs of Mode 1, Mode 2 Form 1 & Form 2 and unsynced sectors, with one
+	// hunk's worth of zeroes in the middle.
+	std::vector<unsigned char> Image()
+	{
+		std::vector<unsigned char> image(g_sectors * KetchupSector::Size);
+		for (uint32_t lba = 0; lba < g_sectors; ++lba) {
+			unsigned char *sector = image.data() + lba * KetchupSector::Size;
+			if (lba >= 100 && lba < 100 + g_hunkFrames) continue;
+
+			unsigned kind = (lba / 7) % 4;
+			if (kind == 3) {
+				auto bytes = Bytes(KetchupSector::Size);
+				std::copy(bytes.begin(), bytes.end(), sector);
+				continue;
+			}
+
+			std::copy_n(KetchupSector::Sync, sizeof(KetchupSector::Sync), sector);
+			uint32_t address = lba + 150;
+			sector[0xC] = BCD(address / 75 / 60);
+			sector[0xD] = BCD(address / 75 % 60);
+			sector[0xE] = BCD(address % 75);
+			sector[0xF] = kind == 0 ? 1 : 2;
+
+			auto data = Bytes(0x914);
+			if (kind == 0) {
+				std::copy_n(data.begin(), KetchupSector::DataSize, sector + 0x10);
+			}
+			else {
+				unsigned char subheader[4] = { 1, 0, static_cast<unsigned char>(kind == 2 ? 0x28 : 0x08), 0 };
+				std::copy_n(subheader, 4, sector + 0x10);
+				std::copy_n(subheader, 4, sector + 0x14);
+				std::copy_n(data.begin(), kind == 2 ? 0x914 : KetchupSector::DataSize, sector + 0x18);
+			}
+			KetchupSector::Regenerate(sector);
+		}
+		return image;
+	}
+
+	// A file held in memory, read as KetchupSource would, every read counted.
+	struct Stored
+	{
+		std::vector<unsigned char> data;
+		std::atomic<int> reads = 0;
+
+		explicit Stored(std::vector<unsigned char> data) : data(std::move(data)) {}
+
+		KetchupImage::Reader Reader()
+		{
+			return [this](uint64_t offset, unsigned char *out, size_t size) {
+				++reads;
+				if (offset > data.size() || size > data.size() - offset) return false;
+				std::copy_n(data.begin() + static_cast<ptrdiff_t>(offset), size, out);
+				return true;
+			};
+		}
+	};
+
+	// The ECM form of an image, as ecm makes it: each sector whose sync, EDC
+	// & ECC can be made again from the rest stored without them, Mode 2 ones
+	// after their sync & header as raw bytes, and anything else stored as is.
+	std::vector<unsigned char> ECM(const std::vector<unsigned char> &image)
+	{
+		std::vector<unsigned char> ecm = { 'E', 'C', 'M', 0 };
+		uint32_t type = 0, count = 0;
+		std::vector<unsigned char> stored;
+
+		auto flush = [&] {
+			if (!count) return;
+			uint32_t n = count - 1;
+			ecm.push_back(static_cast<unsigned char>((n & 0x1F) << 2 | type));
+			for (n >>= 5; n; n >>= 7) {
+				ecm.back() |= 0x80;
+				ecm.push_back(n & 0x7F);
+			}
+			ecm.insert(ecm.end(), stored.begin(), stored.end());
+			stored.clear();
+			count = 0;
+		};
+		auto add = [&](uint32_t as, const unsigned char *data, size_t size) {
+			if (as != type) flush();
+			type = as;
+			count += as == 0 ? static_cast<uint32_t>(size) : 1;
+			stored.insert(stored.end(), data, data + size);
+		};
+
+		size_t at = 0;
+		for (; at + KetchupSector::Size <= image.size(); at += KetchupSector::Size) {
+			const unsigned char *sector = image.data() + at;
+			unsigned char copy[KetchupSector::Size];
+			std::copy_n(sector, sizeof(copy), copy);
+
+			unsigned mode = KetchupSector::Synced(sector) ? KetchupSector::Mode(sector) : 0;
+			if (mode == 1) {
+				KetchupSector::Regenerate(copy, 1, false);
+				if (std::equal(copy, copy + sizeof(copy), sector)) {
+					add(1, sector + 0xC, 3);
+					stored.insert(stored.end(), sector + 0x10, sector + 0x810);
+					continue;
+				}
+			}
+			else if (mode == 2 && std::equal(sector + 0x10, sector + 0x14, sector + 0x14)) {
+				bool form2 = KetchupSector::Form2(sector);
+				KetchupSector::Regenerate(copy, 2, form2);
+				if (std::equal(copy + 0x10, copy + sizeof(copy), sector + 0x10)) {
+					add(0, sector, 0x10);
+					add(form2 ? 3 : 2, sector + 0x14, form2 ? 0x918 : 0x804);
+					continue;
+				}
+			}
+			add(0, sector, KetchupSector::Size);
+		}
+		if (at < image.size()) add(0, image.data() + at, image.size() - at);
+		flush();
+
+		// The end, then the EDC of the whole image.
+		for (unsigned char byte : { 0xFC, 0xFF, 0xFF, 0xFF, 0x3F }) ecm.push_back(byte);
+		uint32_t edc = KetchupSector::EDC(image.data(), image.size());
+		for (int i = 0; i < 4; ++i) ecm.push_back(static_cast<unsigned char>(edc >> (i * 8)));
+		return ecm;
+	}
+
+	void Big(std::vector<unsigned char> &data, size_t at, uint64_t value, size_t size)
+	{
+		for (size_t i = 0; i < size; ++i) data[at + i] = static_cast<unsigned char>(value >> ((size - 1 - i) * 8));
+	}
+
+	// An uncompressed CHD v5 of the image, each frame a sector and subcode,
+	// and hunks of nothing but zeroes left out of the file.
+	std::vector<unsigned char> CHD(const std::vector<unsigned char> &image)
+	{
+		uint32_t frames = static_cast<uint32_t>(image.size() / KetchupSector::Size);
+		uint32_t hunkBytes = g_hunkFrames * g_frameSize;
+		uint32_t hunks = (frames + g_hunkFrames - 1) / g_hunkFrames;
+
+		std::vector<unsigned char> chd(124 + hunks * 4);
+		std::copy_n("MComprHD", 8, chd.begin());
+		Big(chd, 8, 124, 4);
+		Big(chd, 12, 5, 4);
+		Big(chd, 32, static_cast<uint64_t>(frames) * g_frameSize, 8);
+		Big(chd, 40, 124, 8);
+		Big(chd, 56, hunkBytes, 4);
+		Big(chd, 60, g_frameSize, 4);
+		chd.resize((chd.size() + hunkBytes - 1) / hunkBytes * hunkBytes);
+
+		for (uint32_t hunk = 0; hunk < hunks; ++hunk) {
+			std::vector<unsigned char> data(hunkBytes);
+			for (uint32_t i = 0; i < g_hunkFrames && hunk * g_hunkFrames + i < frames; ++i) {
+				auto sector = image.begin() + static_cast<ptrdiff_t>((hunk * g_hunkFrames + i) * KetchupSector::Size);
+				if (std::all_of(sector, sector + KetchupSector::Size, [](unsigned char c) { return c == 0; })) continue;
+				std::copy_n(sector, KetchupSector::Size, data.begin() + i * g_frameSize);
+				auto subcode = Bytes(96);
+				std::copy(subcode.begin(), subcode.end(), data.begin() + i * g_frameSize + KetchupSector::Size);
+			}
+			if (std::all_of(data.begin(), data.end(), [](unsigned char c) { return c == 0; })) continue;
+
+			Big(chd, 124 + hunk * 4, chd.size() / hunkBytes, 4);
+			chd.insert(chd.end(), data.begin(), data.end());
+		}
+		return chd;
+	}
+
+	// Read back in runs that don't line up with sectors, then from anywhere,
+	// across the end too, it's the image it was made from.
+	void Matches(const KetchupImage &decoded, const std::vector<unsigned char> &image)
+	{
+		CHECK(decoded.Size() == image.size());
+
+		std::vector<unsigned char> read(image.size());
+		for (size_t at = 0; at < image.size(); at += 0x1234) {
+			size_t size = std::min<size_t>(0x1234, image.size() - at);
+			CHECK(decoded.Read(at, read.data() + at, size));
+		}
+		CHECK(read == image);
+
+		std::vector<unsigned char> buffer(3 * KetchupSector::Size + 0x100);
+		for (int i = 0; i < 500; ++i) {
+			uint64_t offset = g_random() % (image.size() + 0x100);
+			size_t size = g_random() % buffer.size();
+			std::fill(buffer.begin(), buffer.end(), 0xAA);
+			CHECK(decoded.Read(offset, buffer.data(), size));
+
+			size_t inside = offset < image.size() ? static_cast<size_t>(std::min<uint64_t>(size, image.size() - offset)) : 0;
+			CHECK(std::equal(buffer.begin(), buffer.begin() + inside, image.begin() + static_cast<ptrdiff_t>(std::min<uint64_t>(offset, image.size()))));
+			CHECK(std::all_of(buffer.begin() + inside, buffer.begin() + size, [](unsigned char c) { return c == 0; }));
+		}
+	}
+
+	void ECMImage()
+	{
+		// With a tail that isn't a whole sector.
+		auto image = Image();
+		auto tail = Bytes(100);
+		image.insert(image.end(), tail.begin(), tail.end());
+
+		Stored stored(ECM(image));
+		CHECK(stored.data.size() < image.size());
+
+		std::unique_ptr<KetchupImage> decoded;
+		CHECK(KetchupImage::Open(stored.Reader(), stored.data.size(), decoded));
+		CHECK(decoded && dynamic_cast<KetchupECM *>(decoded.get()));
+		if (!decoded) return;
+
+		// Indexed in a read or two, not one per record.
+		CHECK(stored.reads <= 3);
+		Matches(*decoded, image);
+
+		// Cut short, or without its end, it's damaged.
+		for (size_t cut : { size_t(5), stored.data.size() / 2, stored.data.size() - 9, stored.data.size() - 2 }) {
+			Stored shorter(std::vector<unsigned char>(stored.data.begin(), stored.data.begin() + static_cast<ptrdiff_t>(cut)));
+			CHECK(!KetchupImage::Open(shorter.Reader(), shorter.data.size(), decoded));
+			CHECK(!decoded);
+		}
+	}
+
+	void CHDImage()
+	{
+		auto image = Image();
+		Stored stored(CHD(image));
+
+		// A hunk for the header & map, and none for the zeroed one.
+		uint32_t hunks = (g_sectors + g_hunkFrames - 1) / g_hunkFrames;
+		CHECK(stored.data.size() == hunks * g_hunkFrames * g_frameSize);
+
+		std::unique_ptr<KetchupImage> decoded;
+		CHECK(KetchupImage::Open(stored.Reader(), stored.data.size(), decoded));
+		CHECK(decoded && dynamic_cast<KetchupCHD *>(decoded.get()));
+		if (decoded) Matches(*decoded, image);
+
+		// Compressed, with a parent, or mapped past its end, it can't be read.
+		auto refused = [&](size_t at, unsigned char value) {
+			Stored changed(stored.data);
+			changed.data[at] = value;
+			CHECK(!KetchupImage::Open(changed.Reader(), changed.data.size(), decoded));
+			CHECK(!decoded);
+		};
+		refused(19, 1);
+		refused(110, 1);
+		refused(124, 0x7F);
+		refused(12 + 3, 4);
+
+		// Nor can one cut short.
+		Stored shorter(std::vector<unsigned char>(stored.data.begin(), stored.data.end() - 1));
+		CHECK(!KetchupImage::Open(shorter.Reader(), shorter.data.size(), decoded));
+	}
+
+	void RawImage()
+	{
+		// Anything else is read as it's stored.
+		std::unique_ptr<KetchupImage> decoded = std::make_unique<KetchupECM>(nullptr, 0);
+		Stored raw(Image());
+		CHECK(KetchupImage::Open(raw.Reader(), raw.data.size(), decoded));
+		CHECK(!decoded);
+
+		Stored tiny(std::vector<unsigned char> { 'E', 'C', 'M' });
+		CHECK(KetchupImage::Open(tiny.Reader(), tiny.data.size(), decoded));
+		CHECK(!decoded);
+	}
+}
+
+int main()
+{
+	ECMImage();
+	CHDImage();
+	RawImage();
+	return g_failures != 0;
+}
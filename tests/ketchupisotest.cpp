@@ -0,0 +1,368 @@
+#include "ketchupiso.h"
+#include "ketchupsector.h"
+#include "ketchupmods.h"
+#include "check.h"
+
+namespace {
+	const std::filesystem::path g_root = "ketchupiso";
+	const std::filesystem::path g_image = g_root / "image.bin";
+
+	// A raw Mode 2 image, every sector Form 1 unless asked, with its header
+	// timed from the start of the disc as mastering would.
+	struct Disc
+	{
+		std::vector<unsigned char> raw;
+
+		explicit Disc(uint32_t sectors) : raw(sectors * KetchupSector::Size)
+		{
+			for (uint32_t lba = 0; lba < sectors; ++lba) Header(lba, 2, false);
+		}
+
+		unsigned char *Sector(uint32_t lba) { return raw.data() + lba * KetchupSector::Size; }
+		unsigned char *Data(uint32_t lba) { return Sector(lba) + 0x18; }
+
+		void Header(uint32_t lba, unsigned mode, bool form2)
+		{
+			static constexpr unsigned char sync[12] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+			unsigned char *sector = Sector(lba);
+			std::memcpy(sector, sync, sizeof(sync));
+
+			uint32_t frames = lba + 150;
+			unsigned msf[3] = { frames / 75 / 60, frames / 75 % 60, frames % 75 };
+			for (int i = 0; i < 3; ++i) sector[0xC + i] = static_cast<unsigned char>((msf[i] / 10) << 4 | msf[i] % 10);
+			sector[0xF] = static_cast<unsigned char>(mode);
+
+			std::memset(sector + 0x10, 0, 8);
+			sector[0x12] = sector[0x16] = form2 ? 0x20 : 0x08;
+		}
+
+		void Seal()
+		{
+			for (size_t at = 0; at < raw.size(); at += KetchupSector::Size) KetchupSector::Regenerate(raw.data() + at);
+		}
+	};
+
+	// Both-endian, as ISO9660 records its numbers.
+	void Both(unsigned char *data, uint32_t value)
+	{
+		for (int i = 0; i < 4; ++i) {
+			data[i] = static_cast<unsigned char>(value >> (i * 8));
+			data[7 - i] = data[i];
+		}
+	}
+
+	// A directory record at `pos`, giving where the next one goes.
+	size_t Record(unsigned char *data, size_t pos, std::string_view name, uint32_t lba, uint32_t size, bool directory = false)
+	{
+		unsigned char *record = data + pos;
+		size_t length = (33 + name.size() + 1) & ~size_t(1);
+		record[0] = static_cast<unsigned char>(length);
+		Both(record + 2, lba);
+		Both(record + 10, size);
+		record[25] = directory ? 0x02 : 0x00;
+		record[32] = static_cast<unsigned char>(name.size());
+		std::memcpy(record + 33, name.data(), name.size());
+		return pos + length;
+	}
+
+	// The volume descriptors at 16 & 17, the root at 18 with README.TXT at
+	// 20, and DIR at 19 with FILE.BIN across 21 & 22 and STREAM.XA in the
+	// Form 2 sector 23.
+	struct Files
+	{
+		std::vector<unsigned char> readme = Bytes(100);
+		std::vector<unsigned char> file = Bytes(0x1000);
+	};
+
+	Disc Layout(const Files &files)
+	{
+		Disc disc(25);
+
+		unsigned char *primary = disc.Data(16);
+		primary[0] = 1;
+		std::memcpy(primary + 1, "CD001", 5);
+		primary[6] = 1;
+		Record(primary, 156, std::string_view("\0", 1), 18, 0x800, true);
+
+		unsigned char *terminator = disc.Data(17);
+		terminator[0] = 0xFF;
+		std::memcpy(terminator + 1, "CD001", 5);
+		terminator[6] = 1;
+
+		size_t pos = Record(disc.Data(18), 0, std::string_view("\0", 1), 18, 0x800, true);
+		pos = Record(disc.Data(18), pos, "\1", 18, 0x800, true);
+		pos = Record(disc.Data(18), pos, "DIR", 19, 0x800, true);
+		Record(disc.Data(18), pos, "README.TXT;1", 20, static_cast<uint32_t>(files.readme.size()));
+
+		pos = Record(disc.Data(19), 0, std::string_view("\0", 1), 19, 0x800, true);
+		pos = Record(disc.Data(19), pos, "\1", 18, 0x800, true);
+		pos = Record(disc.Data(19), pos, "FILE.BIN;1", 21, static_cast<uint32_t>(files.file.size()));
+		Record(disc.Data(19), pos, "STREAM.XA;1", 23, 0x800);
+
+		std::copy(files.readme.begin(), files.readme.end(), disc.Data(20));
+		std::copy(files.file.begin(), files.file.begin() + 0x800, disc.Data(21));
+		std::copy(files.file.begin() + 0x800, files.file.end(), disc.Data(22));
+		disc.Header(23, 2, true);
+
+		disc.Seal();
+		return disc;
+	}
+
+	void Sectors()
+	{
+		Disc disc(2);
+		unsigned char *sector = disc.Sector(0);
+		CHECK(KetchupSector::Synced(sector));
+		CHECK(KetchupSector::Mode(sector) == 2);
+		CHECK(!KetchupSector::Form2(sector));
+		CHECK(KetchupSector::DataOffset(sector) == 0x18);
+
+		disc.Header(1, 2, true);
+		CHECK(KetchupSector::Form2(disc.Sector(1)));
+		disc.Header(1, 1, false);
+		CHECK(!KetchupSector::Form2(disc.Sector(1)));
+		CHECK(KetchupSector::DataOffset(disc.Sector(1)) == 0x10);
+		disc.Header(1, 0, false);
+		CHECK(KetchupSector::DataOffset(disc.Sector(1)) == 0);
+		disc.Header(1, 2, false);
+		disc.Sector(1)[5] = 0;
+		CHECK(!KetchupSector::Synced(disc.Sector(1)));
+		CHECK(KetchupSector::DataOffset(disc.Sector(1)) == 0);
+
+		// CRC-32/CD-ROM-EDC's check value.
+		CHECK(KetchupSector::EDC(reinterpret_cast<const unsigned char *>("123456789"), 9) == 0x6EC2EDC4);
+		CHECK(KetchupSector::EDC(reinterpret_cast<const unsigned char *>("56789"), 5,
+			KetchupSector::EDC(reinterpret_cast<const unsigned char *>("1234"), 4)) == 0x6EC2EDC4);
+	}
+
+	void Regenerate()
+	{
+		for (auto [mode, form2] : { std::pair(1u, false), std::pair(2u, false), std::pair(2u, true) }) {
+			Disc disc(2);
+			disc.Header(0, mode, form2);
+			disc.Header(1, mode, form2);
+			size_t start = KetchupSector::DataOffset(disc.Sector(0));
+			size_t end = form2 ? 0x92C : start + KetchupSector::DataSize;
+			auto data = Bytes(end - start);
+			std::copy(data.begin(), data.end(), disc.Sector(0) + start);
+			KetchupSector::Regenerate(disc.Sector(0));
+			std::vector<unsigned char> sealed(disc.Sector(0), disc.Sector(1));
+
+			// Sealed again, nothing changes.
+			KetchupSector::Regenerate(disc.Sector(0));
+			CHECK(std::equal(sealed.begin(), sealed.end(), disc.Sector(0)));
+
+			// Changed, everything after the data changes with it.
+			disc.Sector(0)[start + 0x100] ^= 0x5A;
+			KetchupSector::Regenerate(disc.Sector(0));
+			CHECK(!std::equal(sealed.begin() + static_cast<ptrdiff_t>(end), sealed.end(), disc.Sector(0) + end));
+
+			// Changed back, or built afresh, it's as it was.
+			disc.Sector(0)[start + 0x100] ^= 0x5A;
+			KetchupSector::Regenerate(disc.Sector(0));
+			CHECK(std::equal(sealed.begin(), sealed.end(), disc.Sector(0)));
+
+			std::copy_n(disc.Sector(0), start, disc.Sector(1));
+			std::copy(data.begin(), data.end(), disc.Sector(1) + start);
+			KetchupSector::Regenerate(disc.Sector(1));
+			CHECK(std::equal(sealed.begin(), sealed.end(), disc.Sector(1)));
+
+			// Only Mode 1 covers the header with its ECC.
+			disc.Sector(1)[0xC] ^= 0x01;
+			KetchupSector::Regenerate(disc.Sector(1));
+			bool same = std::equal(sealed.begin() + 0x10, sealed.end(), disc.Sector(1) + 0x10);
+			CHECK(same == (mode == 2));
+		}
+	}
+
+	void Index()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+
+		Files files;
+		Disc disc = Layout(files);
+		Write(g_image, disc.raw);
+		KetchupSource source(g_image);
+
+		auto cache = g_root / KetchupISO::IndexFile;
+		KetchupISO iso;
+		CHECK(iso.Load(source, cache));
+		CHECK(std::filesystem::exists(cache));
+
+		auto *file = iso.Find("DIR/FILE.BIN");
+		CHECK(file && file->lba == 21 && file->size == 0x1000 && file->record == 19);
+		CHECK(file && std::memcmp(disc.Data(19) + file->at + 33, "FILE.BIN;1", 10) == 0);
+		CHECK(iso.Find("dir\\file.bin;1") == file);
+		CHECK(iso.Find("/DIR//FILE.BIN") == file);
+
+		auto *readme = iso.Find("README.TXT");
+		CHECK(readme && readme->lba == 20 && readme->size == 100 && readme->record == 18);
+		CHECK(iso.Find("DIR/STREAM.XA") != nullptr);
+		CHECK(!iso.Find("DIR"));
+		CHECK(!iso.Find("FILE.BIN"));
+
+		// The cache is taken as is while the image's descriptors are the same.
+		{
+			std::ifstream in(cache);
+			auto index = nlohmann::json::parse(in);
+			index["files"]["DIR/FILE.BIN"][0] = 99;
+			std::ofstream out(cache, std::ios::trunc);
+			out << index.dump();
+		}
+		KetchupISO cached;
+		CHECK(cached.Load(source, cache));
+		CHECK(cached.Find("DIR/FILE.BIN") && cached.Find("DIR/FILE.BIN")->lba == 99);
+
+		// A different image is walked again.
+		disc.raw.resize(disc.raw.size() + KetchupSector::Size);
+		Write(g_image, disc.raw);
+		KetchupSource grown(g_image);
+		KetchupISO rebuilt;
+		CHECK(rebuilt.Load(grown, cache));
+		CHECK(rebuilt.Find("DIR/FILE.BIN") && rebuilt.Find("DIR/FILE.BIN")->lba == 21);
+
+		// As is a cache that can't be read.
+		{
+			std::ofstream out(cache, std::ios::trunc);
+			out << "{ \"version\": 1,";
+		}
+		KetchupISO broken;
+		CHECK(broken.Load(grown, cache));
+		CHECK(broken.Find("DIR/FILE.BIN") && broken.Find("DIR/FILE.BIN")->lba == 21);
+	}
+
+	void Malformed()
+	{
+		Files files;
+		auto loads = [](Disc disc) {
+			disc.Seal();
+			Write(g_image, disc.raw);
+			KetchupSource source(g_image);
+			std::filesystem::remove(g_root / KetchupISO::IndexFile);
+			KetchupISO iso;
+			return iso.Load(source, g_root / KetchupISO::IndexFile);
+		};
+		CHECK(loads(Layout(files)));
+
+		Disc unnamed = Layout(files);
+		unnamed.Data(16)[1] = 'X';
+		CHECK(!loads(unnamed));
+
+		// Only a terminator, without a primary descriptor.
+		Disc terminated = Layout(files);
+		std::copy_n(terminated.Data(17), KetchupSector::DataSize, terminated.Data(16));
+		CHECK(!loads(terminated));
+
+		Disc shortRecord = Layout(files);
+		shortRecord.Data(19)[0] = 20;
+		CHECK(!loads(shortRecord));
+
+		Disc longName = Layout(files);
+		longName.Data(18)[32] = 0xF0;
+		CHECK(!loads(longName));
+
+		// Directories in Form 2 sectors can't be read.
+		Disc streamed = Layout(files);
+		streamed.Header(19, 2, true);
+		CHECK(!loads(streamed));
+
+		// Nor can an image that isn't there.
+		KetchupSource none;
+		KetchupISO iso;
+		CHECK(!iso.Load(none, g_root / KetchupISO::IndexFile));
+	}
+
+	// Each sector's EDC & ECC as they'd be made for its data now.
+	bool Sealed(std::vector<unsigned char> image)
+	{
+		auto sealed = image;
+		for (size_t at = 0; at < sealed.size(); at += KetchupSector::Size) KetchupSector::Regenerate(sealed.data() + at);
+		return sealed == image;
+	}
+
+	void Replace()
+	{
+		std::filesystem::remove_all(g_root);
+		auto mod = g_root / "mod";
+		std::filesystem::create_directories(mod / "DIR");
+
+		Files files;
+		Disc disc = Layout(files);
+		Write(g_image, disc.raw);
+		KetchupSource source(g_image);
+		auto cache = g_root / KetchupISO::IndexFile;
+
+		// The same size, only the file's sectors change.
+		auto file = Bytes(0x1000);
+		Write(mod / "DIR" / "FILE.BIN", file);
+		Ketchup_Patches patches;
+		KetchupISO::Replace(mod, source, cache, patches);
+		auto image = Apply(disc.raw, patches);
+		CHECK(image.size() == disc.raw.size());
+		CHECK(std::equal(file.begin(), file.begin() + 0x800, image.begin() + 21 * KetchupSector::Size + 0x18));
+		CHECK(std::equal(file.begin() + 0x800, file.end(), image.begin() + 22 * KetchupSector::Size + 0x18));
+		CHECK(std::all_of(patches.begin(), patches.end(), [](const auto &run) {
+			return run.first >= 21 * KetchupSector::Size && run.first + run.second.size() <= 23 * KetchupSector::Size;
+		}));
+		CHECK(Sealed(image));
+
+		// Smaller, with the rest of its sector zeroed and its size recorded.
+		auto readme = Bytes(50);
+		Write(mod / "README.TXT", readme);
+		patches.clear();
+		KetchupISO::Replace(mod, source, cache, patches);
+		image = Apply(disc.raw, patches);
+		const unsigned char *data = image.data() + 20 * KetchupSector::Size + 0x18;
+		CHECK(std::equal(readme.begin(), readme.end(), data));
+		CHECK(std::all_of(data + readme.size(), data + KetchupSector::DataSize, [](unsigned char byte) { return byte == 0; }));
+		CHECK(Sealed(image));
+
+		Write(g_root / "patched.bin", image);
+		KetchupSource patched(g_root / "patched.bin");
+		KetchupISO iso;
+		CHECK(iso.Load(patched, g_root / "patched.json"));
+		CHECK(iso.Find("README.TXT") && iso.Find("README.TXT")->size == 50);
+		CHECK(iso.Find("DIR/FILE.BIN") && iso.Find("DIR/FILE.BIN")->size == 0x1000);
+
+		// Up to the whole of the sectors it has, but no further.
+		std::filesystem::remove(mod / "README.TXT");
+		Write(mod / "DIR" / "FILE.BIN", Bytes(0x1001));
+		patches.clear();
+		KetchupISO::Replace(mod, source, cache, patches);
+		CHECK(patches.empty());
+
+		Write(mod / "DIR" / "FILE.BIN", Bytes(0x900));
+		patches.clear();
+		KetchupISO::Replace(mod, source, cache, patches);
+		image = Apply(disc.raw, patches);
+		CHECK(Sealed(image));
+		Write(g_root / "patched.bin", image);
+		KetchupSource shrunk(g_root / "patched.bin");
+		std::filesystem::remove(g_root / "patched.json");
+		CHECK(iso.Load(shrunk, g_root / "patched.json"));
+		CHECK(iso.Find("DIR/FILE.BIN") && iso.Find("DIR/FILE.BIN")->size == 0x900);
+
+		// Files that aren't on the disc, or lie in Form 2 sectors, are left be.
+		std::filesystem::remove(mod / "DIR" / "FILE.BIN");
+		Write(mod / "DIR" / "STREAM.XA", Bytes(0x800));
+		Write(mod / "MISSING.BIN", Bytes(0x10));
+		patches.clear();
+		KetchupISO::Replace(mod, source, cache, patches);
+		CHECK(patches.empty());
+
+		// As is everything without a folder to replace them from.
+		KetchupISO::Replace(g_root / "none", source, cache, patches);
+		CHECK(patches.empty());
+	}
+}
+
+int main()
+{
+	Sectors();
+	Regenerate();
+	Index();
+	Malformed();
+	Replace();
+	return g_failures != 0;
+}
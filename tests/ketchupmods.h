@@ -0,0 +1,209 @@
+#pragma once
+
+#include "ketchuppatch.h"
+
+#include <random>
+
+// Builds the mods the Ketchup tests load.
+
+inline std::mt19937 g_random(14);
+
+typedef std::vector<std::pair<uint64_t, std::vector<unsigned char>>> Records;
+
+inline std::vector<unsigned char> Bytes(size_t size)
+{
+	std::vector<unsigned char> bytes(size);
+	for (auto &byte : bytes) byte = static_cast<unsigned char>(g_random());
+	return bytes;
+}
+
+// Up to 255 bytes each, somewhere below `range`.
+inline Records RandomRecords(size_t count, uint64_t range = 0x10000)
+{
+	Records records;
+	for (size_t i = 0; i < count; ++i) records.push_back({ g_random() % range, Bytes(1 + g_random() % 0xFF) });
+	return records;
+}
+
+inline void Append(std::vector<unsigned char> &data, uint64_t value, size_t size)
+{
+	for (size_t i = 0; i < size; ++i) data.push_back(static_cast<unsigned char>(value >> (i * 8)));
+}
+
+// PPF 3.0, with undo data, a validation block or a FILE_ID.DIZ if asked.
+inline std::vector<unsigned char> PPF3(const Records &records, bool undo = false, const std::vector<unsigned char> &block = {}, std::string_view diz = {})
+{
+	std::vector<unsigned char> data(60, ' ');
+	std::memcpy(data.data(), "PPF30", 5);
+	data[5] = 2;
+	data[56] = 0;
+	data[57] = block.empty() ? 0 : 1;
+	data[58] = undo ? 1 : 0;
+	data[59] = 0;
+	for (unsigned char byte : block) data.push_back(byte);
+
+	for (auto &[offset, bytes] : records) {
+		Append(data, offset, 8);
+		data.push_back(static_cast<unsigned char>(bytes.size()));
+		std::copy(bytes.begin(), bytes.end(), std::back_inserter(data));
+		if (undo) data.insert(data.end(), bytes.size(), 0xEE);
+	}
+
+	if (!diz.empty()) {
+		for (std::string_view text : { std::string_view("@BEGIN_FILE_ID.DIZ"), diz, std::string_view("@END_FILE_ID.DIZ") }) {
+			data.insert(data.end(), text.begin(), text.end());
+		}
+		Append(data, diz.size(), 2);
+	}
+	return data;
+}
+
+inline void Write(const std::filesystem::path &path, const std::vector<unsigned char> &data)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char *>(data.data()), data.size());
+}
+
+// The runs the records make, written one after another onto `patches`.
+inline Ketchup_Patches Expected(const Records &records, Ketchup_Patches patches = {})
+{
+	for (auto &[offset, bytes] : records) KetchupPatch::Coalesce(patches, offset, bytes.data(), bytes.size());
+	return patches;
+}
+
+// The image with `patches` written on it.
+inline std::vector<unsigned char> Apply(std::vector<unsigned char> image, const Ketchup_Patches &patches)
+{
+	for (auto &[offset, run] : patches) {
+		if (image.size() < offset + run.size()) image.resize(static_cast<size_t>(offset + run.size()));
+		std::copy(run.begin(), run.end(), image.begin() + static_cast<ptrdiff_t>(offset));
+	}
+	return image;
+}
+
+// IPS records, and `count` bytes of `value` as run length records.
+struct Fill
+{
+	uint32_t offset;
+	uint16_t count;
+	unsigned char value;
+};
+
+inline std::vector<unsigned char> IPS(const Records &records, const std::vector<Fill> &fills = {})
+{
+	std::vector<unsigned char> data = { 'P', 'A', 'T', 'C', 'H' };
+	auto big = [&data](uint32_t value, size_t size) {
+		for (size_t i = size; i-- > 0;) data.push_back(static_cast<unsigned char>(value >> (i * 8)));
+	};
+	for (auto &[offset, bytes] : records) {
+		big(static_cast<uint32_t>(offset), 3);
+		big(static_cast<uint32_t>(bytes.size()), 2);
+		for (unsigned char byte : bytes) data.push_back(byte);
+	}
+	for (auto &fill : fills) {
+		big(fill.offset, 3);
+		big(0, 2);
+		big(fill.count, 2);
+		data.push_back(fill.value);
+	}
+	for (char c : { 'E', 'O', 'F' }) data.push_back(static_cast<unsigned char>(c));
+	return data;
+}
+
+// The variable length integers UPS & BPS share.
+inline void Number(std::vector<unsigned char> &data, uint64_t value)
+{
+	while (true) {
+		unsigned char x = value & 0x7F;
+		value >>= 7;
+		if (value == 0) {
+			data.push_back(0x80 | x);
+			return;
+		}
+		data.push_back(x);
+		value--;
+	}
+}
+
+// The source, target and patch CRC-32s that end UPS & BPS patches.
+inline void Footer(std::vector<unsigned char> &data, const std::vector<unsigned char> &source, const std::vector<unsigned char> &target)
+{
+	Append(data, KetchupPatch::CRC32(source.data(), source.size()), 4);
+	Append(data, KetchupPatch::CRC32(target.data(), target.size()), 4);
+	Append(data, KetchupPatch::CRC32(data.data(), data.size()), 4);
+}
+
+// From `source` to a `target` of the same size.
+inline std::vector<unsigned char> UPS(const std::vector<unsigned char> &source, const std::vector<unsigned char> &target)
+{
+	std::vector<unsigned char> data = { 'U', 'P', 'S', '1' };
+	Number(data, source.size());
+	Number(data, target.size());
+
+	size_t last = 0;
+	for (size_t pos = 0; pos < target.size();) {
+		if (source[pos] == target[pos]) {
+			pos++;
+			continue;
+		}
+		Number(data, pos - last);
+		for (; pos < target.size() && source[pos] != target[pos]; pos++) data.push_back(source[pos] ^ target[pos]);
+		data.push_back(0);
+		last = ++pos;
+	}
+
+	Footer(data, source, target);
+	return data;
+}
+
+struct Action
+{
+	enum Kind { SourceRead, TargetRead, SourceCopy, TargetCopy } kind;
+	uint64_t length;
+	// From where the last copy of the kind left off.
+	int64_t delta = 0;
+};
+
+// The actions in turn, each reading from `source`, or for TargetRead from
+// random bytes. The target they make comes back in `target`.
+inline std::vector<unsigned char> BPS(const std::vector<unsigned char> &source, const std::vector<Action> &actions, std::vector<unsigned char> &target)
+{
+	target.clear();
+	std::vector<unsigned char> body;
+	uint64_t source_offset = 0, target_offset = 0;
+	for (auto &action : actions) {
+		Number(body, ((action.length - 1) << 2) | action.kind);
+		switch (action.kind) {
+			case Action::SourceRead:
+				for (uint64_t i = 0; i < action.length; ++i) target.push_back(source[target.size()]);
+				break;
+			case Action::TargetRead:
+				for (unsigned char byte : Bytes(static_cast<size_t>(action.length))) {
+					body.push_back(byte);
+					target.push_back(byte);
+				}
+				break;
+			case Action::SourceCopy:
+			case Action::TargetCopy: {
+				uint64_t delta = action.delta < 0 ? ((0 - static_cast<uint64_t>(action.delta)) << 1) | 1 : static_cast<uint64_t>(action.delta) << 1;
+				Number(body, delta);
+				uint64_t &relative = action.kind == Action::SourceCopy ? source_offset : target_offset;
+				relative += action.delta;
+				for (uint64_t i = 0; i < action.length; ++i) {
+					target.push_back(action.kind == Action::SourceCopy ? source[relative] : target[relative]);
+					relative++;
+				}
+				break;
+			}
+		}
+	}
+
+	std::vector<unsigned char> data = { 'B', 'P', 'S', '1' };
+	Number(data, source.size());
+	Number(data, target.size());
+	Number(data, 5);
+	for (char c : { 'n', 'o', 't', 'e', 's' }) data.push_back(static_cast<unsigned char>(c));
+	data.insert(data.end(), body.begin(), body.end());
+	Footer(data, source, target);
+	return data;
+}
@@ -0,0 +1,168 @@
+#include "ketchupoverlay.h"
+#include "ketchupsector.h"
+#include "ketchupmods.h"
+#include "check.h"
+
+namespace {
+	const std::filesystem::path g_root = "ketchupoverlay";
+	const std::filesystem::path g_image = g_root / "image.bin";
+	const std::filesystem::path g_overlay = g_root / KetchupOverlay::OverlayFile;
+
+	constexpr uint32_t g_sectors = 300;
+
+	// Every sector as read through the overlay against the patched image.
+	bool Matches(const KetchupOverlay &overlay, const std::vector<unsigned char> &patched)
+	{
+		unsigned char sector[KetchupSector::Size];
+		for (uint32_t lba = 0; lba < g_sectors; ++lba) {
+			if (!overlay.Read(lba, sector)) return false;
+			if (std::memcmp(sector, patched.data() + lba * KetchupSector::Size, sizeof(sector)) != 0) return false;
+		}
+		return true;
+	}
+
+	// Sectors with a run in them, however little of it.
+	size_t Touched(const Ketchup_Patches &patches)
+	{
+		std::set<uint64_t> sectors;
+		for (auto &[offset, run] : patches) {
+			for (uint64_t lba = offset / KetchupSector::Size; lba <= (offset + run.size() - 1) / KetchupSector::Size; ++lba) sectors.insert(lba);
+		}
+		return sectors.size();
+	}
+
+	void Resolve()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+		auto image = Bytes(g_sectors * KetchupSector::Size);
+		Write(g_image, image);
+		KetchupSource source(g_image);
+
+		// Runs within a sector, across two, and neighbours sharing one.
+		Records records = RandomRecords(40, image.size() - 0x100);
+		records.push_back({ 5 * KetchupSector::Size - 10, Bytes(20) });
+		records.push_back({ 9 * KetchupSector::Size + 0x100, Bytes(0x10) });
+		records.push_back({ 9 * KetchupSector::Size + 0x200, Bytes(0x10) });
+		records.push_back({ 299 * KetchupSector::Size + KetchupSector::Size - 1, Bytes(1) });
+		auto patches = Expected(records);
+
+		KetchupOverlay overlay;
+		CHECK(!overlay.Valid());
+		CHECK(overlay.Open(g_overlay, source, patches));
+		CHECK(overlay.Valid());
+		CHECK(overlay.Sectors() == Touched(patches));
+		CHECK(Matches(overlay, Apply(image, patches)));
+
+		// Untouched sectors aren't in it, and are read from the image.
+		CHECK(overlay.Sector(5) && overlay.Sector(4) && overlay.Sector(299));
+		CHECK(!overlay.Sector(g_sectors));
+		for (uint32_t lba = 0; lba < g_sectors; ++lba) {
+			bool patched = false;
+			for (auto &[offset, run] : patches) {
+				patched |= offset < (lba + 1ull) * KetchupSector::Size && offset + run.size() > lba * KetchupSector::Size;
+			}
+			CHECK(!!overlay.Sector(lba) == patched);
+		}
+
+		// No patches at all, and it reads as the image.
+		KetchupOverlay empty;
+		CHECK(empty.Open(g_root / "empty.kovl", source, {}));
+		CHECK(empty.Sectors() == 0);
+		CHECK(Matches(empty, image));
+	}
+
+	void Rebuild()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+		auto image = Bytes(g_sectors * KetchupSector::Size);
+		Write(g_image, image);
+		KetchupSource source(g_image);
+		auto patches = Expected(RandomRecords(30, image.size() - 0x100));
+
+		{
+			KetchupOverlay overlay;
+			CHECK(overlay.Open(g_overlay, source, patches));
+		}
+		auto time = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+		std::filesystem::last_write_time(g_overlay, time);
+
+		// The same image & patches map what's there.
+		{
+			KetchupOverlay overlay;
+			CHECK(overlay.Open(g_overlay, source, patches));
+			CHECK(std::filesystem::last_write_time(g_overlay) == time);
+			CHECK(Matches(overlay, Apply(image, patches)));
+		}
+
+		// Other patches build it again, in place.
+		auto other = Expected(RandomRecords(30, image.size() - 0x100));
+		{
+			KetchupOverlay overlay;
+			CHECK(overlay.Open(g_overlay, source, other));
+			CHECK(std::filesystem::last_write_time(g_overlay) != time);
+			CHECK(Matches(overlay, Apply(image, other)));
+			CHECK(!std::filesystem::exists(g_root / "overlay.kovl.tmp"));
+		}
+
+		// As does one with its rank table broken, or cut short.
+		auto overlay = Bytes(0);
+		{
+			std::ifstream file(g_overlay, std::ios::binary);
+			overlay.assign(std::istreambuf_iterator<char>(file), {});
+		}
+		size_t words = (g_sectors + 63) / 64;
+		auto broken = overlay;
+		broken[32 + words * 8 + 4] ^= 1;
+		Write(g_overlay, broken);
+		{
+			KetchupOverlay reopened;
+			CHECK(reopened.Open(g_overlay, source, other));
+			CHECK(Matches(reopened, Apply(image, other)));
+		}
+
+		auto cut = overlay;
+		cut.pop_back();
+		Write(g_overlay, cut);
+		{
+			KetchupOverlay reopened;
+			CHECK(reopened.Open(g_overlay, source, other));
+			CHECK(Matches(reopened, Apply(image, other)));
+			CHECK(std::filesystem::file_size(g_overlay) == overlay.size());
+		}
+
+		// Or another image of the same size, different under a patch.
+		auto &[offset, run] = *other.begin();
+		uint64_t sector = offset / KetchupSector::Size * KetchupSector::Size;
+		image[offset != sector ? sector : offset + run.size()] ^= 0xFF;
+		Write(g_root / "other.bin", image);
+		KetchupSource changed(g_root / "other.bin");
+		Write(g_overlay, overlay);
+		{
+			KetchupOverlay reopened;
+			CHECK(reopened.Open(g_overlay, changed, other));
+			CHECK(Matches(reopened, Apply(image, other)));
+		}
+	}
+
+	void Skipped()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+		Write(g_root / "a.ppf", PPF3({}));
+		Write(g_overlay, Bytes(10));
+		Write(g_root / "overlay.kovl.tmp", Bytes(10));
+
+		// Overlays written alongside the mods aren't mods themselves.
+		CHECK(KetchupPatch::LoadOrder(g_root) == std::vector<std::filesystem::path>({ g_root / "a.ppf" }));
+	}
+}
+
+int main()
+{
+	Resolve();
+	Rebuild();
+	Skipped();
+	return g_failures != 0;
+}
@@ -0,0 +1,140 @@
+#include "ketchuppatch.h"
+#include "check.h"
+
+#include <random>
+
+namespace {
+	std::mt19937 g_random(13);
+
+	std::vector<unsigned char> Bytes(size_t size)
+	{
+		std::vector<unsigned char> bytes(size);
+		for (auto &byte : bytes) byte = static_cast<unsigned char>(g_random());
+		return bytes;
+	}
+
+	// Runs have to be disjoint, non-adjacent and non-empty.
+	bool Canonical(const Ketchup_Patches &patches)
+	{
+		uint64_t end = 0;
+		bool first = true;
+		for (auto &[offset, run] : patches) {
+			if (run.empty() || (!first && offset <= end)) return false;
+			end = offset + run.size();
+			first = false;
+		}
+		return true;
+	}
+
+	void CoalesceMatchesWrites()
+	{
+		for (int round = 0; round < 200; ++round) {
+			std::vector<int> image(0x2000, -1);
+			Ketchup_Patches patches;
+
+			// Overlapping, adjacent and disjoint records, in any order.
+			for (int i = 0; i < 50; ++i) {
+				size_t offset = g_random() % 0x1F00;
+				auto data = Bytes(1 + g_random() % 0xFF);
+				KetchupPatch::Coalesce(patches, offset, data.data(), data.size());
+				for (size_t j = 0; j < data.size(); ++j) image[offset + j] = data[j];
+			}
+			CHECK(Canonical(patches));
+
+			std::vector<int> coalesced(image.size(), -1);
+			for (auto &[offset, run] : patches) {
+				for (size_t j = 0; j < run.size(); ++j) coalesced[offset + j] = run[j];
+			}
+			CHECK(coalesced == image);
+		}
+	}
+
+	void CoalesceJoins()
+	{
+		unsigned char a[] = { 1, 2, 3 };
+		unsigned char b[] = { 4, 5 };
+		unsigned char c[] = { 6 };
+
+		Ketchup_Patches patches;
+		KetchupPatch::Coalesce(patches, 10, a, sizeof(a));
+		KetchupPatch::Coalesce(patches, 13, b, sizeof(b));
+		CHECK(patches.size() == 1);
+		CHECK(patches[10] == std::vector<unsigned char>({ 1, 2, 3, 4, 5 }));
+
+		// Bridging two runs, and records before a run.
+		KetchupPatch::Coalesce(patches, 20, a, sizeof(a));
+		KetchupPatch::Coalesce(patches, 15, a, sizeof(a));
+		KetchupPatch::Coalesce(patches, 18, b, sizeof(b));
+		KetchupPatch::Coalesce(patches, 9, c, sizeof(c));
+		CHECK(patches.size() == 1);
+		CHECK(patches[9] == std::vector<unsigned char>({ 6, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3 }));
+
+		KetchupPatch::Coalesce(patches, 100, c, 0);
+		CHECK(patches.size() == 1);
+	}
+
+	void ReadThroughRuns()
+	{
+		auto image = Bytes(0x1000);
+		{
+			std::ofstream file("ketchuppatch.bin", std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char *>(image.data()), image.size());
+		}
+		KetchupSource source("ketchuppatch.bin");
+		CHECK(source.Valid());
+		CHECK(source.Size() == image.size());
+
+		Ketchup_Patches runs;
+		auto data = Bytes(0x20);
+		KetchupPatch::Coalesce(runs, 0x100, data.data(), data.size());
+		KetchupPatch::Coalesce(runs, 0x200, data.data(), data.size());
+
+		std::vector<unsigned char> read(0x180);
+		CHECK(KetchupPatch::ReadTarget(runs, source, 0xF0, read.data(), read.size()));
+		auto want = image;
+		std::copy(data.begin(), data.end(), want.begin() + 0x100);
+		std::copy(data.begin(), data.end(), want.begin() + 0x200);
+		CHECK(std::equal(read.begin(), read.end(), want.begin() + 0xF0));
+
+		// Past the end reads as zeroes.
+		std::vector<unsigned char> tail(0x20, 0xAA);
+		CHECK(source.Read(0xFF0, tail.data(), tail.size()));
+		CHECK(std::equal(tail.begin(), tail.begin() + 0x10, image.begin() + 0xFF0));
+		CHECK(std::all_of(tail.begin() + 0x10, tail.end(), [](unsigned char byte) { return byte == 0; }));
+
+		// No image, only the runs.
+		KetchupSource missing("ketchuppatch.missing");
+		CHECK(!missing.Valid());
+		CHECK(!KetchupPatch::ReadTarget(runs, missing, 0x100, read.data(), 0x20));
+		CHECK(std::equal(data.begin(), data.end(), read.begin()));
+
+		CHECK(KetchupPatch::Covers(runs, 0x100, 0x20));
+		CHECK(KetchupPatch::Covers(runs, 0x108, 0x8));
+		CHECK(!KetchupPatch::Covers(runs, 0x100, 0x21));
+		CHECK(!KetchupPatch::Covers(runs, 0xFF, 0x2));
+		CHECK(!KetchupPatch::Covers(runs, 0x180, 0x1));
+	}
+
+	void CRC32()
+	{
+		const char text[] = "123456789";
+		auto data = reinterpret_cast<const unsigned char *>(text);
+		CHECK(KetchupPatch::CRC32(data, 9) == 0xCBF43926);
+
+		// In pieces as in one, whatever the alignment.
+		auto bytes = Bytes(1000);
+		uint32_t whole = KetchupPatch::CRC32(bytes.data(), bytes.size());
+		for (size_t split : { 1, 7, 8, 9, 500, 999 }) {
+			CHECK(KetchupPatch::CRC32(bytes.data() + split, bytes.size() - split, KetchupPatch::CRC32(bytes.data(), split)) == whole);
+		}
+	}
+}
+
+int main()
+{
+	CoalesceMatchesWrites();
+	CoalesceJoins();
+	ReadThroughRuns();
+	CRC32();
+	return g_failures != 0;
+}
@@ -0,0 +1,249 @@
+#include "ketchupreload.h"
+#include "ketchupiso.h"
+#include "ketchupoverlay.h"
+#include "ketchupwatch.h"
+#include "ketchupmods.h"
+#include "check.h"
+
+namespace {
+	const std::filesystem::path g_root = "ketchupreload";
+	const std::filesystem::path g_mods = g_root / "mods";
+	const std::filesystem::path g_image = g_root / "image.bin";
+
+	// Written with a time of its own, so a change shows on any clock.
+	void Save(const std::filesystem::path &path, const std::vector<unsigned char> &data)
+	{
+		static int tick = 0;
+		Write(path, data);
+		std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now() + std::chrono::seconds(++tick));
+	}
+
+	// The mods' records, each mod on top of those before it.
+	Ketchup_Patches Composed(std::initializer_list<const Records *> mods)
+	{
+		Ketchup_Patches patches;
+		for (auto *records : mods) patches = Expected(*records, std::move(patches));
+		return patches;
+	}
+
+	size_t Count(const Ketchup_Patches &patches)
+	{
+		size_t bytes = 0;
+		for (auto &[offset, run] : patches) bytes += run.size();
+		return bytes;
+	}
+
+	void Diff()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_root);
+		auto image = Bytes(0x40000);
+		Write(g_image, image);
+		KetchupSource source(g_image);
+
+		// Whatever was there before, the diff takes it to what's there after.
+		for (int round = 0; round < 300; ++round) {
+			Ketchup_Patches before = Expected(RandomRecords(20, 0x3F000));
+			Ketchup_Patches after = Expected(RandomRecords(5, 0x3F000), before);
+			for (auto it = after.begin(); it != after.end();) it = g_random() % 4 == 0 ? after.erase(it) : std::next(it);
+
+			auto diff = KetchupReload::Diff(before, after, {}, source);
+			CHECK(Apply(Apply(image, before), diff) == Apply(image, after));
+			CHECK(KetchupReload::Diff(after, after, {}, source).empty());
+		}
+
+		// Only the bytes that differ.
+		auto run = Bytes(100);
+		Ketchup_Patches before, after;
+		KetchupPatch::Coalesce(before, 0x100, run.data(), run.size());
+		run[10] ^= 0xFF;
+		run[11] ^= 0xFF;
+		run[50] ^= 0xFF;
+		KetchupPatch::Coalesce(after, 0x100, run.data(), run.size());
+		auto diff = KetchupReload::Diff(before, after, {}, source);
+		CHECK(diff.size() == 2 && Count(diff) == 3);
+
+		// Bytes no longer patched are set back from the image, or the game's
+		// patches on it, and can't be without either.
+		auto game = Bytes(40);
+		Ketchup_Patches builtin;
+		KetchupPatch::Coalesce(builtin, 0x110, game.data(), game.size());
+		diff = KetchupReload::Diff(before, {}, builtin, source);
+		CHECK(Apply(Apply(image, before), diff) == Apply(image, builtin));
+
+		KetchupSource none;
+		CHECK(KetchupReload::Diff(before, {}, builtin, none).empty());
+		CHECK(KetchupReload::Diff(before, {}, {}, none).empty());
+		auto whole = Bytes(100);
+		builtin.clear();
+		KetchupPatch::Coalesce(builtin, 0x100, whole.data(), whole.size());
+		diff = KetchupReload::Diff(before, {}, builtin, none);
+		CHECK(Apply(Apply(image, before), diff) == Apply(image, builtin));
+	}
+
+	void Update()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_mods);
+		auto image = Bytes(0x40000);
+		Write(g_image, image);
+		KetchupSource source(g_image);
+
+		Records a, b;
+		for (uint64_t i = 0; i < 200; ++i) a.push_back({ 0x1000 + i * 0x100, Bytes(64) });
+		for (uint64_t i = 0; i < 10; ++i) b.push_back({ 0x30000 + i * 0x80, Bytes(100) });
+		Records c = { { 0x1000 + 5 * 0x100 + 10, Bytes(20) } };
+		Save(g_mods / "a.ppf", PPF3(a));
+		Save(g_mods / "b.ppf", PPF3(b));
+
+		// The table the emulator reads the disc through, entered in order.
+		KetchupReload reload;
+		Ketchup_Patches patches;
+		reload.Update(g_mods, source, true, nullptr, patches);
+		auto table = Apply(image, patches);
+		auto want = Composed({ &a, &b });
+		CHECK(patches == want);
+		CHECK(reload.Applied() == want);
+
+		// Nothing changed, nothing to do unless the emulator let go of it all.
+		reload.Update(g_mods, source, false, nullptr, patches);
+		CHECK(patches.empty());
+		reload.Update(g_mods, source, true, nullptr, patches);
+		CHECK(patches == want);
+
+		// One record revised, its first byte the same as before.
+		a[17].second = Bytes(64);
+		a[17].second[0] = want[a[17].first][0];
+		Save(g_mods / "a.ppf", PPF3(a));
+		reload.Update(g_mods, source, false, nullptr, patches);
+		table = Apply(table, patches);
+		want = Composed({ &a, &b });
+		CHECK(table == Apply(image, want));
+		CHECK(Count(patches) != 0 && Count(patches) <= 63);
+
+		// A new mod over part of another, then a load order putting it first.
+		Save(g_mods / "c.ppf", PPF3(c));
+		reload.Update(g_mods, source, false, nullptr, patches);
+		table = Apply(table, patches);
+		CHECK(table == Apply(image, Composed({ &a, &b, &c })));
+		CHECK(Count(patches) != 0 && Count(patches) <= 20);
+
+		{
+			std::ofstream file(g_mods / KetchupPatch::LoadOrderFile);
+			file << "c.ppf\n";
+		}
+		reload.Update(g_mods, source, false, nullptr, patches);
+		table = Apply(table, patches);
+		CHECK(table == Apply(image, Composed({ &c, &a, &b })));
+		std::filesystem::remove(g_mods / KetchupPatch::LoadOrderFile);
+
+		// A removed mod's bytes are set back from the image.
+		std::filesystem::remove(g_mods / "b.ppf");
+		reload.Update(g_mods, source, false, nullptr, patches);
+		table = Apply(table, patches);
+		CHECK(table == Apply(image, Composed({ &a, &c })));
+
+		// One broken mid edit drops out, and comes back once it's fixed.
+		Save(g_mods / "c.ppf", { 'P', 'P', 'F', '3', '0' });
+		reload.Update(g_mods, source, false, nullptr, patches);
+		table = Apply(table, patches);
+		CHECK(table == Apply(image, Composed({ &a })));
+		Save(g_mods / "c.ppf", PPF3(c));
+		reload.Update(g_mods, source, false, nullptr, patches);
+		table = Apply(table, patches);
+		CHECK(table == Apply(image, Composed({ &a, &c })));
+
+		// The indexes written alongside them aren't changes.
+		CHECK(std::filesystem::exists(g_mods / "c.ppf.kidx"));
+		reload.Update(g_mods, source, false, nullptr, patches);
+		CHECK(patches.empty());
+
+		// The game's own patch under a mod comes back once the mod goes.
+		auto bytes = Bytes(40);
+		Ketchup_Patches game;
+		KetchupPatch::Coalesce(game, 0x1000 + 5 * 0x100, bytes.data(), bytes.size());
+		auto played = Apply(image, game);
+		table = Apply(played, reload.Applied());
+
+		int asked = 0;
+		auto builtin = [&](const Ketchup_Patches &, Ketchup_Patches &runs) {
+			++asked;
+			runs = game;
+		};
+		std::filesystem::remove(g_mods / "c.ppf");
+		reload.Update(g_mods, source, false, builtin, patches);
+		table = Apply(table, patches);
+		CHECK(asked == 1);
+		CHECK(table == Apply(played, Composed({ &a })));
+
+		// A folder that's gone sets everything back, then there's nothing to do.
+		std::filesystem::remove_all(g_mods);
+		reload.Update(g_mods, source, false, builtin, patches);
+		table = Apply(table, patches);
+		CHECK(table == played);
+		CHECK(reload.Applied().empty());
+		reload.Update(g_mods, source, false, builtin, patches);
+		CHECK(patches.empty());
+
+		// And it all comes back with the folder.
+		std::filesystem::create_directories(g_mods);
+		Save(g_mods / "a.ppf", PPF3(a));
+		reload.Update(g_mods, source, false, builtin, patches);
+		table = Apply(table, patches);
+		CHECK(table == Apply(played, Composed({ &a })));
+
+		// Another folder starts over with all of its mods.
+		auto other = g_root / "other";
+		std::filesystem::create_directories(other);
+		Save(other / "b.ppf", PPF3(b));
+		reload.Update(other, source, false, builtin, patches);
+		CHECK(patches == Composed({ &b }));
+	}
+
+	void Watch()
+	{
+		std::filesystem::remove_all(g_root);
+		std::filesystem::create_directories(g_mods / "folder");
+		Save(g_mods / "a.ppf", PPF3({}));
+		Save(g_mods / "folder" / "b.ppf", PPF3({}));
+
+		KetchupWatch watch(g_mods);
+		CHECK(watch.Root() == g_mods);
+		CHECK(watch.Poll().empty());
+
+		// Indexes, overlays and files written aside aren't mods.
+		Save(g_mods / "a.ppf.kidx", Bytes(10));
+		Save(g_mods / "a.ppf.kidx.tmp", Bytes(10));
+		Save(g_mods / KetchupISO::IndexFile, Bytes(10));
+		Save(g_mods / KetchupOverlay::OverlayFile, Bytes(10));
+		CHECK(watch.Poll().empty());
+
+		// Changed in time, size, or both.
+		Save(g_mods / "a.ppf", PPF3({}));
+		CHECK(watch.Poll() == std::vector<std::filesystem::path>({ g_mods / "a.ppf" }));
+		CHECK(watch.Poll().empty());
+
+		auto time = std::filesystem::last_write_time(g_mods / "folder" / "b.ppf");
+		Write(g_mods / "folder" / "b.ppf", PPF3({ { 0, Bytes(4) } }));
+		std::filesystem::last_write_time(g_mods / "folder" / "b.ppf", time);
+		CHECK(watch.Poll() == std::vector<std::filesystem::path>({ g_mods / "folder" / "b.ppf" }));
+
+		// Added and removed together.
+		Save(g_mods / "c.ppf", PPF3({}));
+		std::filesystem::remove(g_mods / "a.ppf");
+		CHECK(watch.Poll() == std::vector<std::filesystem::path>({ g_mods / "a.ppf", g_mods / "c.ppf" }));
+
+		// All of them once the folder's gone, then nothing.
+		std::filesystem::remove_all(g_mods);
+		CHECK(watch.Poll() == std::vector<std::filesystem::path>({ g_mods / "c.ppf", g_mods / "folder" / "b.ppf" }));
+		CHECK(watch.Poll().empty());
+	}
+}
+
+int main()
+{
+	Diff();
+	Update();
+	Watch();
+	return g_failures != 0;
+}
@@ -0,0 +1,440 @@
+#include "m2scan.h"
+#include "m2signature.h"
+#include "m2pe.h"
+#include "m2rampatches.h"
+#include "m2patchfilter.h"
+#include "m2ram.h"
+#include "m2interntable.h"
+#include "ketchupmods.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <string>
+#include <tuple>
+
+// Throughput of the parts of the fix that don't need the game, against what
+// they replaced where that can still be built here. Not run as a test, the
+// numbers only mean something on an idle machine in a release build.
+namespace {
+    const std::filesystem::path g_root = "m2benchdata";
+
+    volatile uintptr_t g_sink;
+
+    // The best of `rounds` runs, in seconds.
+    double Time(int rounds, const std::function<void()> & function)
+    {
+        double best = 1e30;
+        for (int round = 0; round < rounds; ++round) {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+
+    void Report(const char * name, double bytes, double seconds)
+    {
+        std::printf("%-44s %10.3f GB/s  %10.3f ms\n", name, bytes / seconds / 1e9, seconds * 1e3);
+    }
+
+    void Rate(const char * name, double count, double seconds, const char * unit)
+    {
+        std::printf("%-44s %10.3f M%s/s %9.3f ms\n", name, count / seconds / 1e6, unit, seconds * 1e3);
+    }
+
+    // Bytes about as often as in x86 code, the common ones an anchor avoids.
+    std::vector<unsigned char> Code(size_t size)
+    {
+        static constexpr unsigned char common[] = { 0x00, 0xFF, 0x8B, 0x48, 0x89, 0xE8, 0x24, 0x44, 0x0F, 0xCC, 0x4C, 0x85 };
+        std::vector<unsigned char> code(size);
+        for (auto & byte : code) {
+            auto r = g_random();
+            byte = r % 2 ? common[(r >> 8) % std::size(common)] : static_cast<unsigned char>(r >> 16);
+        }
+        return code;
+    }
+
+    // The scanner M2Hook used before M2Scan, CSGOSimple's.
+    std::vector<int> PatternToByte(const char * pattern)
+    {
+        auto bytes = std::vector<int> {};
+        auto start = const_cast<char *>(pattern);
+        auto end = const_cast<char *>(pattern) + strlen(pattern);
+
+        for (auto current = start; current < end; ++current) {
+            if (*current == '?') {
+                ++current;
+                if (*current == '?')
+                    ++current;
+                bytes.push_back(-1);
+            }
+            else {
+                bytes.push_back(strtoul(current, &current, 16));
+            }
+        }
+        return bytes;
+    }
+
+    unsigned char * PatternScanBuffer(void * buffer, size_t size, const char * signature)
+    {
+        auto patternBytes = PatternToByte(signature);
+        auto scanBytes = reinterpret_cast<unsigned char *>(buffer);
+
+        auto s = patternBytes.size();
+        auto d = patternBytes.data();
+
+        for (size_t i = 0; i < size - s; ++i) {
+            bool found = true;
+            for (size_t j = 0; j < s; ++j) {
+                if (scanBytes[i + j] != d[j] && d[j] != -1) {
+                    found = false;
+                    break;
+                }
+            }
+            if (found) {
+                return &scanBytes[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // Hook signatures from the fix, as it has them.
+    const char * const g_signatures[] = {
+        "48 89 5C 24 18 48 89 7C 24 20 41 56 48 83 EC 20 41 8B F8 44 8B F2 48 8B D9 48 85 C9 75 ?? 39 0D",
+        "53 55 56 8B F1 8B EA 57 85 F6 75 25 8B 74 24 14",
+        "C7 86 A4 00 00 00 FF FF FF FF 89 86 A0 00 00 00",
+        "FF D0 8B 4D 18 83 C4 04 FF 8E 98 00 00 00 C6 01",
+        "0F B6 44 24 20 83 C4 04 8B 4F 04 BA FD FF FF FF",
+        "8B 44 24 ?? 05 ?? ?? ?? ?? 83 F8 ?? 0F 87 ?? ?? ?? ?? 53",
+        "8B 44 24 ?? 48 83 F8 ?? 0F 87 ?? ?? ?? ?? FF 24 85 ?? ?? ?? ?? 8B 44 24",
+        "83 EC 08 53 55 56 8B 35 ?? ?? ?? ?? 8B DA 8B E9",
+        "8B 54 24 04 56 8B 74 24 0C 3B 72 3C 7C 20 81 7A",
+        "48 89 5C 24 18 48 89 74 24 20 57 48 83 EC 40 4D",
+        "48 83 EC 38 FF CA 4D 8B D8 4C 8B D1 83 FA 0A 0F",
+        "48 8B DA 48 8B F1 4D 85 C9 74 38 4C 8B 11 90 49",
+        "40 57 48 83 EC 20 8B FA 3B 51 78 7C 2E 48 8D 05",
+        "8B C1 C1 E8 1A 85 C0 75 15 85 C9 75 06 B8",
+        "4D 0F AF C1 4C 03 C0 49 C1 F8 10 41 81 F8 00 FC",
+        "C7 44 24 08 F3 5A 00 00 C7 44 24 0C 00 00 00 00",
+    };
+
+    // One signature over a module's worth of code, found at the end.
+    void Scanner()
+    {
+        auto code = Code(64 << 20);
+        auto pattern = PatternToByte(g_signatures[0]);
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            code[code.size() - pattern.size() + i] = static_cast<unsigned char>(pattern[i] < 0 ? 0x90 : pattern[i]);
+        }
+
+        Report("scan, CSGOSimple (before)", static_cast<double>(code.size()), Time(3, [&] {
+            g_sink = reinterpret_cast<uintptr_t>(PatternScanBuffer(code.data(), code.size(), g_signatures[0]));
+        }));
+        Report("scan, M2Scan::Find", static_cast<double>(code.size()), Time(5, [&] {
+            g_sink = reinterpret_cast<uintptr_t>(M2Scan::Find(code.data(), code.size(), pattern.data(), pattern.size()));
+        }));
+    }
+
+    // Every signature of a module, one at a time or in one pass.
+    void Batch()
+    {
+        auto code = Code(64 << 20);
+        std::vector<std::vector<int>> patterns;
+        for (auto text : g_signatures) patterns.push_back(PatternToByte(text));
+
+        double bytes = static_cast<double>(code.size()) * patterns.size();
+        Report("16 signatures, M2Scan::Find each", bytes, Time(3, [&] {
+            for (auto & pattern : patterns) g_sink = reinterpret_cast<uintptr_t>(M2Scan::Find(code.data(), code.size(), pattern.data(), pattern.size()));
+        }));
+        Report("16 signatures, M2Scan::FindAll", bytes, Time(3, [&] {
+            std::vector<M2Scan::Request> requests;
+            for (auto & pattern : patterns) requests.push_back({ pattern.data(), pattern.size() });
+            M2Scan::FindAll(code.data(), code.size(), requests);
+            g_sink = requests[0].result;
+        }));
+    }
+
+    // Parsing a signature's text at runtime, as before and now.
+    // Parse also picks the scan anchors, which the literals in the fix have
+    // done at compile time and so don't pay here at all.
+    void Signatures()
+    {
+        const size_t count = 100000;
+        Rate("signature text, PatternToByte (before)", static_cast<double>(count), Time(3, [&] {
+            for (size_t i = 0; i < count; ++i) g_sink = PatternToByte(g_signatures[i % std::size(g_signatures)]).size();
+        }), "sig");
+        Rate("signature text, M2Signature::Parse", static_cast<double>(count), Time(3, [&] {
+            for (size_t i = 0; i < count; ++i) g_sink = M2Signature::Parse(g_signatures[i % std::size(g_signatures)]).Hash();
+        }), "sig");
+    }
+
+    // A data signature looked for in the data sections, or the whole image.
+    void Sections()
+    {
+        const uint32_t text = 48 << 20, data = 16 << 20, size = 0x1000 + text + data;
+        auto image = Code(size);
+        std::fill(image.begin(), image.begin() + 0x1000, 0);
+        auto write = [&](size_t offset, uint32_t value, size_t bytes) {
+            for (size_t i = 0; i < bytes; ++i) image[offset + i] = static_cast<unsigned char>(value >> (i * 8));
+        };
+        write(0, 0x5A4D, 2);
+        write(0x3C, 0x80, 4);
+        write(0x80, 0x00004550, 4);
+        write(0x80 + 6, 2, 2);
+        write(0x80 + 20, 0xF0, 2);
+        write(0x80 + 24, 0x20B, 2);
+        write(0x80 + 24 + 56, size, 4);
+        size_t table = 0x80 + 24 + 0xF0;
+        std::memcpy(&image[table], ".text", 5);
+        write(table + 8, text, 4);
+        write(table + 12, 0x1000, 4);
+        write(table + 36, 0x00000020 | 0x20000000 | 0x40000000, 4);
+        std::memcpy(&image[table + 40], ".data", 5);
+        write(table + 40 + 8, data, 4);
+        write(table + 40 + 12, 0x1000 + text, 4);
+        write(table + 40 + 36, 0x00000040 | 0x40000000 | 0x80000000, 4);
+
+        static constexpr char classname[] = "CLASSNAME = ";
+        std::memcpy(&image[size - 64], classname, sizeof(classname) - 1);
+        auto signature = M2Signature::Data("43 4C 41 53 53 4E 41 4D 45 20 3D 20");
+
+        Report("data signature, whole image", static_cast<double>(size), Time(3, [&] {
+            g_sink = reinterpret_cast<uintptr_t>(signature.Find(image.data(), image.size()));
+        }));
+        Report("data signature, M2PE data ranges", static_cast<double>(size), Time(3, [&] {
+            auto pe = M2PE::Parse(image.data(), image.size());
+            for (auto & [begin, end] : pe->DataRanges()) {
+                if (auto found = signature.Find(image.data() + begin, end - begin)) {
+                    g_sink = reinterpret_cast<uintptr_t>(found);
+                    break;
+                }
+            }
+        }));
+    }
+
+    // PPF3 records gathered into runs.
+    void Coalescing()
+    {
+        auto records = RandomRecords(200000, 0x8000000);
+        double bytes = 0;
+        for (auto & [offset, run] : records) bytes += static_cast<double>(run.size());
+        Report("coalesce 200k records", bytes, Time(3, [&] {
+            Ketchup_Patches patches;
+            for (auto & [offset, run] : records) KetchupPatch::Coalesce(patches, offset, run.data(), run.size());
+            g_sink = patches.size();
+        }));
+    }
+
+    // Each format parsed, and PPF3 loaded again from its index.
+    void Parsers()
+    {
+        std::filesystem::create_directories(g_root);
+        auto image = Bytes(32 << 20);
+        Write(g_root / "image.bin", image);
+        KetchupSource source(g_root / "image.bin");
+
+        auto records = RandomRecords(100000, image.size() - 0x100);
+        auto target = image;
+        for (size_t i = 0; i < target.size(); i += 61) target[i] ^= 0xA5;
+        std::vector<unsigned char> built;
+        std::vector<Action> actions;
+        for (uint64_t done = 0; done < image.size();) {
+            uint64_t length = std::min<uint64_t>(1 + g_random() % 0x4000, image.size() - done);
+            actions.push_back({ g_random() % 4 ? Action::SourceRead : Action::TargetRead, length });
+            done += length;
+        }
+
+        // PPF3 & IPS by the bytes of the mod, UPS & BPS by the image they go
+        // through and check the CRC-32 of.
+        std::tuple<const char *, std::vector<unsigned char>, bool> mods[] = {
+            { "parse PPF3", PPF3(records), false },
+            { "parse IPS", IPS(RandomRecords(100000, 0xFFFF00)), false },
+            { "parse UPS, per image byte", UPS(image, target), true },
+            { "parse BPS, per image byte", BPS(image, actions, built), true },
+        };
+        for (auto & [name, mod, whole] : mods) {
+            Report(name, static_cast<double>(whole ? image.size() : mod.size()), Time(3, [&] {
+                Ketchup_Patches patches;
+                KetchupPatch::Checks checks;
+                g_sink = KetchupPatch::Parse(mod.data(), mod.size(), source, patches, checks);
+            }));
+        }
+
+        auto path = g_root / "mod.ppf";
+        auto & ppf = std::get<1>(mods[0]);
+        Write(path, ppf);
+        auto index = path;
+        index += KetchupPatch::IndexExtension;
+        Report("load PPF3, parsed and indexed", static_cast<double>(ppf.size()), Time(3, [&] {
+            std::filesystem::remove(index);
+            Ketchup_Patches patches;
+            g_sink = KetchupPatch::Load(path, source, patches);
+        }));
+        Report("load PPF3, from its index", static_cast<double>(ppf.size()), Time(3, [&] {
+            Ketchup_Patches patches;
+            g_sink = KetchupPatch::Load(path, source, patches);
+        }));
+    }
+
+    // RAM patch writes matched by offset, a scan or the index.
+    void RamPatches()
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> patches;
+        for (int i = 0; i < 2000; ++i) patches.emplace_back(static_cast<uint32_t>(g_random() % 0x200000) & ~3u, 1);
+        M2RamPatches index;
+        for (auto & [offset, length] : patches) index.Add(offset, length);
+        index.Finish();
+
+        std::vector<uint32_t> writes;
+        for (int i = 0; i < 100000; ++i) writes.push_back(i % 2 ? patches[g_random() % patches.size()].first : static_cast<uint32_t>(g_random() % 0x200000));
+
+        Rate("RAM patch writes, scanned", static_cast<double>(writes.size()), Time(3, [&] {
+            size_t hits = 0;
+            for (auto offset : writes) {
+                for (auto & patch : patches) {
+                    if (patch.first == offset) { ++hits; break; }
+                }
+            }
+            g_sink = hits;
+        }), "write");
+        Rate("RAM patch writes, M2RamPatches", static_cast<double>(writes.size()), Time(3, [&] {
+            size_t hits = 0;
+            M2RamPatches::Write write;
+            for (auto offset : writes) hits += index.Next(offset, write);
+            g_sink = hits;
+        }), "write");
+    }
+
+    // CD-ROM patches checked against the data blacklist.
+    void Filters()
+    {
+        std::vector<std::vector<unsigned char>> blacklist;
+        M2PatchFilter filter;
+        for (int i = 0; i < 500; ++i) {
+            blacklist.push_back(Bytes(16 + g_random() % 4));
+            filter.AddData(blacklist.back());
+        }
+        std::vector<std::vector<int>> patches;
+        for (int i = 0; i < 20000; ++i) {
+            auto bytes = i % 10 ? Bytes(16 + g_random() % 4) : blacklist[g_random() % blacklist.size()];
+            patches.emplace_back(bytes.begin(), bytes.end());
+        }
+
+        Rate("patch data blacklist, compared", static_cast<double>(patches.size()), Time(3, [&] {
+            size_t hits = 0;
+            for (auto & patch : patches) {
+                for (auto & data : blacklist) {
+                    if (data.size() == patch.size() && std::equal(data.begin(), data.end(), patch.begin())) { ++hits; break; }
+                }
+            }
+            g_sink = hits;
+        }), "patch");
+        Rate("patch data blacklist, M2PatchFilter", static_cast<double>(patches.size()), Time(3, [&] {
+            size_t hits = 0;
+            for (auto & patch : patches) hits += filter.MatchData(patch.size(), [&patch](size_t i) { return patch[i]; });
+            g_sink = hits;
+        }), "patch");
+    }
+
+    // Script call events matched to hooks, by comparing names down the hook
+    // table or by probing for the interned name. Most calls aren't hooked.
+    void Dispatch()
+    {
+        struct Name
+        {
+            std::string text;
+            size_t hash;
+        };
+        std::deque<Name> names;
+        for (int i = 0; i < 600; ++i) {
+            auto text = "SystemFunction_" + std::to_string(i * 7919 % 1000);
+            names.push_back({ text, std::hash<std::string> {}(text) });
+        }
+        std::vector<std::string> table;
+        M2InternTable<Name, int> interned;
+        interned.Reset(60);
+        for (int i = 0; i < 60; ++i) {
+            table.push_back(names[i * 10].text);
+            interned.Insert(&names[i * 10], names[i * 10].hash) = i + 1;
+        }
+        std::vector<const Name *> events;
+        for (int i = 0; i < 1000000; ++i) events.push_back(&names[g_random() % names.size()]);
+
+        Rate("call events, compared by name", static_cast<double>(events.size()), Time(3, [&] {
+            size_t hits = 0;
+            for (auto event : events) {
+                for (auto & name : table) {
+                    if (name == event->text) { ++hits; break; }
+                }
+            }
+            g_sink = hits;
+        }), "event");
+        Rate("call events, M2InternTable", static_cast<double>(events.size()), Time(3, [&] {
+            size_t hits = 0;
+            for (auto event : events) hits += interned.Find(event, event->hash) != nullptr;
+            g_sink = hits;
+        }), "event");
+    }
+
+    // Ketchup's mapped CD-ROM writes, a sector's data at a time, straight
+    // into DRAM or a value at a time. Each value here is only a call through
+    // std::function, in the game it's a call into the script as well.
+    void Ram()
+    {
+        std::vector<unsigned char> dram(M2Ram::Size), script(M2Ram::Size);
+        M2_EmuPSX psx = {};
+        psx.MemoryDRAM = dram.data();
+        std::function<void(int, unsigned int, uint32_t)> set = [&](int bits, unsigned int address, uint32_t value) {
+            std::memcpy(&script[address], &value, bits / 8);
+        };
+        auto sector = Bytes(0x800);
+
+        Report("RAM writes, per value", static_cast<double>(M2Ram::Size), Time(5, [&] {
+            for (unsigned int address = 0; address < M2Ram::Size; address += 0x800) M2Ram::Write(nullptr, address, sector.data(), sector.size(), set);
+            g_sink = script[0];
+        }));
+        Report("RAM writes, straight to DRAM", static_cast<double>(M2Ram::Size), Time(5, [&] {
+            for (unsigned int address = 0; address < M2Ram::Size; address += 0x800) M2Ram::Write(&psx, address, sector.data(), sector.size(), set);
+            g_sink = dram[0];
+        }));
+    }
+
+    // The disc image's CRC-32.
+    void Fingerprint()
+    {
+        auto image = Bytes(64 << 20);
+        Report("CRC-32", static_cast<double>(image.size()), Time(3, [&] {
+            g_sink = KetchupPatch::CRC32(image.data(), image.size());
+        }));
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    const std::pair<const char *, void (*)()> benchmarks[] = {
+        { "scanner", Scanner },
+        { "batch", Batch },
+        { "signatures", Signatures },
+        { "sections", Sections },
+        { "coalescing", Coalescing },
+        { "parsers", Parsers },
+        { "rampatches", RamPatches },
+        { "filters", Filters },
+        { "ram", Ram },
+        { "dispatch", Dispatch },
+        { "fingerprint", Fingerprint },
+    };
+
+    // All of them, or those named.
+    for (auto & [name, benchmark] : benchmarks) {
+        bool asked = argc < 2;
+        for (int i = 1; i < argc; ++i) asked |= std::string(argv[i]) == name;
+        if (asked) benchmark();
+    }
+    std::filesystem::remove_all(g_root);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include "m2debuginfo.h"
+#include "check.h"
+
+namespace {
+    const std::vector<std::string> g_batch = { "system/script/util.nut", "title/mgs1/loader.nut" };
+
+    void Matches()
+    {
+        // Everything, batch or not.
+        CHECK(M2DebugInfo::Matches("*", g_batch));
+        CHECK(M2DebugInfo::Matches("*", {}));
+        CHECK(M2DebugInfo::Matches("loader, *", {}));
+
+        // A part of any script's name in the batch.
+        CHECK(M2DebugInfo::Matches("loader", g_batch));
+        CHECK(M2DebugInfo::Matches("mgs1/", g_batch));
+        CHECK(M2DebugInfo::Matches("menu,util", g_batch));
+        CHECK(!M2DebugInfo::Matches("menu", g_batch));
+        CHECK(!M2DebugInfo::Matches("loader", {}));
+        CHECK(!M2DebugInfo::Matches("Loader", g_batch));
+
+        // Spaces & tabs around names, and empty ones, are let go.
+        CHECK(M2DebugInfo::Matches(" \tmenu , loader\t ", g_batch));
+        CHECK(M2DebugInfo::Matches(",,loader,", g_batch));
+        CHECK(M2DebugInfo::Matches("  *  ", {}));
+        CHECK(!M2DebugInfo::Matches("", g_batch));
+        CHECK(!M2DebugInfo::Matches(" , \t,", g_batch));
+
+        // A star is only all on its own.
+        CHECK(!M2DebugInfo::Matches("*.nut", g_batch));
+        CHECK(!M2DebugInfo::Matches("loader*", g_batch));
+    }
+}
+
+int main()
+{
+    Matches();
+    return g_failures != 0;
+}
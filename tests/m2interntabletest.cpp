@@ -0,0 +1,204 @@
+#include "m2interntable.h"
+#include "check.h"
+
+#include <deque>
+#include <map>
+#include <functional>
+#include <string>
+
+namespace {
+    // The VM's interned strings as far as the table sees them, one object
+    // per name with its hash alongside.
+    struct Name
+    {
+        std::string text;
+        size_t hash;
+    };
+
+    struct Hooks
+    {
+        int call = 0;
+        int ret = 0;
+        bool scoped = false;
+    };
+
+    void Lookup()
+    {
+        std::deque<Name> names;
+        for (int i = 0; i < 40; ++i) {
+            auto text = "function" + std::to_string(i);
+            names.push_back({ text, std::hash<std::string> {}(text) });
+        }
+
+        M2InternTable<Name, Hooks> table;
+        CHECK(!table.Find(&names[0], names[0].hash));
+
+        table.Reset(names.size());
+        CHECK(table.Capacity() == 128);
+        for (size_t i = 0; i < names.size(); ++i) table.Insert(&names[i], names[i].hash).call = static_cast<int>(i) + 1;
+        CHECK(table.Size() == names.size());
+
+        for (size_t i = 0; i < names.size(); ++i) {
+            auto hooks = table.Find(&names[i], names[i].hash);
+            CHECK(hooks && hooks->call == static_cast<int>(i) + 1);
+        }
+
+        // It's the object that's looked for, not its text.
+        Name copy = names[3];
+        CHECK(!table.Find(&copy, copy.hash));
+        CHECK(!table.Find(nullptr, 0));
+
+        // Adding a name again gives back what it has, for hooks of another kind.
+        auto &hooks = table.Insert(&names[3], names[3].hash);
+        CHECK(hooks.call == 4 && hooks.ret == 0);
+        hooks.ret = 10;
+        CHECK(table.Find(&names[3], names[3].hash)->ret == 10);
+        CHECK(table.Size() == names.size());
+    }
+
+    void Collisions()
+    {
+        // All in the last slot, so each probe wraps around to the start, and
+        // a miss walks every one of them to the empty slot after.
+        std::deque<Name> names;
+        for (int i = 0; i < 8; ++i) names.push_back({ "same" + std::to_string(i), 15 });
+
+        M2InternTable<Name, Hooks> table;
+        table.Reset(names.size());
+        CHECK(table.Capacity() == 16);
+        for (size_t i = 0; i < names.size(); ++i) table.Insert(&names[i], names[i].hash).call = static_cast<int>(i) + 1;
+        for (size_t i = 0; i < names.size(); ++i) CHECK(table.Find(&names[i], 15)->call == static_cast<int>(i) + 1);
+
+        Name other = { "other", 15 };
+        CHECK(!table.Find(&other, other.hash));
+        Name high = { "high", 15 + 16 * 7 };
+        CHECK(!table.Find(&high, high.hash));
+
+        // A hash's high bits don't matter beyond the table's size.
+        auto &hooks = table.Insert(&high, high.hash);
+        hooks.scoped = true;
+        CHECK(table.Find(&high, 15)->scoped);
+    }
+
+    using Hook = int (*)(int);
+    int Print(int) { return 1; }
+    int Logged(int) { return 2; }
+    int SetRamValue(int) { return 3; }
+    int Returned(int) { return 4; }
+
+    // Names interned once each, as the VM's shared state does.
+    struct Strings
+    {
+        std::map<std::string, Name> names;
+
+        std::pair<const Name *, size_t> operator()(const std::string &text)
+        {
+            auto [it, added] = names.try_emplace(text, Name { text, std::hash<std::string> {}(text) });
+            return { &it->second, it->second.hash };
+        }
+
+        const M2HookTable<Name, Hook>::Entry *Find(const M2HookTable<Name, Hook> &table, const std::string &text)
+        {
+            auto [name, hash] = (*this)(text);
+            return table.Find(name, hash);
+        }
+    };
+
+    void Natives()
+    {
+        // SQHook's NativeTable, print & printf both logged, and a hook set
+        // later for a name already in it.
+        M2HookTable<Name, Hook>::Table natives = {
+            { "setRamValue", SetRamValue },
+            { "printf", Print },
+            { "print", Print },
+            { "setRamValue", Logged },
+        };
+
+        Strings strings;
+        M2HookTable<Name, Hook> table;
+        CHECK(!strings.Find(table, "print"));
+        table.Build(natives, {}, {}, strings);
+
+        CHECK(strings.Find(table, "print")->call == Print);
+        CHECK(strings.Find(table, "printf")->call == Print);
+        CHECK(!strings.Find(table, "printf")->ret);
+
+        // The first for a name wins, as FixNative's walk down the table did.
+        CHECK(strings.Find(table, "setRamValue")->call == SetRamValue);
+
+        // Unhooked natives aren't in it, so CallNative lets them straight through.
+        CHECK(!strings.Find(table, "getRamValue"));
+        CHECK(!strings.Find(table, "Print"));
+    }
+
+    void Scripts()
+    {
+        M2HookTable<Name, Hook>::Table calls = { { "Load", Print }, { "Load", Logged } };
+        M2HookTable<Name, Hook>::Table returns = { { "Load", Returned }, { "Exit", Returned } };
+
+        Strings strings;
+        M2HookTable<Name, Hook> table;
+        table.Build(calls, returns, { "Load", "Frame" }, strings);
+
+        auto load = strings.Find(table, "Load");
+        CHECK(load && load->call == Print && load->ret == Returned && load->scoped);
+        auto exit = strings.Find(table, "Exit");
+        CHECK(exit && !exit->call && exit->ret == Returned && !exit->scoped);
+
+        // A scoped name with no hooks yet is still found, and only as scoped.
+        auto frame = strings.Find(table, "Frame");
+        CHECK(frame && !frame->call && !frame->ret && frame->scoped);
+
+        // Built again, as when the hook tables change, what was there goes.
+        table.Build({ { "Exit", Logged } }, {}, {}, strings);
+        CHECK(!strings.Find(table, "Load"));
+        CHECK(strings.Find(table, "Exit")->call == Logged);
+
+        // Enough scoped names to fill a table sized for calls & returns alone.
+        std::vector<std::string> scoped;
+        for (int i = 0; i < 40; ++i) scoped.push_back("Scoped" + std::to_string(i));
+        table.Build(calls, {}, scoped, strings);
+        CHECK(!strings.Find(table, "Missing"));
+        CHECK(strings.Find(table, "Scoped39")->scoped);
+    }
+
+    void Sizing()
+    {
+        // At most half full for the keys it's reset for, however many, so a
+        // miss always stops. Calls, returns and scoped names all count.
+        for (size_t count : { 0, 1, 8, 9, 64, 65, 1000 }) {
+            M2InternTable<Name, Hooks> table;
+            table.Reset(count);
+            CHECK(table.Capacity() >= 16 && table.Capacity() >= count * 2);
+            CHECK((table.Capacity() & (table.Capacity() - 1)) == 0);
+
+            std::deque<Name> names;
+            for (size_t i = 0; i < count; ++i) {
+                names.push_back({ std::to_string(i), i * 0x9E3779B9u });
+                table.Insert(&names.back(), names.back().hash);
+            }
+            Name missing = { "missing", 0 };
+            CHECK(!table.Find(&missing, missing.hash));
+        }
+
+        // And emptied again by another reset.
+        Name name = { "name", 1 };
+        M2InternTable<Name, Hooks> table;
+        table.Reset(1);
+        table.Insert(&name, name.hash).call = 1;
+        table.Reset(1);
+        CHECK(!table.Find(&name, name.hash));
+        CHECK(table.Size() == 0);
+    }
+}
+
+int main()
+{
+    Lookup();
+    Collisions();
+    Sizing();
+    Natives();
+    Scripts();
+    return g_failures != 0;
+}
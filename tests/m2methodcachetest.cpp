@@ -0,0 +1,116 @@
+#include "m2methodcache.h"
+#include "check.h"
+
+#include <vector>
+
+namespace {
+    // Stand-ins for the VM's shared states, root tables & instances, by
+    // address as SQInvoker compares them, and OT_TABLE.
+    int g_state, g_other;
+    const uint64_t g_root = 0x1000, g_table = 0x08000020, g_instance = 0x2000, g_replaced = 0x3000;
+
+    // A method handle, numbered in the order they were resolved.
+    struct Method
+    {
+        int id = 0;
+    };
+
+    struct Script
+    {
+        int resolved = 0;
+        std::vector<int> released;
+
+        auto Resolve(bool found = true)
+        {
+            return [this, found] { ++resolved; return Method { found ? resolved : 0 }; };
+        }
+
+        auto Release()
+        {
+            return [this](Method &method) { released.push_back(method.id); };
+        }
+    };
+
+    // SQInvoker::Handles::Acquire's checks, for one VM and global.
+    bool Acquire(M2MethodCache<Method> &cache, Script &script, const void *state, uint64_t root, uint64_t instance, unsigned generation)
+    {
+        bool bound = cache.Bind(state, root);
+        if (!cache.Current(g_table, instance, generation)) cache.Reset(g_table, instance, generation, script.Release());
+        return bound;
+    }
+
+    void Resolved()
+    {
+        M2MethodCache<Method> cache;
+        Script script;
+        CHECK(Acquire(cache, script, &g_state, g_root, g_instance, 0));
+
+        // Each method once, misses included.
+        CHECK(cache.Find("GetRamValue", script.Resolve()).id == 1);
+        CHECK(cache.Find("GetRamValue", script.Resolve()).id == 1);
+        CHECK(cache.Find("Missing", script.Resolve(false)).id == 0);
+        CHECK(cache.Find("Missing", script.Resolve()).id == 0);
+        CHECK(cache.Find("SetRamValue", script.Resolve()).id == 3);
+        CHECK(script.resolved == 3);
+        CHECK(cache.Size() == 3);
+
+        // The same global in the same VM keeps them.
+        CHECK(!Acquire(cache, script, &g_state, g_root, g_instance, 0));
+        CHECK(cache.Find("GetRamValue", script.Resolve()).id == 1);
+        CHECK(script.resolved == 3 && script.released.empty());
+    }
+
+    void Reassigned()
+    {
+        M2MethodCache<Method> cache;
+        Script script;
+        Acquire(cache, script, &g_state, g_root, g_instance, 0);
+        cache.Find("GetRamValue", script.Resolve());
+        cache.Find("SetRamValue", script.Resolve());
+
+        // Another object in the global, the old one's methods are released.
+        CHECK(!Acquire(cache, script, &g_state, g_root, g_replaced, 0));
+        CHECK(script.released == std::vector<int>({ 1, 2 }));
+        CHECK(cache.Size() == 0);
+        CHECK(cache.Find("GetRamValue", script.Resolve()).id == 3);
+
+        // Or an object of another type at the same value.
+        CHECK(cache.Current(g_table, g_replaced, 0));
+        CHECK(!cache.Current(g_table + 1, g_replaced, 0));
+
+        // Methods replaced in place, SQInvoker::Invalidate() bumps the generation.
+        CHECK(!cache.Current(g_table, g_replaced, 1));
+        Acquire(cache, script, &g_state, g_root, g_replaced, 1);
+        CHECK(script.released == std::vector<int>({ 1, 2, 3 }));
+        CHECK(cache.Find("GetRamValue", script.Resolve()).id == 4);
+        CHECK(cache.Current(g_table, g_replaced, 1));
+    }
+
+    void Restarted()
+    {
+        M2MethodCache<Method> cache;
+        Script script;
+        Acquire(cache, script, &g_state, g_root, g_instance, 0);
+        cache.Find("GetRamValue", script.Resolve());
+
+        // A new VM, even one with the global at the same address, drops
+        // everything without releasing it into a VM that's gone.
+        for (auto [state, root] : { std::pair<const void *, uint64_t>(&g_other, g_root), { &g_other, g_root + 1 } }) {
+            CHECK(Acquire(cache, script, state, root, g_instance, 0));
+            CHECK(script.released.empty());
+            CHECK(cache.Size() == 0);
+            cache.Find("GetRamValue", script.Resolve());
+        }
+        CHECK(script.resolved == 3);
+        CHECK(!Acquire(cache, script, &g_other, g_root + 1, g_instance, 0));
+        CHECK(cache.Find("GetRamValue", script.Resolve()).id == 3);
+    }
+}
+
+int main()
+{
+    Resolved();
+    Reassigned();
+    Restarted();
+    return g_failures != 0;
+}
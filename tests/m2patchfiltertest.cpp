@@ -0,0 +1,137 @@
+#include "m2patchfilter.h"
+#include "check.h"
+
+#include <random>
+
+namespace {
+    std::mt19937 g_random(19);
+
+    bool MatchData(const M2PatchFilter & filter, const std::vector<int> & data)
+    {
+        return filter.MatchData(data.size(), [&data](size_t i) { return data[i]; });
+    }
+
+    void Files()
+    {
+        M2PatchFilter filter;
+        CHECK(!filter.HasFiles());
+        CHECK(!filter.MatchFile("anything"));
+
+        filter.AddFile("stage/");
+        filter.AddFile("face");
+        filter.AddFile("facet");
+        CHECK(filter.HasFiles());
+
+        CHECK(filter.MatchFile("stage/d00a.dar"));
+        CHECK(filter.MatchFile("stage/"));
+        CHECK(filter.MatchFile("face"));
+        CHECK(filter.MatchFile("faces.dat"));
+        CHECK(!filter.MatchFile("stage"));
+        CHECK(!filter.MatchFile("fac"));
+        CHECK(!filter.MatchFile("radar.dat"));
+        CHECK(!filter.MatchFile(""));
+
+        // An empty prefix starts every name.
+        filter.AddFile("");
+        CHECK(filter.MatchFile("radar.dat"));
+    }
+
+    void Data()
+    {
+        M2PatchFilter filter;
+        CHECK(!filter.HasData());
+        CHECK(!MatchData(filter, { 1, 2, 3 }));
+
+        filter.AddData({ 1, 2, 3 });
+        filter.AddData({ 1, 2, 4 });
+        filter.AddData({ 0xFF });
+        filter.AddData({});
+        CHECK(filter.HasData());
+
+        CHECK(MatchData(filter, { 1, 2, 3 }));
+        CHECK(MatchData(filter, { 1, 2, 4 }));
+        CHECK(MatchData(filter, { 0xFF }));
+        CHECK(!MatchData(filter, { 1, 2, 5 }));
+        CHECK(!MatchData(filter, { 1, 2 }));
+        CHECK(!MatchData(filter, {}));
+
+        // Values that aren't bytes never match, even if they'd wrap to one.
+        CHECK(!MatchData(filter, { 1, 2, -1 }));
+        CHECK(!MatchData(filter, { 1, 2, 0x103 }));
+
+        // Only asked for the bytes of a length some pattern has.
+        size_t asked = 0;
+        filter.MatchData(7, [&asked](size_t) { ++asked; return 0; });
+        CHECK(asked == 0);
+    }
+
+    void ManyData()
+    {
+        M2PatchFilter filter;
+        std::vector<std::vector<unsigned char>> patterns;
+        for (int i = 0; i < 1000; ++i) {
+            std::vector<unsigned char> pattern(1 + g_random() % 16);
+            for (auto & byte : pattern) byte = static_cast<unsigned char>(g_random());
+            filter.AddData(pattern);
+            patterns.push_back(pattern);
+        }
+
+        for (auto & pattern : patterns) {
+            std::vector<int> data(pattern.begin(), pattern.end());
+            CHECK(MatchData(filter, data));
+            data.back() ^= 0x80;
+            bool added = false;
+            for (auto & other : patterns) added |= std::equal(other.begin(), other.end(), data.begin(), data.end());
+            CHECK(MatchData(filter, data) == added);
+        }
+    }
+
+    void Ranges()
+    {
+        M2PatchFilter filter;
+        CHECK(!filter.HasRanges());
+        CHECK(!filter.MatchRange(0));
+
+        filter.AddRange(10, 20);
+        filter.AddRange(30, 40);
+        filter.AddRange(21, 22);
+        filter.AddRange(35, 50);
+        filter.AddRange(5, 5);
+        CHECK(filter.HasRanges());
+
+        for (uint32_t value : { 5u, 10u, 15u, 20u, 21u, 22u, 30u, 45u, 50u }) CHECK(filter.MatchRange(value));
+        for (uint32_t value : { 0u, 4u, 6u, 9u, 23u, 29u, 51u }) CHECK(!filter.MatchRange(value));
+
+        // Bridging everything, and up to the top.
+        filter.AddRange(6, 29);
+        for (uint32_t value = 5; value <= 50; ++value) CHECK(filter.MatchRange(value));
+        filter.AddRange(UINT32_MAX - 1, UINT32_MAX);
+        CHECK(filter.MatchRange(UINT32_MAX));
+        CHECK(!filter.MatchRange(UINT32_MAX - 2));
+        filter.AddRange(0, UINT32_MAX);
+        CHECK(filter.MatchRange(0) && filter.MatchRange(1000) && filter.MatchRange(UINT32_MAX));
+    }
+
+    void RandomRanges()
+    {
+        M2PatchFilter filter;
+        std::vector<bool> set(4096);
+        for (int i = 0; i < 300; ++i) {
+            uint32_t first = g_random() % 4000;
+            uint32_t last = first + g_random() % 40;
+            filter.AddRange(first, last);
+            for (uint32_t value = first; value <= last; ++value) set[value] = true;
+        }
+        for (uint32_t value = 0; value < set.size(); ++value) CHECK(filter.MatchRange(value) == set[value]);
+    }
+}
+
+int main()
+{
+    Files();
+    Data();
+    ManyData();
+    Ranges();
+    RandomRanges();
+    return g_failures != 0;
+}
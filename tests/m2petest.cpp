@@ -0,0 +1,125 @@
+#include "m2pe.h"
+#include "check.h"
+
+namespace {
+    struct SectionSpec
+    {
+        const char *name;
+        uint32_t address;
+        uint32_t virtualSize;
+        uint32_t rawOffset;
+        uint32_t rawSize;
+        uint32_t characteristics;
+    };
+
+    constexpr uint32_t Code  = 0x00000020 | 0x20000000 | 0x40000000;
+    constexpr uint32_t RData = 0x00000040 | 0x40000000;
+    constexpr uint32_t Data  = 0x00000040 | 0x40000000 | 0x80000000;
+    constexpr uint32_t BSS   = 0x00000080 | 0x40000000 | 0x80000000;
+
+    void Write(std::vector<unsigned char> & image, size_t offset, uint32_t value, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i) image[offset + i] = static_cast<unsigned char>(value >> (i * 8));
+    }
+
+    // Just the headers M2PE reads, at the size given.
+    std::vector<unsigned char> Build(bool is64, const std::vector<SectionSpec> & sections, size_t size)
+    {
+        std::vector<unsigned char> image(size);
+        const size_t nt = 0x80;
+        const uint16_t optionalSize = is64 ? 0xF0 : 0xE0;
+
+        Write(image, 0, 0x5A4D, 2);
+        Write(image, 0x3C, nt, 4);
+        Write(image, nt, 0x00004550, 4);
+        Write(image, nt + 6, static_cast<uint32_t>(sections.size()), 2);
+        Write(image, nt + 8, 0x5F5E0FF, 4);
+        Write(image, nt + 20, optionalSize, 2);
+        Write(image, nt + 24, is64 ? 0x20B : 0x10B, 2);
+        Write(image, nt + 24 + 56, static_cast<uint32_t>(size), 4);
+
+        size_t table = nt + 24 + optionalSize;
+        for (size_t i = 0; i < sections.size(); ++i) {
+            auto & section = sections[i];
+            size_t header = table + i * 40;
+            std::copy(section.name, section.name + std::strlen(section.name), image.begin() + header);
+            Write(image, header + 8, section.virtualSize, 4);
+            Write(image, header + 12, section.address, 4);
+            Write(image, header + 16, section.rawSize, 4);
+            Write(image, header + 20, section.rawOffset, 4);
+            Write(image, header + 36, section.characteristics, 4);
+        }
+        return image;
+    }
+
+    const std::vector<SectionSpec> g_sections = {
+        { ".text",  0x1000, 0x1800, 0x400,  0x1800, Code },
+        { ".text2", 0x2800, 0x0800, 0x1C00, 0x0800, Code },
+        { ".rdata", 0x4000, 0x1000, 0x2400, 0x1000, RData },
+        { ".data",  0x5000, 0x1000, 0x3400, 0x0200, Data },
+        { ".bss",   0x6000, 0x1000, 0,      0,      BSS },
+    };
+
+    void Image()
+    {
+        for (bool is64 : { false, true }) {
+            auto image = Build(is64, g_sections, 0x7000);
+            auto pe = M2PE::Parse(image.data(), image.size());
+            CHECK(pe.has_value());
+            if (!pe) continue;
+
+            CHECK(pe->Is64() == is64);
+            CHECK(pe->Timestamp() == 0x5F5E0FF);
+            CHECK(pe->SizeOfImage() == 0x7000);
+            CHECK(pe->Sections().size() == g_sections.size());
+            CHECK(pe->Sections()[0].name == ".text");
+
+            // Adjoining code sections merge, data keeps to initialised sections.
+            CHECK(pe->CodeRanges() == std::vector<M2PE::Range>({ { 0x1000, 0x3000 } }));
+            CHECK(pe->DataRanges() == std::vector<M2PE::Range>({ { 0x4000, 0x6000 } }));
+        }
+    }
+
+    void File()
+    {
+        auto image = Build(true, g_sections, 0x3600);
+        auto pe = M2PE::Parse(image.data(), image.size(), M2PE::Layout::File);
+        CHECK(pe.has_value());
+        if (!pe) return;
+
+        // Raw offsets and sizes, clamped to the end of the file.
+        CHECK(pe->CodeRanges() == std::vector<M2PE::Range>({ { 0x400, 0x2400 } }));
+        CHECK(pe->DataRanges() == std::vector<M2PE::Range>({ { 0x2400, 0x3600 } }));
+        CHECK(!pe->Locate(pe->Sections()[4]));
+    }
+
+    void Malformed()
+    {
+        auto image = Build(false, g_sections, 0x7000);
+        CHECK(!M2PE::Parse(nullptr, 0));
+        CHECK(!M2PE::Parse(image.data(), 0x3F));
+
+        // Cut off in the section table.
+        CHECK(!M2PE::Parse(image.data(), 0x80 + 24 + 0xE0 + 40));
+
+        auto bad = image;
+        bad[0] = 'X';
+        CHECK(!M2PE::Parse(bad.data(), bad.size()));
+
+        bad = image;
+        Write(bad, 0x3C, 0x10000, 4);
+        CHECK(!M2PE::Parse(bad.data(), bad.size()));
+
+        bad = image;
+        Write(bad, 0x80 + 24, 0x107, 2);
+        CHECK(!M2PE::Parse(bad.data(), bad.size()));
+    }
+}
+
+int main()
+{
+    Image();
+    File();
+    Malformed();
+    return g_failures != 0;
+}
@@ -0,0 +1,83 @@
+#include "m2rampatches.h"
+#include "check.h"
+
+namespace {
+    // Writes each offset in turn, and notes which of the patch each was.
+    std::vector<std::pair<uint32_t, uint32_t>> Follow(M2RamPatches & patches, const std::vector<uint32_t> & offsets)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> writes;
+        for (uint32_t offset : offsets) {
+            M2RamPatches::Write write;
+            if (patches.Next(offset, write)) writes.emplace_back(write.address, write.index);
+            else writes.emplace_back(UINT32_MAX, 0);
+        }
+        return writes;
+    }
+
+    void Lookup()
+    {
+        M2RamPatches patches;
+        CHECK(!patches.Indexed());
+        patches.Add(0x3000, 2);
+        patches.Add(0x1000, 3);
+        patches.Add(0x1000, 1);
+        patches.Add(0x0000, 1);
+        patches.Finish();
+        CHECK(patches.Indexed());
+        CHECK(patches.Size() == 4);
+
+        // Writes to anywhere a patch doesn't start at are left alone.
+        M2RamPatches::Write write;
+        CHECK(!patches.Next(0x2000, write));
+        CHECK(!patches.Next(0x1001, write));
+
+        // The first added of those at 0x1000 wins, and its values after the
+        // first are taken wherever they're written.
+        auto writes = Follow(patches, { 0x1000, 0x5555, 0x1002, 0x1000, 0x3000, 0x3001, 0x0000, 0x4000 });
+        std::vector<std::pair<uint32_t, uint32_t>> want = {
+            { 0x1000, 0 }, { 0x1000, 1 }, { 0x1000, 2 },
+            { 0x1000, 0 }, { 0x1000, 1 }, { 0x1000, 2 },
+            { 0x0000, 0 }, { UINT32_MAX, 0 },
+        };
+        CHECK(writes == want);
+    }
+
+    void Empty()
+    {
+        // A patch without values only ever starts.
+        M2RamPatches patches;
+        patches.Add(0x10, 0);
+        patches.Add(0x20, 1);
+        patches.Finish();
+
+        M2RamPatches::Write write;
+        CHECK(patches.Next(0x10, write));
+        CHECK(write.index == 0);
+        CHECK(patches.Next(0x20, write));
+        CHECK(write.address == 0x10 && write.index == 0);
+
+        patches.Clear();
+        CHECK(!patches.Indexed());
+        CHECK(patches.Size() == 0);
+    }
+
+    void Many()
+    {
+        M2RamPatches patches;
+        for (uint32_t i = 10000; i-- > 0;) patches.Add(i * 16, 4);
+        patches.Finish();
+
+        for (uint32_t i = 0; i < 10000; i += 97) {
+            auto writes = Follow(patches, { i * 16, 0, 0, 0 });
+            CHECK(writes.front().first == i * 16 && writes.back().second == 3);
+        }
+    }
+}
+
+int main()
+{
+    Lookup();
+    Empty();
+    Many();
+    return g_failures != 0;
+}
@@ -0,0 +1,139 @@
+#include "m2ram.h"
+#include "check.h"
+
+#include <tuple>
+
+namespace {
+    // The machine as far as M2Ram sees it, DRAM and all.
+    struct Machine
+    {
+        std::vector<unsigned char> dram = std::vector<unsigned char>(M2Ram::Size);
+        M2_EmuPSX psx = {};
+
+        Machine()
+        {
+            psx.MemoryDRAM = dram.data();
+        }
+    };
+
+    // SetRamValue & GetRamValue as the script has them, each call noted.
+    struct Script
+    {
+        std::vector<unsigned char> ram = std::vector<unsigned char>(M2Ram::Size + 0x10);
+        std::vector<std::tuple<int, int64_t, uint32_t>> calls;
+
+        auto Set()
+        {
+            return [this](int bits, int64_t address, uint32_t value) {
+                calls.emplace_back(bits, address, value);
+                if (address < 0 || address + bits / 8 > static_cast<int64_t>(ram.size())) return;
+                std::memcpy(&ram[address], &value, bits / 8);
+            };
+        }
+
+        auto Get()
+        {
+            return [this](int bits, int64_t address) {
+                uint32_t value = 0;
+                calls.emplace_back(bits, address, 0);
+                if (address < 0 || address + bits / 8 > static_cast<int64_t>(ram.size())) return value;
+                std::memcpy(&value, &ram[address], bits / 8);
+                return value;
+            };
+        }
+    };
+
+    void Resolve()
+    {
+        Machine machine;
+        auto dram = machine.dram.data();
+
+        // Only a running machine's DRAM.
+        CHECK(!M2Ram::Resolve(nullptr, 0u, 4));
+        M2_EmuPSX stopped = {};
+        CHECK(!M2Ram::Resolve(&stopped, 0u, 4));
+
+        CHECK(M2Ram::Resolve(&machine.psx, 0u, 4) == dram);
+        CHECK(M2Ram::Resolve(&machine.psx, 0x1234u, 4) == dram + 0x1234);
+        CHECK(M2Ram::Resolve(&machine.psx, M2Ram::Size - 4, 4) == dram + M2Ram::Size - 4);
+        CHECK(M2Ram::Resolve(&machine.psx, M2Ram::Size, 0) == dram + M2Ram::Size);
+
+        // Ranges running past the end, or wrapping, aren't in it.
+        CHECK(!M2Ram::Resolve(&machine.psx, M2Ram::Size - 3, 4));
+        CHECK(!M2Ram::Resolve(&machine.psx, M2Ram::Size + 1, 0));
+        CHECK(!M2Ram::Resolve(&machine.psx, 0x10u, SIZE_MAX - 8));
+
+        // Nor are a script's integers that only truncate into it.
+        CHECK(!M2Ram::Resolve(&machine.psx, int64_t(-1), 1));
+        CHECK(!M2Ram::Resolve(&machine.psx, int64_t(0x100000000) + 0x10, 4));
+        CHECK(!M2Ram::Resolve(&machine.psx, uint64_t(0x100000000), 4));
+        CHECK(M2Ram::Resolve(&machine.psx, int64_t(0x10), 4) == dram + 0x10);
+    }
+
+    void Direct()
+    {
+        Machine machine;
+        Script script;
+        const unsigned char data[] = { 1, 2, 3, 4, 5, 6, 7 };
+
+        // Straight into DRAM, with nothing going through the script.
+        M2Ram::Write(&machine.psx, 0x100u, data, sizeof(data), script.Set());
+        CHECK(std::equal(data, data + sizeof(data), machine.dram.begin() + 0x100));
+        CHECK(script.calls.empty());
+
+        unsigned char read[sizeof(data)] = {};
+        M2Ram::Read(&machine.psx, read, 0x100u, sizeof(read), script.Get());
+        CHECK(std::memcmp(read, data, sizeof(data)) == 0);
+        CHECK(M2Ram::Compare(&machine.psx, 0x100u, data, sizeof(data), script.Get()) == 0);
+        CHECK(M2Ram::Compare(&machine.psx, 0x101u, data, sizeof(data), script.Get()) != 0);
+        CHECK(script.calls.empty());
+    }
+
+    void Fallback()
+    {
+        const unsigned char data[] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77 };
+
+        // Without a machine, 32, 16 then 8 bits at a time, little endian.
+        Script script;
+        M2Ram::Write(nullptr, int64_t(0x100), data, sizeof(data), script.Set());
+        std::vector<std::tuple<int, int64_t, uint32_t>> want = {
+            { 32, 0x100, 0x44332211 }, { 16, 0x104, 0x6655 }, { 8, 0x106, 0x77 },
+        };
+        CHECK(script.calls == want);
+        CHECK(std::equal(data, data + sizeof(data), script.ram.begin() + 0x100));
+
+        script.calls.clear();
+        unsigned char read[sizeof(data)] = {};
+        M2Ram::Read(nullptr, read, int64_t(0x100), sizeof(read), script.Get());
+        CHECK(std::memcmp(read, data, sizeof(data)) == 0);
+        CHECK(script.calls.size() == 3);
+        CHECK(M2Ram::Compare(nullptr, int64_t(0x100), data, sizeof(data), script.Get()) == 0);
+        CHECK(M2Ram::Compare(nullptr, int64_t(0x101), data, sizeof(data), script.Get()) != 0);
+
+        // Nor with one, for ranges it can't take, left for the script to deal with.
+        Machine machine;
+        script.calls.clear();
+        M2Ram::Write(&machine.psx, int64_t(M2Ram::Size - 2), data, 4, script.Set());
+        CHECK(script.calls.size() == 1 && std::get<1>(script.calls[0]) == M2Ram::Size - 2);
+        CHECK(machine.dram[M2Ram::Size - 2] == 0);
+
+        script.calls.clear();
+        M2Ram::Write(&machine.psx, int64_t(-4), data, 4, script.Set());
+        CHECK(script.calls.size() == 1 && std::get<1>(script.calls[0]) == -4);
+
+        // And either way round, the same bytes come back.
+        std::vector<unsigned char> bytes(0x1003);
+        for (size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<unsigned char>(i * 7);
+        M2Ram::Write(&machine.psx, 0x2001u, bytes.data(), bytes.size(), script.Set());
+        M2Ram::Write(nullptr, int64_t(0x2001), bytes.data(), bytes.size(), script.Set());
+        CHECK(std::equal(machine.dram.begin() + 0x2001, machine.dram.begin() + 0x2001 + bytes.size(), script.ram.begin() + 0x2001));
+    }
+}
+
+int main()
+{
+    Resolve();
+    Direct();
+    Fallback();
+    return g_failures != 0;
+}
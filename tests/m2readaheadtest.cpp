@@ -0,0 +1,187 @@
+#include "m2readahead.h"
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // A drive with one head: each sector takes a while to read, and more if
+    // it isn't the one after the last.
+    struct Device
+    {
+        std::vector<unsigned char> image;
+        std::vector<std::atomic<int>> reads;
+        std::chrono::microseconds sector;
+        std::chrono::microseconds seek;
+
+        std::mutex mutex;
+        uint32_t head = UINT32_MAX;
+        // Sectors it fails to read, until they're let through.
+        std::atomic<uint32_t> broken = UINT32_MAX;
+
+        Device(uint32_t sectors, std::chrono::microseconds sector, std::chrono::microseconds seek)
+            : image(sectors * M2ReadAhead::SectorSize), reads(sectors), sector(sector), seek(seek)
+        {
+            std::mt19937 random(22);
+            for (auto & byte : image) byte = static_cast<unsigned char>(random());
+        }
+
+        uint32_t Sectors() const
+        {
+            return static_cast<uint32_t>(reads.size());
+        }
+
+        M2ReadAhead::Reader Reader()
+        {
+            return [this](uint32_t lba, unsigned char * data) {
+                std::lock_guard lock(mutex);
+                if (lba >= Sectors() || lba == broken) return false;
+
+                Wait(lba == head + 1 ? sector : sector + seek);
+                head = lba;
+                reads[lba]++;
+                std::memcpy(data, &image[lba * M2ReadAhead::SectorSize], M2ReadAhead::SectorSize);
+                return true;
+            };
+        }
+
+        bool Matches(uint32_t lba, const unsigned char * data) const
+        {
+            return std::memcmp(data, &image[lba * M2ReadAhead::SectorSize], M2ReadAhead::SectorSize) == 0;
+        }
+
+        // Spun rather than slept, as sleeps this short overshoot by far.
+        static void Wait(std::chrono::microseconds time)
+        {
+            auto end = Clock::now() + time;
+            while (Clock::now() < end) std::this_thread::yield();
+        }
+    };
+
+    // A stage load as the game does them: runs of sectors read in order,
+    // with some work done on each, between scattered reads of single ones.
+    std::vector<uint32_t> Trace(uint32_t sectors)
+    {
+        std::mt19937 random(7);
+        std::vector<uint32_t> trace;
+        for (int burst = 0; burst < 30; ++burst) {
+            for (int i = 0; i < 4; ++i) trace.push_back(random() % sectors);
+            uint32_t start = random() % (sectors - 200);
+            uint32_t length = 40 + random() % 120;
+            for (uint32_t lba = start; lba < start + length; ++lba) trace.push_back(lba);
+        }
+        return trace;
+    }
+
+    // Replays the trace, checking every sector, and gives the time spent
+    // stalled on reads.
+    std::chrono::microseconds Replay(Device & device, const std::vector<uint32_t> & trace, const std::function<bool(uint32_t, unsigned char *)> & read)
+    {
+        std::chrono::microseconds stalled {};
+        unsigned char sector[M2ReadAhead::SectorSize];
+        for (uint32_t lba : trace) {
+            auto start = Clock::now();
+            bool ok = read(lba, sector);
+            stalled += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+            CHECK(ok && device.Matches(lba, sector));
+            Device::Wait(std::chrono::microseconds(150));
+        }
+        return stalled;
+    }
+
+    void Replayed()
+    {
+        Device device(4000, std::chrono::microseconds(150), std::chrono::microseconds(2000));
+        auto trace = Trace(device.Sectors());
+
+        auto direct = Replay(device, trace, device.Reader());
+
+        std::chrono::microseconds cached;
+        M2ReadAhead::Counters counters;
+        for (auto & reads : device.reads) reads = 0;
+        {
+            M2ReadAhead cache(device.Reader(), 8192, 32);
+            cached = Replay(device, trace, [&](uint32_t lba, unsigned char * sector) { return cache.Read(lba, sector); });
+            counters = cache.Stats();
+        }
+        std::printf("Stalled %lld ms reading directly, %lld ms through the cache.\n",
+            static_cast<long long>(direct.count() / 1000), static_cast<long long>(cached.count() / 1000));
+
+        // Every read counted once, and with room for all of them no sector
+        // read from the device twice, whether by the worker or not.
+        CHECK(counters.hits + counters.misses == trace.size());
+        CHECK(counters.waits <= counters.hits);
+        CHECK(counters.prefetched > 0);
+        int twice = 0;
+        for (auto & reads : device.reads) twice += reads > 1;
+        CHECK(twice == 0);
+
+        // Runs in order come from the worker, so most reads don't go to the device.
+        CHECK(counters.misses * 2 < trace.size());
+        CHECK(cached < direct);
+    }
+
+    void Bounded()
+    {
+        // Far smaller than the stream through it, still returning the right
+        // sectors, and old ones read again once they're evicted.
+        Device device(2000, std::chrono::microseconds(20), std::chrono::microseconds(100));
+        M2ReadAhead cache(device.Reader(), 8, 16);
+        unsigned char sector[M2ReadAhead::SectorSize];
+        for (int pass = 0; pass < 2; ++pass) {
+            for (uint32_t lba = 0; lba < 500; ++lba) {
+                CHECK(cache.Read(lba, sector) && device.Matches(lba, sector));
+            }
+        }
+        CHECK(device.reads[0] == 2);
+
+        // A sector read twice in a row without anything between stays.
+        CHECK(cache.Read(1500, sector));
+        int reads = device.reads[1500];
+        CHECK(cache.Read(1500, sector) && device.Matches(1500, sector));
+        CHECK(device.reads[1500] == reads);
+    }
+
+    void Failed()
+    {
+        Device device(100, std::chrono::microseconds(10), std::chrono::microseconds(10));
+        device.broken = 50;
+        unsigned char sector[M2ReadAhead::SectorSize];
+        {
+            M2ReadAhead cache(device.Reader(), 64, 8);
+
+            // Read ahead into a sector that can't be, it isn't kept.
+            for (uint32_t lba = 40; lba < 50; ++lba) CHECK(cache.Read(lba, sector));
+            CHECK(!cache.Read(50, sector));
+            CHECK(!cache.Read(50, sector));
+            CHECK(!cache.Read(device.Sectors(), sector));
+
+            // And it's read once it can be.
+            device.broken = UINT32_MAX;
+            CHECK(cache.Read(50, sector) && device.Matches(50, sector));
+        }
+
+        // Let go of mid stream, with the worker still reading.
+        Device slow(1000, std::chrono::microseconds(500), std::chrono::microseconds(500));
+        {
+            M2ReadAhead cache(slow.Reader(), 64, 32);
+            CHECK(cache.Read(0, sector));
+            CHECK(cache.Read(1, sector));
+        }
+        CHECK(slow.reads[2] <= 1);
+    }
+}
+
+int main()
+{
+    Replayed();
+    Bounded();
+    Failed();
+    return g_failures != 0;
+}
@@ -0,0 +1,157 @@
+#include "m2scancache.h"
+#include "check.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+    const std::filesystem::path g_file = std::filesystem::path("m2scancache") / "cache.json";
+    const M2ScanCache::Module g_module = { "game.exe", 0x12345678, 0x100000 };
+
+    void RoundTrip()
+    {
+        {
+            M2ScanCache cache(g_file);
+            CHECK(cache.Enabled());
+            CHECK(!cache.Find(g_module, 1));
+            cache.Store(g_module, 1, 0x1000);
+            cache.Store(g_module, 2, 0x2000);
+            // Past the end of the module.
+            cache.Store(g_module, 3, 0x100000);
+            CHECK(cache.Save());
+        }
+
+        M2ScanCache cache(g_file);
+        CHECK(cache.Find(g_module, 1) == 0x1000);
+        CHECK(cache.Find(g_module, 2) == 0x2000);
+        CHECK(!cache.Find(g_module, 3));
+
+        cache.Erase(g_module, 2);
+        CHECK(!cache.Find(g_module, 2));
+
+        // A rebuilt module has none of its old signatures.
+        auto rebuilt = g_module;
+        rebuilt.timestamp++;
+        CHECK(!cache.Find(rebuilt, 1));
+        cache.Store(rebuilt, 4, 0x4000);
+        CHECK(cache.Find(rebuilt, 4) == 0x4000);
+        CHECK(!cache.Find(g_module, 1));
+    }
+
+    void Disabled()
+    {
+        M2ScanCache cache;
+        CHECK(!cache.Enabled());
+        cache.Store(g_module, 1, 0x1000);
+        CHECK(!cache.Find(g_module, 1));
+        CHECK(cache.Save());
+    }
+
+    void Corrupt()
+    {
+        {
+            std::ofstream file(g_file, std::ios::trunc);
+            file << "{ not json";
+        }
+        M2ScanCache cache(g_file);
+        CHECK(!cache.Find(g_module, 1));
+        cache.Store(g_module, 1, 0x1000);
+        CHECK(cache.Save());
+        CHECK(M2ScanCache(g_file).Find(g_module, 1) == 0x1000);
+    }
+
+    void Prune()
+    {
+        std::filesystem::remove(g_file);
+        {
+            M2ScanCache cache(g_file);
+            cache.Store(g_module, 1, 0x1000);
+            cache.Store(g_module, 2, 0x2000);
+            cache.Save();
+        }
+
+        // Only the second is looked up again, launch after launch.
+        for (uint64_t launch = 0; launch < 12; ++launch) {
+            M2ScanCache cache(g_file);
+            CHECK(cache.Find(g_module, 2) == 0x2000);
+            cache.Store(g_module, 100 + launch, 0x3000);
+            cache.Save();
+        }
+
+        M2ScanCache cache(g_file);
+        CHECK(!cache.Find(g_module, 1));
+        CHECK(cache.Find(g_module, 2) == 0x2000);
+        CHECK(!cache.Find(g_module, 100));
+        CHECK(cache.Find(g_module, 111) == 0x3000);
+    }
+
+    void Refresh()
+    {
+        std::filesystem::remove(g_file);
+        {
+            M2ScanCache cache(g_file);
+            cache.Store(g_module, 1, 0x1000);
+            CHECK(cache.Dirty());
+            cache.Save();
+            CHECK(!cache.Dirty());
+        }
+
+        // Found where it was, nothing to write.
+        for (int launch = 0; launch < 3; ++launch) {
+            M2ScanCache cache(g_file);
+            CHECK(cache.Find(g_module, 1) == 0x1000);
+            cache.Store(g_module, 1, 0x1000);
+            CHECK(!cache.Dirty());
+        }
+
+        // Launches where something else was saved age it, and it's brought
+        // up to date every few of them.
+        std::vector<uint64_t> refreshed;
+        for (uint64_t launch = 1; launch <= 9; ++launch) {
+            M2ScanCache cache(g_file);
+            CHECK(cache.Find(g_module, 1) == 0x1000);
+            if (cache.Dirty()) refreshed.push_back(launch);
+            cache.Store(g_module, 100 + launch, 0x3000);
+            cache.Save();
+        }
+        CHECK(refreshed == std::vector<uint64_t>({ 4, 8 }));
+    }
+
+    void Threads()
+    {
+        std::filesystem::remove(g_file);
+        M2ScanCache cache(g_file);
+
+        std::vector<std::thread> threads;
+        for (uint64_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&cache, t] {
+                for (uint64_t i = 0; i < 200; ++i) {
+                    uint64_t signature = t * 1000 + i;
+                    cache.Store(g_module, signature, static_cast<size_t>(i));
+                    if (cache.Find(g_module, signature) != i) {
+                        ++g_failures;
+                    }
+                    if (i % 50 == 0) cache.Save();
+                }
+            });
+        }
+        for (auto & thread : threads) thread.join();
+        CHECK(cache.Save());
+
+        M2ScanCache saved(g_file);
+        CHECK(saved.Find(g_module, 3199) == 199);
+    }
+}
+
+int main()
+{
+    std::filesystem::remove_all(g_file.parent_path());
+
+    RoundTrip();
+    Disabled();
+    Corrupt();
+    Prune();
+    Refresh();
+    Threads();
+    return g_failures != 0;
+}
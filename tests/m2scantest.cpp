@@ -0,0 +1,137 @@
+#include "m2scan.h"
+#include "check.h"
+
+#include <random>
+
+namespace {
+    std::mt19937 g_random(1);
+
+    // One byte at a time, what the vector paths have to agree with.
+    const unsigned char *Naive(const unsigned char *data, size_t size, const std::vector<int> &pattern)
+    {
+        if (pattern.empty() || size < pattern.size()) return nullptr;
+        for (size_t i = 0; i + pattern.size() <= size; ++i) {
+            if (M2Scan::Match(data + i, pattern.data(), pattern.size())) return data + i;
+        }
+        return nullptr;
+    }
+
+    // Few distinct bytes, so the anchors hit often and partial matches abound.
+    std::vector<unsigned char> Buffer(size_t size)
+    {
+        std::vector<unsigned char> buffer(size);
+        for (auto & byte : buffer) byte = static_cast<unsigned char>(g_random() % 4);
+        return buffer;
+    }
+
+    std::vector<int> Pattern(size_t length, int wildcards)
+    {
+        std::vector<int> pattern(length);
+        for (auto & value : pattern) value = static_cast<int>(g_random() % 100) < wildcards ? -1 : static_cast<int>(g_random() % 4);
+        return pattern;
+    }
+
+    void FindMatchesNaive()
+    {
+        // Every size up to a few vectors wide, for the tails of each path.
+        for (size_t size = 0; size < 200; ++size) {
+            for (int round = 0; round < 20; ++round) {
+                auto buffer = Buffer(size);
+                auto pattern = Pattern(1 + g_random() % 12, 30);
+                auto found = M2Scan::Find(buffer.data(), buffer.size(), pattern.data(), pattern.size());
+                CHECK(found == Naive(buffer.data(), buffer.size(), pattern));
+            }
+        }
+    }
+
+    void FindEdges()
+    {
+        std::vector<unsigned char> buffer(100, 0x90);
+        buffer[97] = 0x12;
+        buffer[98] = 0x34;
+        buffer[99] = 0x56;
+
+        // The last position a pattern fits at.
+        std::vector<int> tail = { 0x12, 0x34, 0x56 };
+        CHECK(M2Scan::Find(buffer.data(), buffer.size(), tail.data(), tail.size()) == buffer.data() + 97);
+
+        // Longer than the buffer, or empty.
+        std::vector<int> longer(101, 0x90);
+        CHECK(!M2Scan::Find(buffer.data(), buffer.size(), longer.data(), longer.size()));
+        CHECK(!M2Scan::Find(buffer.data(), buffer.size(), tail.data(), 0));
+        CHECK(!M2Scan::Find(nullptr, 0, tail.data(), tail.size()));
+
+        // Nothing but wildcards matches at the start.
+        std::vector<int> wild = { -1, -1, -1 };
+        CHECK(M2Scan::Find(buffer.data(), buffer.size(), wild.data(), wild.size()) == buffer.data());
+
+        // One fixed byte, anchored on it twice.
+        std::vector<int> single = { -1, 0x34, -1 };
+        CHECK(M2Scan::Find(buffer.data(), buffer.size(), single.data(), single.size()) == buffer.data() + 97);
+    }
+
+    void AnchorsAreRare()
+    {
+        // 0x00 and 0x8B are common, 0x5A and 0x7E aren't.
+        std::vector<int> pattern = { 0x00, 0x8B, 0x5A, -1, 0x7E };
+        auto [first, second] = M2Scan::Anchors(pattern.data(), pattern.size());
+        CHECK((first == 2 || first == 4) && (second == 2 || second == 4) && first != second);
+
+        std::vector<int> wild = { -1, -1 };
+        auto [none, other] = M2Scan::Anchors(wild.data(), wild.size());
+        CHECK(none == wild.size() && other == wild.size());
+    }
+
+    void FindAllMatchesFind()
+    {
+        // Big enough to be split across threads, with matches on the seams.
+        auto buffer = Buffer(5 << 20);
+        std::vector<std::vector<int>> patterns;
+        for (int i = 0; i < 200; ++i) {
+            size_t at = g_random() % (buffer.size() - 16);
+            if (i < 3) at = (buffer.size() + 2) / 4 * (i + 1) - 3;
+            auto & pattern = patterns.emplace_back(buffer.begin() + at, buffer.begin() + at + 6 + g_random() % 10);
+            for (auto & value : pattern) {
+                if (g_random() % 5 == 0) value = -1;
+            }
+        }
+        // Ones with no two fixed bytes together, and ones that aren't there.
+        patterns.push_back({ buffer[100], -1, buffer[102], -1, buffer[104] });
+        patterns.push_back({ 0x10, 0x20, 0x30, 0x40 });
+        patterns.push_back({ -1, -1 });
+
+        std::vector<M2Scan::Request> requests;
+        for (auto & pattern : patterns) requests.push_back({ pattern.data(), pattern.size() });
+        M2Scan::FindAll(buffer.data(), buffer.size(), requests);
+
+        for (size_t i = 0; i < patterns.size(); ++i) {
+            auto found = Naive(buffer.data(), buffer.size(), patterns[i]);
+            CHECK(requests[i].result == (found ? static_cast<size_t>(found - buffer.data()) : M2Scan::npos));
+        }
+    }
+
+    void FindAllSmall()
+    {
+        // Shorter than the patterns, and a buffer of a single byte pair.
+        std::vector<unsigned char> buffer = { 0x12, 0x34 };
+        std::vector<int> fits = { 0x12, 0x34 };
+        std::vector<int> longer = { 0x12, 0x34, 0x56 };
+        std::vector<M2Scan::Request> requests = { { fits.data(), fits.size() }, { longer.data(), longer.size() } };
+        M2Scan::FindAll(buffer.data(), buffer.size(), requests);
+        CHECK(requests[0].result == 0);
+        CHECK(requests[1].result == M2Scan::npos);
+
+        M2Scan::FindAll(nullptr, 0, requests);
+        CHECK(requests[0].result == M2Scan::npos);
+    }
+}
+
+int main()
+{
+    FindMatchesNaive();
+    FindEdges();
+    AnchorsAreRare();
+    FindAllMatchesFind();
+    FindAllSmall();
+    return g_failures != 0;
+}
@@ -0,0 +1,80 @@
+#include "m2signature.h"
+#include "check.h"
+
+#include <vector>
+
+namespace {
+    // Literals are parsed by the compiler.
+    constexpr M2Signature g_literal = "8B 4C 24 ?? 0F ?";
+    static_assert(g_literal.Length() == 6);
+    static_assert(g_literal.Pattern()[0] == 0x8B && g_literal.Pattern()[3] == -1 && g_literal.Pattern()[5] == -1);
+    static_assert(g_literal.Area() == M2Signature::Region::Code);
+    static_assert(M2Signature::Data("41 42 43").Area() == M2Signature::Region::Data);
+
+    void ParseMatchesLiterals()
+    {
+        auto parsed = M2Signature::Parse("8b 4c 24 ?? 0f ??");
+        CHECK(parsed.Valid());
+        CHECK(parsed.Length() == g_literal.Length());
+        CHECK(parsed.Hash() == g_literal.Hash());
+        CHECK(parsed.First() == g_literal.First() && parsed.Second() == g_literal.Second());
+
+        // Data signatures hash apart from code ones with the same bytes.
+        CHECK(M2Signature::Parse("41 42 43", M2Signature::Region::Data).Hash() == M2Signature::Data("41 42 43").Hash());
+        CHECK(M2Signature::Parse("41 42 43").Hash() != M2Signature::Data("41 42 43").Hash());
+    }
+
+    void ParseRejectsMalformed()
+    {
+        CHECK(!M2Signature::Parse("").Valid());
+        CHECK(!M2Signature::Parse("   ").Valid());
+        CHECK(!M2Signature::Parse("8B4C").Valid());
+        CHECK(!M2Signature::Parse("8B 4").Valid());
+        CHECK(!M2Signature::Parse("8B XY").Valid());
+        CHECK(!M2Signature::Parse("8B ???").Valid());
+
+        std::string full;
+        for (size_t i = 0; i < M2Signature::Capacity; ++i) full += "AA ";
+        CHECK(M2Signature::Parse(full).Valid());
+        CHECK(!M2Signature::Parse(full + "AA").Valid());
+    }
+
+    void FromBytes()
+    {
+        const unsigned char bytes[] = { 0x41, 0x42, 0x43 };
+        auto signature = M2Signature::FromBytes(bytes, sizeof(bytes));
+        CHECK(signature.Valid());
+        CHECK(signature.Area() == M2Signature::Region::Data);
+        CHECK(signature.Hash() == M2Signature::Data("41 42 43").Hash());
+
+        // Too long to hold, scanned for without a signature instead.
+        std::vector<unsigned char> longer(M2Signature::Capacity + 1, 0x41);
+        CHECK(!M2Signature::FromBytes(longer.data(), longer.size()).Valid());
+        CHECK(M2Signature::FromBytes(longer.data(), M2Signature::Capacity).Valid());
+        CHECK(!M2Signature::FromBytes(bytes, 0).Valid());
+    }
+
+    void Find()
+    {
+        std::vector<unsigned char> buffer(64, 0x90);
+        const unsigned char code[] = { 0x8B, 0x4C, 0x24, 0x10, 0x0F, 0x85 };
+        std::copy(std::begin(code), std::end(code), buffer.begin() + 40);
+
+        CHECK(g_literal.Find(buffer.data(), buffer.size()) == buffer.data() + 40);
+        CHECK(g_literal.Match(buffer.data() + 40));
+        CHECK(!M2Signature::Parse("").Find(buffer.data(), buffer.size()));
+
+        std::vector<M2Scan::Request> requests = { g_literal.Request() };
+        M2Scan::FindAll(buffer.data(), buffer.size(), requests);
+        CHECK(requests[0].result == 40);
+    }
+}
+
+int main()
+{
+    ParseMatchesLiterals();
+    ParseRejectsMalformed();
+    FromBytes();
+    Find();
+    return g_failures != 0;
+}
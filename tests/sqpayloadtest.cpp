@@ -0,0 +1,87 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+
+#include "check.h"
+
+// The VM's own vector, over a stand-in for the allocator it's built against.
+typedef int64_t SQInteger;
+typedef uint64_t SQUnsignedInteger;
+
+#include "squirrel/squirrel/squtils.h"
+
+namespace {
+    size_t g_allocations = 0;
+    size_t g_bytes = 0;
+
+    // An SQObjectPtr on x64, a type tag and an 8 byte value.
+    struct Slot
+    {
+        uint32_t type = 0;
+        int64_t value = 0;
+    };
+    static_assert(sizeof(Slot) == 16);
+
+    void Reset()
+    {
+        g_allocations = 0;
+        g_bytes = 0;
+    }
+
+    // A Ketchup run as the CD-ROM patch payload is built, an array made at
+    // its size with sq_newarray and its slots filled in place. SQArray::Create
+    // adds one SQ_MALLOC for the array itself on top of what's counted here.
+    void Sized()
+    {
+        for (size_t size : { 1, 16, 2048, 0x930 * 16, 0x100000 }) {
+            Reset();
+            {
+                sqvector<Slot> values;
+                values.resize(size);
+                for (size_t i = 0; i < size; i++) values[i].value = static_cast<int64_t>(i & 0xFF);
+                CHECK(g_allocations == 1);
+                CHECK(g_bytes == size * sizeof(Slot));
+            }
+        }
+    }
+
+    // Appended a byte at a time, as a script building one would, it's grown
+    // by doubling and allocated again each time.
+    void Appended()
+    {
+        Reset();
+        {
+            sqvector<Slot> values;
+            for (size_t i = 0; i < 2048; i++) values.push_back({ 2, static_cast<int64_t>(i & 0xFF) });
+            CHECK(g_allocations == 10);
+        }
+    }
+}
+
+void *sq_vm_malloc(SQUnsignedInteger size)
+{
+    ++g_allocations;
+    g_bytes = size;
+    return std::malloc(size);
+}
+
+void *sq_vm_realloc(void *p, SQUnsignedInteger, SQUnsignedInteger size)
+{
+    ++g_allocations;
+    g_bytes = size;
+    return std::realloc(p, size);
+}
+
+void sq_vm_free(void *p, SQUnsignedInteger)
+{
+    std::free(p);
+}
+
+int main()
+{
+    Sized();
+    Appended();
+    return g_failures != 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// Stands in for src/stdafx.h, which brings in the game's script VM and the
+// hooking libraries, with only what the Ketchup sources built here use.
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include "win32.h"
+#endif
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <cinttypes>
+#include <climits>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <vector>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <numeric>
+#include <memory>
+#include <optional>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <unordered_set>
+#include <mutex>
+#include <functional>
+
+#include "spdlog.h"
+#include "nlohmann/json.hpp"
+using json = nlohmann::json;
@@ -0,0 +1,113 @@
+#pragma once
+
+// The Win32 file calls the Ketchup sources make, over POSIX, so the tests
+// build off Windows too. Only as much as those sources use.
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef void *HANDLE;
+typedef unsigned long DWORD;
+typedef int BOOL;
+
+union LARGE_INTEGER
+{
+	long long QuadPart;
+};
+
+struct OVERLAPPED
+{
+	DWORD Offset;
+	DWORD OffsetHigh;
+};
+
+#define INVALID_HANDLE_VALUE (reinterpret_cast<HANDLE>(-1))
+#define GENERIC_READ 0x80000000
+#define FILE_SHARE_READ 0x1
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define PAGE_READONLY 0x2
+#define FILE_MAP_READ 0x4
+
+namespace win32 {
+	// A handle is its descriptor plus one, so none is ever null.
+	inline HANDLE Handle(int fd)
+	{
+		return fd < 0 ? INVALID_HANDLE_VALUE : reinterpret_cast<HANDLE>(static_cast<intptr_t>(fd) + 1);
+	}
+
+	inline int Descriptor(HANDLE handle)
+	{
+		return static_cast<int>(reinterpret_cast<intptr_t>(handle) - 1);
+	}
+
+	// munmap needs the length a view was mapped with.
+	inline std::mutex g_viewMutex;
+	inline std::map<const void *, size_t> g_views;
+}
+
+inline HANDLE CreateFileW(const char *path, DWORD, DWORD, void *, DWORD, DWORD, HANDLE)
+{
+	return win32::Handle(open(path, O_RDONLY));
+}
+
+inline BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER *size)
+{
+	struct stat status;
+	if (fstat(win32::Descriptor(file), &status) != 0) return 0;
+	size->QuadPart = status.st_size;
+	return 1;
+}
+
+inline BOOL ReadFile(HANDLE file, void *data, DWORD size, DWORD *read, OVERLAPPED *overlapped)
+{
+	off_t offset = static_cast<off_t>((static_cast<uint64_t>(overlapped->OffsetHigh) << 32) | overlapped->Offset);
+	ssize_t count = pread(win32::Descriptor(file), data, size, offset);
+	if (count < 0) return 0;
+	*read = static_cast<DWORD>(count);
+	return 1;
+}
+
+// A mapping is a second descriptor on the file.
+inline HANDLE CreateFileMappingW(HANDLE file, void *, DWORD, DWORD, DWORD, const char *)
+{
+	int fd = dup(win32::Descriptor(file));
+	return fd < 0 ? nullptr : win32::Handle(fd);
+}
+
+inline void *MapViewOfFile(HANDLE mapping, DWORD, DWORD, DWORD, size_t)
+{
+	int fd = win32::Descriptor(mapping);
+	struct stat status;
+	if (fstat(fd, &status) != 0 || status.st_size == 0) return nullptr;
+
+	size_t size = static_cast<size_t>(status.st_size);
+	void *view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED) return nullptr;
+
+	std::lock_guard lock(win32::g_viewMutex);
+	win32::g_views[view] = size;
+	return view;
+}
+
+inline BOOL UnmapViewOfFile(const void *view)
+{
+	std::lock_guard lock(win32::g_viewMutex);
+	auto it = win32::g_views.find(view);
+	if (it == win32::g_views.end()) return 0;
+	munmap(const_cast<void *>(view), it->second);
+	win32::g_views.erase(it);
+	return 1;
+}
+
+inline BOOL CloseHandle(HANDLE handle)
+{
+	return close(win32::Descriptor(handle)) == 0;
+}